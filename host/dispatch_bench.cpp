@@ -0,0 +1,199 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Register dispatch micro-benchmark (host build)
+ */
+
+#include "dispatch_bench.h"
+#include "main.h"
+#include "replay.h"
+#include "spi_analyzer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Minimum duration of each benchmark run (in seconds)
+#define MIN_BENCHMARK_TIME 0.5
+// Number of alternating runs (the best run counts)
+#define NUM_BENCHMARK_RUNS 5
+
+
+// Switch-based register dispatch as used before the register shadow
+// (extended to burst writes for a fair comparison)
+class SwitchDispatch
+{
+public:
+    SwitchDispatch(TimingAnalyzer &ta) : timingAnalyzer(ta), symbolTimeout(0x64), preambleLength(8) {}
+
+    // not inlined into the benchmark loop (like SpiAnalyzer::OnTrx, which is in a different file)
+    __attribute__((noinline)) void OnTrx(uint64_t time, const uint8_t *startTrx, const uint8_t *endTrx)
+    {
+        uint8_t reg = *startTrx;
+        if (reg == 0x00)
+        {
+            timingAnalyzer.OnDataReceived(endTrx - startTrx - 1);
+            return;
+        }
+
+        if ((reg & 0x80U) == 0)
+            return;
+
+        reg &= 0x7fU;
+        for (const uint8_t *p = startTrx + 1; p < endTrx; p++, reg = (reg + 1) & 0x7fU)
+            OnRegWrite(time, reg, *p);
+    }
+
+private:
+    void OnRegWrite(uint64_t time, uint8_t reg, uint8_t value)
+    {
+        switch (reg)
+        {
+        case 0x01: // OpMode
+            timingAnalyzer.SetLongRangeMode((value & 0x80) != 0 ? LongrangeModeLora : LongrangeModeFSK);
+            if ((value & 0x07U) == 0x03)
+                timingAnalyzer.OnTxStart(time);
+            else if ((value & 0x07U) == 0x06)
+                timingAnalyzer.OnRxStart(time);
+            break;
+        case 0x1d: // ModemConfig1
+            if ((value >> 4U) < NUM_BANDWIDTHS)
+            {
+                timingAnalyzer.SetBandwidth(value >> 4U);
+                uint8_t cr = ((value >> 1U) & 0x7U) + 4;
+                if (cr >= 5 && cr <= 8)
+                {
+                    timingAnalyzer.SetCodingRate(cr);
+                    timingAnalyzer.SetImplicitHeader(value & 0x01U);
+                }
+            }
+            break;
+        case 0x1e: // ModemConfig2
+            if ((value >> 4U) >= 6 && (value >> 4U) <= 12)
+                timingAnalyzer.SetSpreadingFactor(value >> 4U);
+            timingAnalyzer.SetCrcOn((value >> 2U) & 0x01U);
+            symbolTimeout = (uint16_t)((symbolTimeout & 0xff) | ((value & 0x03U) << 8));
+            timingAnalyzer.SetRxSymbolTimeout(symbolTimeout);
+            break;
+        case 0x1f: // SymbTimeoutLsb
+            symbolTimeout = (uint16_t)((symbolTimeout & 0xff00) | value);
+            timingAnalyzer.SetRxSymbolTimeout(symbolTimeout);
+            break;
+        case 0x20: // PreambleMsb
+            preambleLength = (uint16_t)((preambleLength & 0xff) | (value << 8));
+            timingAnalyzer.SetPreambleLength(preambleLength);
+            break;
+        case 0x21: // PreambleLsb
+            preambleLength = (uint16_t)((preambleLength & 0xff00) | value);
+            timingAnalyzer.SetPreambleLength(preambleLength);
+            break;
+        case 0x22: // PayloadLength
+            timingAnalyzer.SetTxPayloadLength(value);
+            break;
+        case 0x26: // ModemConfig3
+            timingAnalyzer.SetLowDataRateOptimization((value >> 3U) & 0x01U);
+            break;
+        default:
+            break;
+        }
+    }
+
+    TimingAnalyzer &timingAnalyzer;
+    uint16_t symbolTimeout;
+    uint16_t preambleLength;
+};
+
+// Recorded SPI transactions (stored back to back)
+struct TransactionMix
+{
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> times;
+    std::vector<size_t> ends;
+    uint64_t numRegWrites = 0;
+};
+
+static void AddTransaction(const RecordedEvent &event, void *context)
+{
+    if (event.type != RecordedEventSpi || event.len == 0)
+        return;
+
+    TransactionMix *mix = (TransactionMix *)context;
+    mix->data.insert(mix->data.end(), event.data, event.data + event.len);
+    mix->times.push_back(event.time);
+    mix->ends.push_back(mix->data.size());
+    if ((event.data[0] & 0x80) != 0 && event.data[0] != 0x80)
+        mix->numRegWrites += event.len - 1;
+}
+
+// Runs the transactions through the analyzer until the minimum time has elapsed.
+// Returns the number of register writes per second.
+template <typename Analyzer>
+static double Benchmark(Analyzer &analyzer, const TransactionMix &mix)
+{
+    const uint8_t *data = mix.data.data();
+    size_t numTrx = mix.ends.size();
+    uint64_t numPasses = 0;
+    double seconds;
+    auto startTime = std::chrono::steady_clock::now();
+
+    do
+    {
+        size_t start = 0;
+        for (size_t i = 0; i < numTrx; i++)
+        {
+            analyzer.OnTrx(mix.times[i], data + start, data + mix.ends[i]);
+            start = mix.ends[i];
+        }
+        numPasses++;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+        seconds = elapsed.count();
+    } while (seconds < MIN_BENCHMARK_TIME);
+
+    return numPasses * mix.numRegWrites / seconds;
+}
+
+int RunDispatchBenchmark(const char *path)
+{
+    TransactionMix mix;
+    if (!ReadEventFile(path, AddTransaction, &mix))
+        return 1;
+    if (mix.numRegWrites == 0)
+    {
+        fprintf(stderr, "No register writes in %s\n", path);
+        return 1;
+    }
+
+    // one extra byte so a transaction never ends at the end of the "circular" buffer
+    mix.data.push_back(0);
+
+    // the analysis output is not of interest
+    HostSerial.SetEnabled(false);
+
+    TimingAnalyzer switchTimingAnalyzer;
+    SwitchDispatch switchDispatch(switchTimingAnalyzer);
+    TimingAnalyzer tableTimingAnalyzer;
+    SpiAnalyzer tableDispatch(mix.data.data(), mix.data.size(), tableTimingAnalyzer);
+
+    // alternate the runs so both see the same machine load
+    double switchRate = 0;
+    double tableRate = 0;
+    for (int i = 0; i < NUM_BENCHMARK_RUNS; i++)
+    {
+        switchRate = std::max(switchRate, Benchmark(switchDispatch, mix));
+        Output.Flush();
+        tableRate = std::max(tableRate, Benchmark(tableDispatch, mix));
+        Output.Flush();
+    }
+
+    HostSerial.SetEnabled(true);
+
+    printf("%lu transactions, %llu register writes\n", (unsigned long)mix.ends.size(),
+            (unsigned long long)mix.numRegWrites);
+    printf("switch dispatch: %8.1f M register writes/s\n", switchRate / 1e6);
+    printf("table dispatch:  %8.1f M register writes/s\n", tableRate / 1e6);
+    return 0;
+}
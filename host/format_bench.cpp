@@ -0,0 +1,105 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Formatting micro-benchmark (host build)
+ */
+
+#include "format_bench.h"
+#include "format_samples.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Minimum duration of each benchmark run (in seconds)
+#define MIN_BENCHMARK_TIME 0.5
+// Number of alternating runs (the best run counts)
+#define NUM_BENCHMARK_RUNS 5
+#define TEXT_BUF_LEN 256
+
+// Verifies that both implementations produce the same text.
+// Returns the number of differences.
+static int VerifySamples(const std::vector<FormatSample> &samples)
+{
+    int numDifferences = 0;
+    for (const FormatSample &sample : samples)
+    {
+        if (sample.argType == FormatSample::ArgUnsupported)
+        {
+            fprintf(stderr, "Format \"%s\": unsupported conversion\n", sample.fmt.c_str());
+            numDifferences++;
+            continue;
+        }
+
+        char text[TEXT_BUF_LEN];
+        char expected[TEXT_BUF_LEN];
+        size_t len = sample.Format(text, sizeof(text));
+        size_t expectedLen = sample.Reference(expected, sizeof(expected));
+        if (len != expectedLen || strcmp(text, expected) != 0)
+        {
+            fprintf(stderr, "Format \"%s\":\n  expected: \"%s\"\n  actual:   \"%s\"\n",
+                    sample.fmt.c_str(), expected, text);
+            numDifferences++;
+        }
+    }
+    return numDifferences;
+}
+
+// Formats all samples until the minimum time has elapsed.
+// Returns the number of formatted calls per second.
+static double Benchmark(const std::vector<FormatSample> &samples, bool useReference)
+{
+    char text[TEXT_BUF_LEN];
+    uint64_t numPasses = 0;
+    size_t totalLen = 0;
+    double seconds;
+    auto startTime = std::chrono::steady_clock::now();
+
+    do
+    {
+        for (const FormatSample &sample : samples)
+            totalLen += useReference ? sample.Reference(text, sizeof(text)) : sample.Format(text, sizeof(text));
+        numPasses++;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+        seconds = elapsed.count();
+    } while (seconds < MIN_BENCHMARK_TIME);
+
+    // prevent the compiler from optimizing the formatting away
+    if (totalLen == 0)
+        fprintf(stderr, "No output\n");
+
+    return numPasses * samples.size() / seconds;
+}
+
+int RunFormatBenchmark()
+{
+    std::vector<const char *> formats = CollectFormatStrings();
+    std::vector<FormatSample> samples = CreateFormatSamples(formats);
+    int numDifferences = VerifySamples(samples);
+    if (numDifferences != 0)
+    {
+        fprintf(stderr, "%d of %lu format samples differ from snprintf\n", numDifferences,
+                (unsigned long)samples.size());
+        return 1;
+    }
+
+    // alternate the runs so both see the same machine load
+    double referenceRate = 0;
+    double formatRate = 0;
+    for (int i = 0; i < NUM_BENCHMARK_RUNS; i++)
+    {
+        referenceRate = std::max(referenceRate, Benchmark(samples, true));
+        formatRate = std::max(formatRate, Benchmark(samples, false));
+    }
+
+    printf("%lu format samples of %lu call sites identical to snprintf\n", (unsigned long)samples.size(),
+            (unsigned long)formats.size());
+    printf("snprintf:       %8.2f M calls/s\n", referenceRate / 1e6);
+    printf("FormatToBuffer: %8.2f M calls/s\n", formatRate / 1e6);
+    return 0;
+}
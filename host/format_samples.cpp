@@ -0,0 +1,194 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Format strings of all call sites with sample arguments (host build)
+ */
+
+#include "format_samples.h"
+#include "format.h"
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+// Start and end of the section "fmtstr" (provided by the linker)
+extern "C" const char __start_fmtstr[];
+extern "C" const char __stop_fmtstr[];
+
+static const long long INT_VALUES[] = { 0, 1, -42, 255, 65535, INT_MIN, INT_MAX };
+static const long long LONG_VALUES[] = { 0, -46394, 997945, 1234567890, LONG_MIN, LONG_MAX };
+static const long long UNSIGNED_VALUES[] = { 0, 8, 254, 65535, UINT_MAX };
+static const long long UNSIGNED_LONG_VALUES[] = { 0, 5, 868, 125000, 0xabcdef, (long long)ULONG_MAX };
+static const char *const STRING_VALUES[] = { "", "Unconfirmed data up", "LinkCheck" };
+
+
+// Determines the argument type of the conversion (without the leading '%')
+// and returns the position after the conversion
+static const char *ParseConversion(const char *fmt, FormatSample::ArgType &argType)
+{
+    while (*fmt == '-' || *fmt == '0')
+        fmt++;
+    while (*fmt >= '0' && *fmt <= '9')
+        fmt++;
+    bool isLong = false;
+    while (*fmt == 'l' || *fmt == 'h')
+    {
+        isLong = isLong || *fmt == 'l';
+        fmt++;
+    }
+
+    char conversion = *fmt;
+    if (conversion == 'd' || conversion == 'i' || conversion == 'c')
+        argType = isLong ? FormatSample::ArgLong : FormatSample::ArgInt;
+    else if (conversion == 'u' || conversion == 'x' || conversion == 'X')
+        argType = isLong ? FormatSample::ArgUnsignedLong : FormatSample::ArgUnsigned;
+    else if (conversion == 's')
+        argType = FormatSample::ArgString;
+    else
+        argType = FormatSample::ArgUnsupported;
+
+    return conversion != 0 ? fmt + 1 : fmt;
+}
+
+static void AddSamples(std::vector<FormatSample> &samples, const std::string &fmt, FormatSample::ArgType argType,
+        int piece)
+{
+    const long long *values = nullptr;
+    size_t numValues = 0;
+    switch (argType)
+    {
+    case FormatSample::ArgInt:
+        values = INT_VALUES;
+        numValues = ARRAY_LEN(INT_VALUES);
+        break;
+    case FormatSample::ArgLong:
+        values = LONG_VALUES;
+        numValues = ARRAY_LEN(LONG_VALUES);
+        break;
+    case FormatSample::ArgUnsigned:
+        values = UNSIGNED_VALUES;
+        numValues = ARRAY_LEN(UNSIGNED_VALUES);
+        break;
+    case FormatSample::ArgUnsignedLong:
+        values = UNSIGNED_LONG_VALUES;
+        numValues = ARRAY_LEN(UNSIGNED_LONG_VALUES);
+        break;
+    case FormatSample::ArgString:
+        for (size_t i = 0; i < ARRAY_LEN(STRING_VALUES); i++)
+            samples.push_back({ fmt, argType, 0, STRING_VALUES[i], piece });
+        return;
+    default:
+        samples.push_back({ fmt, argType, 0, nullptr, piece });
+        return;
+    }
+
+    // characters are only printed for printable values
+    bool isChar = fmt[fmt.size() - 1] == 'c';
+    for (size_t i = 0; i < numValues; i++)
+        samples.push_back({ fmt, argType, isChar ? 'A' + (long long)i : values[i], nullptr, piece });
+}
+
+size_t FormatSample::Format(char *buf, size_t size) const
+{
+    const char *f = fmt.c_str();
+    switch (argType)
+    {
+    case ArgInt:
+        return FormatToBuffer(buf, size, f, (int)value);
+    case ArgLong:
+        return FormatToBuffer(buf, size, f, (long)value);
+    case ArgUnsigned:
+        return FormatToBuffer(buf, size, f, (unsigned)value);
+    case ArgUnsignedLong:
+        return FormatToBuffer(buf, size, f, (unsigned long)value);
+    case ArgString:
+        return FormatToBuffer(buf, size, f, str);
+    default:
+        return FormatToBuffer(buf, size, f);
+    }
+}
+
+size_t FormatSample::Reference(char *buf, size_t size) const
+{
+    // the format strings are not literals (checked by the compiler at the call sites)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+    const char *f = fmt.c_str();
+    int len;
+    switch (argType)
+    {
+    case ArgInt:
+        len = snprintf(buf, size, f, (int)value);
+        break;
+    case ArgLong:
+        len = snprintf(buf, size, f, (long)value);
+        break;
+    case ArgUnsigned:
+        len = snprintf(buf, size, f, (unsigned)value);
+        break;
+    case ArgUnsignedLong:
+        len = snprintf(buf, size, f, (unsigned long)value);
+        break;
+    case ArgString:
+        len = snprintf(buf, size, f, str);
+        break;
+    default:
+        len = snprintf(buf, size, f, 0);
+        break;
+    }
+#pragma GCC diagnostic pop
+    // length of the text written (like `FormatToBuffer`)
+    return len < 0 ? 0 : ((size_t)len < size ? (size_t)len : size - 1);
+}
+
+std::vector<const char *> CollectFormatStrings()
+{
+    std::vector<const char *> formats;
+    const char *p = __start_fmtstr;
+    while (p < __stop_fmtstr)
+    {
+        if (*p != 0)
+            formats.push_back(p);
+        p += strlen(p) + 1;
+    }
+    return formats;
+}
+
+std::vector<FormatSample> CreateFormatSamples(const std::vector<const char *> &formats)
+{
+    std::vector<FormatSample> samples;
+    for (const char *fmt : formats)
+    {
+        const char *start = fmt;
+        const char *p = fmt;
+        int piece = 0;
+        while (*p != 0)
+        {
+            if (*p != '%')
+            {
+                p++;
+                continue;
+            }
+            if (p[1] == '%')
+            {
+                p += 2;
+                continue;
+            }
+
+            FormatSample::ArgType argType;
+            p = ParseConversion(p + 1, argType);
+            AddSamples(samples, std::string(start, p), argType, piece++);
+            start = p;
+        }
+
+        if (p > start || start == fmt)
+            AddSamples(samples, std::string(start, p), FormatSample::ArgNone, piece);
+    }
+    return samples;
+}
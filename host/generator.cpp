@@ -0,0 +1,455 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Synthetic LMIC traffic generator (host build)
+ */
+
+#include "generator.h"
+#include "main.h"
+#include "event_processor.h"
+#include "host_capture.h"
+#include "timing_analyzer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Delay between RX1 and RX2
+#define RX2_DELAY_OFFSET 1000000
+// Time between opmode TX/RX and the start of transmission/reception
+#define RAMP_UP_TIME 40
+// Number of symbols the RX window is opened early
+#define RX_EARLY_SYMBOLS 2
+// Interval between register writes of a configuration sequence
+#define CONFIG_WRITE_INTERVAL 60
+
+// Frf register values of the uplink channels (868.1, 868.3 and 868.5 MHz)
+// and of RX2 (869.525 MHz)
+static const uint32_t UPLINK_CHANNELS[] = { 0xd90666, 0xd91333, 0xd92000 };
+#define NUM_UPLINK_CHANNELS (sizeof(UPLINK_CHANNELS) / sizeof(UPLINK_CHANNELS[0]))
+#define RX2_CHANNEL 0xd9619a
+
+enum SimEventType
+{
+    SimEventSpi,
+    SimEventDio0,
+    SimEventDio1
+};
+
+struct SimEvent
+{
+    uint64_t time;
+    SimEventType type;
+    std::vector<uint8_t> data;
+};
+
+// Generator for the events of a single TX/RX cycle
+class CycleGenerator
+{
+public:
+    CycleGenerator(const GeneratorConfig &config) : config(config), rng(config.seed) {}
+
+    // Generates the events of a cycle starting at the given time.
+    // Returns the time of the last event.
+    uint64_t Generate(uint64_t start, std::vector<SimEvent> &events);
+
+private:
+    uint64_t Configure(uint64_t t, uint32_t frf, uint8_t sf, bool crcOn, uint8_t payloadLength, uint16_t symbTimeout);
+    uint64_t Burst(uint64_t t);
+    uint64_t ReadDownlink(uint64_t t);
+    void WriteReg(uint64_t time, uint8_t reg, uint8_t value);
+    void ReadReg(uint64_t time, uint8_t reg) { AddSpi(time, { reg, 0x00 }); }
+    void AddSpi(uint64_t time, std::vector<uint8_t> data) { events->push_back({ time, SimEventSpi, data }); }
+    void AddDio(uint64_t time, SimEventType type) { events->push_back({ time, type, {} }); }
+    int32_t Jitter();
+
+    double SymbolDuration(uint8_t sf) const { return (1 << sf) * 1000000.0 / config.bandwidth; }
+    double AirTime(uint8_t sf, bool crcOn, uint8_t payloadLength) const;
+
+    const GeneratorConfig &config;
+    std::mt19937 rng;
+    std::vector<SimEvent> *events = nullptr;
+    uint16_t fCnt = 0;
+    uint32_t numCycles = 0;
+};
+
+
+static int RunAnalysis(const std::vector<SimEvent> &events, uint64_t &now, uint32_t serviceTime);
+static void EmitEvents(const std::vector<SimEvent> &events);
+static void DeliverEvent(const SimEvent &event);
+static int BandwidthIndex(uint32_t bandwidth);
+
+
+int Generate(const GeneratorConfig &config)
+{
+    CycleGenerator generator(config);
+    std::vector<SimEvent> events;
+    HostSerial.SetEnabled(!config.quiet && !config.emit);
+
+    uint64_t cycleStart = 1000000;
+    uint64_t consumerTime = 0;
+    uint64_t numEvents = 0;
+    uint64_t lastEventTime = 0;
+    uint32_t maxBurstEvents = 0;
+
+    for (uint32_t i = 0; i < config.numCycles; i++)
+    {
+        events.clear();
+        uint64_t cycleEnd = generator.Generate(cycleStart, events);
+
+        // stable sort so events with identical time keep their order
+        std::stable_sort(events.begin(), events.end(),
+                [](const SimEvent &a, const SimEvent &b) { return a.time < b.time; });
+
+        if (config.emit)
+        {
+            EmitEvents(events);
+        }
+        else
+        {
+            uint32_t n = (uint32_t)RunAnalysis(events, consumerTime, config.serviceTime);
+            if (n > maxBurstEvents)
+                maxBurstEvents = n;
+        }
+
+        numEvents += events.size();
+        lastEventTime = cycleEnd;
+
+        // the next cycle may only start after the current one has ended
+        cycleStart = std::max(cycleStart + config.cycleInterval, cycleEnd + RAMP_UP_TIME);
+    }
+
+    if (config.emit)
+        return 0;
+
+    HostSerial.SetEnabled(true);
+    PrintStatistics();
+    Output.Flush();
+
+    double seconds = lastEventTime / 1000000.0;
+    fprintf(stderr, "%llu events in %.1fs simulated time (%.1f events/s), largest batch: %u events\n",
+            (unsigned long long)numEvents, seconds, seconds > 0 ? numEvents / seconds : 0.0, maxBurstEvents);
+    return 0;
+}
+
+// Runs the events through the analysis pipeline.
+//
+// The interrupt handlers queue the events at the event time, preempting
+// the main loop. The main loop processes one event at a time, taking
+// `serviceTime` per event, until the queue is empty. `now` is the time
+// of the main loop (it carries over to the next call).
+// Returns the largest number of events processed in a single batch.
+static int RunAnalysis(const std::vector<SimEvent> &events, uint64_t &now, uint32_t serviceTime)
+{
+    size_t next = 0;
+    int maxBatchSize = 0;
+
+    while (next < events.size())
+    {
+        // main loop idle: wait for the next event
+        if (now < events[next].time)
+            now = events[next].time;
+
+        int batchSize = 0;
+        while (true)
+        {
+            // interrupts that occurred in the meantime
+            while (next < events.size() && events[next].time <= now)
+                DeliverEvent(events[next++]);
+
+            if (!ProcessNextEvent())
+                break;
+
+            batchSize++;
+            now += serviceTime;
+        }
+
+        CompleteBatch(batchSize);
+        if (batchSize > maxBatchSize)
+            maxBatchSize = batchSize;
+    }
+
+    return maxBatchSize;
+}
+
+static void DeliverEvent(const SimEvent &event)
+{
+    if (event.type == SimEventSpi)
+        SimulateSpiTrx(event.time, event.data.data(), event.data.size());
+    else
+        SimulateDioEdge(event.type == SimEventDio0 ? 0 : 1, event.time);
+}
+
+// Writes the events in the replay format
+static void EmitEvents(const std::vector<SimEvent> &events)
+{
+    for (const SimEvent &event : events)
+    {
+        printf("%llu ", (unsigned long long)event.time);
+        if (event.type == SimEventSpi)
+        {
+            fputs("SPI", stdout);
+            for (uint8_t b : event.data)
+                printf(" %02x", b);
+            putchar('\n');
+        }
+        else
+        {
+            puts(event.type == SimEventDio0 ? "DIO0" : "DIO1");
+        }
+    }
+}
+
+uint64_t CycleGenerator::Generate(uint64_t start, std::vector<SimEvent> &events)
+{
+    this->events = &events;
+
+    // uplink: configuration, FIFO write, TX
+    uint32_t frf = UPLINK_CHANNELS[numCycles % NUM_UPLINK_CHANNELS];
+    numCycles++;
+    uint64_t t = Configure(start, frf, config.spreadingFactor, true, config.payloadLength, 0);
+    WriteReg(t, 0x0e, 0x80); // FifoTxBaseAddr
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x0d, 0x80); // FifoAddrPtr
+    t += CONFIG_WRITE_INTERVAL;
+    std::vector<uint8_t> fifo(1 + config.payloadLength);
+    fifo[0] = 0x80;
+    for (size_t i = 1; i < fifo.size(); i++)
+        fifo[i] = (uint8_t)rng();
+    if (config.payloadLength >= 13)
+    {
+        // LoRaWAN unconfirmed data up: MHDR, DevAddr, FCtrl, FCnt, FPort, payload, MIC
+        const uint8_t header[] = { 0x40, 0x78, 0x56, 0x34, 0x12, 0x00, (uint8_t)fCnt, (uint8_t)(fCnt >> 8), 0x01 };
+        memcpy(&fifo[1], header, sizeof(header));
+        fCnt++;
+    }
+    AddSpi(t, fifo);
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x01, 0x83); // OpMode TX
+    Burst(t);
+
+    uint64_t txDone = t + RAMP_UP_TIME + (uint64_t)AirTime(config.spreadingFactor, true, config.payloadLength) + Jitter();
+    AddDio(txDone, SimEventDio0);
+    t = txDone + CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x01, 0x80); // OpMode sleep
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x12, 0xff); // clear IrqFlags
+
+    // RX1 and RX2
+    bool hasDownlink = rng() % 100 < config.downlinkPercent;
+    for (int window = 1; window <= 2; window++)
+    {
+        uint8_t sf = window == 1 ? config.spreadingFactor : config.rx2SpreadingFactor;
+        double symbolDuration = SymbolDuration(sf);
+        uint64_t delay = config.rx1Delay + (window == 2 ? RX2_DELAY_OFFSET : 0);
+        uint64_t rxStart = txDone + delay - (uint64_t)(RX_EARLY_SYMBOLS * symbolDuration) + Jitter();
+        uint16_t symbTimeout = 8;
+
+        Configure(rxStart - 11 * CONFIG_WRITE_INTERVAL, window == 1 ? frf : RX2_CHANNEL, sf, false, 64, symbTimeout);
+        WriteReg(rxStart, 0x01, 0x86); // OpMode RX single
+        Burst(rxStart);
+
+        if (hasDownlink)
+        {
+            t = rxStart + RAMP_UP_TIME + (uint64_t)AirTime(sf, false, config.downlinkLength) + Jitter();
+            AddDio(t, SimEventDio0);
+            return ReadDownlink(t + CONFIG_WRITE_INTERVAL);
+        }
+
+        t = rxStart + RAMP_UP_TIME + (uint64_t)(symbTimeout * symbolDuration) + Jitter();
+        AddDio(t, SimEventDio1);
+        t += CONFIG_WRITE_INTERVAL;
+        WriteReg(t, 0x01, 0x80); // OpMode sleep
+    }
+
+    return t;
+}
+
+// Writes the LoRa configuration like LMIC does before TX and RX.
+// Returns the time after the last write.
+uint64_t CycleGenerator::Configure(uint64_t t, uint32_t frf, uint8_t sf, bool crcOn, uint8_t payloadLength, uint16_t symbTimeout)
+{
+    bool ldro = SymbolDuration(sf) > 16000;
+
+    WriteReg(t, 0x01, 0x80); // OpMode sleep
+    t += CONFIG_WRITE_INTERVAL;
+    AddSpi(t, { 0x86, (uint8_t)(frf >> 16), (uint8_t)(frf >> 8), (uint8_t)frf }); // Frf
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x1d, (uint8_t)((BandwidthIndex(config.bandwidth) << 4) | 0x02)); // ModemConfig1: CR 4/5, explicit header
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x1e, (uint8_t)((sf << 4) | (crcOn ? 0x04 : 0x00) | ((symbTimeout >> 8) & 0x03))); // ModemConfig2
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x26, ldro ? 0x0c : 0x04); // ModemConfig3: AGC, LDRO
+    t += CONFIG_WRITE_INTERVAL;
+    if (symbTimeout != 0)
+    {
+        WriteReg(t, 0x1f, (uint8_t)symbTimeout); // SymbTimeoutLsb
+        t += CONFIG_WRITE_INTERVAL;
+    }
+    WriteReg(t, 0x20, 0x00); // PreambleMsb
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x21, 0x08); // PreambleLsb
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x22, payloadLength); // PayloadLength
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x40, crcOn ? 0x40 : 0x00); // DioMapping1
+    t += CONFIG_WRITE_INTERVAL;
+    return t;
+}
+
+// Generates a burst of IrqFlags reads
+uint64_t CycleGenerator::Burst(uint64_t t)
+{
+    for (uint32_t i = 0; i < config.burstLength; i++)
+    {
+        t += config.burstInterval;
+        ReadReg(t, 0x12);
+    }
+    return t;
+}
+
+// Reads the downlink packet like LMIC does after RX done.
+// Returns the time of the last transaction.
+uint64_t CycleGenerator::ReadDownlink(uint64_t t)
+{
+    ReadReg(t, 0x12); // IrqFlags
+    t += CONFIG_WRITE_INTERVAL;
+    ReadReg(t, 0x13); // RxNbBytes
+    t += CONFIG_WRITE_INTERVAL;
+    ReadReg(t, 0x10); // FifoRxCurrentAddr
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x0d, 0x00); // FifoAddrPtr
+    t += CONFIG_WRITE_INTERVAL;
+    std::vector<uint8_t> fifo(1 + config.downlinkLength, 0x00);
+    AddSpi(t, fifo);
+    t += CONFIG_WRITE_INTERVAL;
+    WriteReg(t, 0x01, 0x80); // OpMode sleep
+    return t;
+}
+
+void CycleGenerator::WriteReg(uint64_t time, uint8_t reg, uint8_t value)
+{
+    AddSpi(time, { (uint8_t)(reg | 0x80), value });
+}
+
+int32_t CycleGenerator::Jitter()
+{
+    if (config.jitter == 0)
+        return 0;
+    return (int32_t)(rng() % (2 * config.jitter + 1)) - (int32_t)config.jitter;
+}
+
+// Time on air in us (see Semtech AN1200.13)
+double CycleGenerator::AirTime(uint8_t sf, bool crcOn, uint8_t payloadLength) const
+{
+    double symbolDuration = SymbolDuration(sf);
+    int de = symbolDuration > 16000 ? 1 : 0;
+    int numerator = 8 * payloadLength - 4 * sf + 28 + (crcOn ? 16 : 0);
+    int denominator = 4 * (sf - 2 * de);
+    int payloadSymbols = 8 + std::max((numerator + denominator - 1) / denominator * 5, 0);
+    return (8 + 4.25 + payloadSymbols) * symbolDuration;
+}
+
+static int BandwidthIndex(uint32_t bandwidth)
+{
+    for (int i = 0; i < NUM_BANDWIDTHS; i++)
+        if (BANDWIDTH_TABLE[i] == bandwidth)
+            return i;
+    return -1;
+}
+
+bool ParseGeneratorOptions(int argc, char *argv[], GeneratorConfig &config)
+{
+    for (int i = 0; i < argc; i++)
+    {
+        const char *option = argv[i];
+        if (strcmp(option, "--help") == 0)
+            return false;
+        if (strcmp(option, "--emit") == 0)
+        {
+            config.emit = true;
+            continue;
+        }
+        if (strcmp(option, "--quiet") == 0)
+        {
+            config.quiet = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Missing value for %s\n", option);
+            return false;
+        }
+
+        char *end;
+        unsigned long value = strtoul(argv[++i], &end, 10);
+        if (*end != '\0')
+        {
+            fprintf(stderr, "Invalid value for %s\n", option);
+            return false;
+        }
+
+        if (strcmp(option, "--cycles") == 0)
+            config.numCycles = value;
+        else if (strcmp(option, "--interval") == 0)
+            config.cycleInterval = value;
+        else if (strcmp(option, "--sf") == 0)
+            config.spreadingFactor = (uint8_t)value;
+        else if (strcmp(option, "--bw") == 0)
+            config.bandwidth = value;
+        else if (strcmp(option, "--rx2-sf") == 0)
+            config.rx2SpreadingFactor = (uint8_t)value;
+        else if (strcmp(option, "--payload") == 0)
+            config.payloadLength = (uint8_t)value;
+        else if (strcmp(option, "--rx-delay") == 0)
+            config.rx1Delay = value;
+        else if (strcmp(option, "--jitter") == 0)
+            config.jitter = value;
+        else if (strcmp(option, "--downlink") == 0)
+            config.downlinkPercent = (uint8_t)value;
+        else if (strcmp(option, "--downlink-len") == 0)
+            config.downlinkLength = (uint8_t)value;
+        else if (strcmp(option, "--burst") == 0)
+            config.burstLength = value;
+        else if (strcmp(option, "--burst-interval") == 0)
+            config.burstInterval = value;
+        else if (strcmp(option, "--service") == 0)
+            config.serviceTime = value;
+        else if (strcmp(option, "--seed") == 0)
+            config.seed = value;
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", option);
+            return false;
+        }
+    }
+
+    if (config.spreadingFactor < 6 || config.spreadingFactor > 12
+            || config.rx2SpreadingFactor < 6 || config.rx2SpreadingFactor > 12)
+    {
+        fprintf(stderr, "Spreading factor must be between 6 and 12\n");
+        return false;
+    }
+
+    if (BandwidthIndex(config.bandwidth) < 0)
+    {
+        fprintf(stderr, "Unsupported bandwidth %lu Hz\n", (unsigned long)config.bandwidth);
+        return false;
+    }
+
+    if (config.rx1Delay < 100000)
+    {
+        fprintf(stderr, "RX delay must be at least 100000us\n");
+        return false;
+    }
+
+    return true;
+}
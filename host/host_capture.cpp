@@ -0,0 +1,36 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Simulated event capturing for the host build
+ */
+
+#include "host_capture.h"
+#include "event_processor.h"
+
+// Total number of bytes written to the SPI buffer
+static uint32_t spiWritePos = 0;
+
+uint32_t SpiWritePosition()
+{
+    return spiWritePos;
+}
+
+void SimulateSpiTrx(uint64_t time, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        SpiDataBuf[spiWritePos & (SPI_DATA_BUF_LEN - 1)] = data[i];
+        spiWritePos++;
+    }
+
+    QueueEvent(EventTypeSpiTrx, time, spiWritePos);
+}
+
+void SimulateDioEdge(int dio, uint64_t time)
+{
+    QueueEvent(dio == 0 ? EventTypeDone : EventTypeTimeout, time);
+}
@@ -0,0 +1,27 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Simulated registers and HAL functions for the host build
+ */
+
+#include "stm32f1xx_hal.h"
+
+// SysTick configured for a 1 ms period at 72 MHz
+SysTick_Type HostSysTick = { 0, 71999, {}, 0 };
+SCB_Type HostSCB = { 0 };
+
+static uint32_t halTick = 0;
+
+void HAL_IncTick()
+{
+    halTick++;
+}
+
+uint32_t HAL_GetTick()
+{
+    return halTick;
+}
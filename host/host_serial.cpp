@@ -0,0 +1,39 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Serial output for the host build (writes to stdout)
+ */
+
+#include "host_serial.h"
+#include <cstdio>
+#include <cstring>
+
+HostSerialImpl HostSerial;
+
+void HostSerialImpl::Init()
+{
+}
+
+bool HostSerialImpl::Write(const uint8_t *data, size_t len, TxPriority)
+{
+    if (!isEnabled)
+        return true;
+
+    if (capture != nullptr)
+    {
+        capture->append((const char *)data, len);
+        return true;
+    }
+
+    fwrite(data, 1, len, stdout);
+    return true;
+}
+
+void HostSerialImpl::Print(const char *str)
+{
+    Write((const uint8_t *)str, strlen(str));
+}
@@ -0,0 +1,20 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Register dispatch micro-benchmark (host build)
+ */
+
+#ifndef DISPATCH_BENCH_H
+#define DISPATCH_BENCH_H
+
+// Runs the SPI transactions of an event file repeatedly through the
+// table-driven register dispatch of `SpiAnalyzer` and through the
+// previous switch-based dispatch and reports the throughput of both.
+// Returns 0 on success.
+int RunDispatchBenchmark(const char *path);
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Formatting micro-benchmark (host build)
+ */
+
+#ifndef FORMAT_BENCH_H
+#define FORMAT_BENCH_H
+
+// Formats the format strings of all call sites with sample arguments
+// (see format_samples.h) using `FormatToBuffer` and `snprintf`,
+// verifies that the results are identical and reports the throughput
+// of both. Returns 0 on success, 1 if the results differ.
+int RunFormatBenchmark();
+
+#endif
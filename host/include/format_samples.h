@@ -0,0 +1,55 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Format strings of all call sites with sample arguments (host build)
+ */
+
+#ifndef FORMAT_SAMPLES_H
+#define FORMAT_SAMPLES_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Piece of a format string (literal text and at most one conversion)
+// with a sample argument of the type expected by the conversion
+struct FormatSample
+{
+    enum ArgType
+    {
+        ArgNone,
+        ArgInt,
+        ArgLong,
+        ArgUnsigned,
+        ArgUnsignedLong,
+        ArgString,
+        // conversion not supported by format.h
+        ArgUnsupported
+    };
+
+    std::string fmt;
+    ArgType argType;
+    long long value;
+    const char *str;
+    // Index of the piece within its format string
+    int piece;
+
+    // Formats the sample with `FormatToBuffer` (see format.h)
+    size_t Format(char *buf, size_t size) const;
+    // Formats the sample with `snprintf`
+    size_t Reference(char *buf, size_t size) const;
+};
+
+// Returns the format strings of all `SERIAL_PRINTF` call sites.
+// The host build collects them in the section "fmtstr" (see output_buffer.h).
+std::vector<const char *> CollectFormatStrings();
+
+// Splits the format strings into pieces with a single conversion and
+// creates samples with typical and extreme argument values for each piece
+std::vector<FormatSample> CreateFormatSamples(const std::vector<const char *> &formats);
+
+#endif
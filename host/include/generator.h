@@ -0,0 +1,62 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Synthetic LMIC traffic generator (host build)
+ */
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdint.h>
+
+// Configuration of the traffic generator (times in us)
+struct GeneratorConfig
+{
+    // Number of TX/RX cycles
+    uint32_t numCycles = 1000;
+    // Interval between the start of two cycles
+    uint32_t cycleInterval = 5000000;
+    // Spreading factor and bandwidth (in Hz) of uplink and RX1
+    uint8_t spreadingFactor = 7;
+    uint32_t bandwidth = 125000;
+    // Spreading factor of RX2
+    uint8_t rx2SpreadingFactor = 12;
+    // Uplink payload length
+    uint8_t payloadLength = 13;
+    // Delay between TX done and RX1 (RX2 is 1s later)
+    uint32_t rx1Delay = 1000000;
+    // Maximum deviation (+/-) of the radio events from the nominal time
+    uint32_t jitter = 20;
+    // Percentage of cycles with a downlink in RX1
+    uint8_t downlinkPercent = 10;
+    // Downlink payload length
+    uint8_t downlinkLength = 17;
+    // Number of status register reads following each opmode change
+    // (as a busy-polling MAC would do)
+    uint32_t burstLength = 0;
+    // Interval between the status register reads
+    uint32_t burstInterval = 50;
+    // Processing time of the main loop per event
+    uint32_t serviceTime = 20;
+    // Seed of the random number generator
+    uint32_t seed = 1;
+    // Write events in replay format instead of running the analysis
+    bool emit = false;
+    // Suppress the analysis output (statistics are still printed)
+    bool quiet = false;
+};
+
+// Parses the generator options (see usage in main.cpp).
+// Returns false if an option is invalid.
+bool ParseGeneratorOptions(int argc, char *argv[], GeneratorConfig &config);
+
+// Generates the traffic and either runs it through the analysis pipeline
+// (simulating interrupts preempting the main loop) or writes it to stdout.
+// Returns 0 on success.
+int Generate(const GeneratorConfig &config);
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Simulated event capturing for the host build
+ */
+
+#ifndef HOST_CAPTURE_H
+#define HOST_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Simulates an SPI transaction (NSS returning to HIGH at the given time):
+// the data is written to the SPI buffer like the DMA does and
+// an SPI event is queued like the NSS interrupt handler does.
+void SimulateSpiTrx(uint64_t time, const uint8_t *data, size_t len);
+
+// Simulates a rising edge on DIO0 or DIO1 at the given time
+void SimulateDioEdge(int dio, uint64_t time);
+
+#endif
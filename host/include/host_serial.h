@@ -0,0 +1,44 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Serial output for the host build (writes to stdout)
+ */
+
+#ifndef HOST_SERIAL_H
+#define HOST_SERIAL_H
+
+#include "tx_ring.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class HostSerialImpl
+{
+public:
+    void Init();
+    // Writes a message (never dropped as stdout blocks)
+    bool Write(const uint8_t *data, size_t len, TxPriority priority = TxPriorityNormal);
+    void Print(const char *str);
+
+    // Number of messages and bytes dropped so far (always 0)
+    TxDropStatistics DropStatistics() { return TxDropStatistics{ 0, 0 }; }
+
+    // Enables or disables the output (e.g. to suppress it during load tests)
+    void SetEnabled(bool enabled) { isEnabled = enabled; }
+
+    // Appends the output to the given string instead of writing it
+    // to stdout (e.g. for unit tests); `nullptr` restores stdout
+    void SetCapture(std::string *capture) { this->capture = capture; }
+
+private:
+    bool isEnabled = true;
+    std::string *capture = nullptr;
+};
+
+extern HostSerialImpl HostSerial;
+
+#endif
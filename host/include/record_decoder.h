@@ -0,0 +1,27 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Decoder for the binary output (host build)
+ */
+
+#ifndef RECORD_DECODER_H
+#define RECORD_DECODER_H
+
+// Reads the binary output of a probe built with BINARY_OUTPUT=1
+// (see binary_record.h) and writes it to stdout, either as the text
+// the probe outputs in text mode or as CSV with one line per event.
+//
+// If the probe was built with DEFERRED_FORMAT=1, `formatStringsPath` must
+// refer to the format strings extracted from the firmware (section "fmtstr").
+// Otherwise, it can be `nullptr`.
+//
+// Invalid records are skipped (reading resumes after the next 0 byte)
+// and counted on stderr. If `path` is "-", the records are read from stdin.
+// Returns 0 on success, 1 on error.
+int DecodeRecords(const char *path, bool csv, const char *formatStringsPath);
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Replay of recorded events (host build)
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum RecordedEventType
+{
+    RecordedEventSpi,
+    RecordedEventDio0,
+    RecordedEventDio1
+};
+
+// Event read from an event file
+struct RecordedEvent
+{
+    uint64_t time;
+    RecordedEventType type;
+    // SPI data (only valid during the handler call)
+    const uint8_t *data;
+    size_t len;
+};
+
+typedef void (*EventFileHandler)(const RecordedEvent &event, void *context);
+
+// Reads an event file and runs the events through the analysis
+// pipeline as fast as possible.
+//
+// The event file is a text file with one event per line:
+//
+//     <time in us> SPI <data bytes in hex>
+//     <time in us> DIO0
+//     <time in us> DIO1
+//
+// Empty lines and lines starting with '#' are ignored. The data bytes
+// may be separated by spaces.
+//
+// The analysis output is written to stdout, the number of events and
+// the event rate to stderr. Returns 0 on success, 1 on error.
+// If `path` is "-", the events are read from stdin.
+int Replay(const char *path);
+
+// Reads an event file (see `Replay()` for the format) and calls `handler`
+// for each event. Errors are reported on stderr. Returns false on error.
+bool ReadEventFile(const char *path, EventFileHandler handler, void *context);
+
+// Reads events from a zero-terminated string in the event file format
+// (e.g. a trace embedded in a test) and calls `handler` for each event.
+// Errors are reported on stderr. Returns false on error.
+bool ReadEventText(const char *text, EventFileHandler handler, void *context);
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Minimal CMSIS shim for the host build
+ */
+
+#ifndef STM32F1XX_H
+#define STM32F1XX_H
+
+#include <stdint.h>
+
+// There are no interrupts on the host. Interrupt handlers are
+// simulated by calling them from the main thread.
+static inline void __disable_irq() {}
+static inline void __enable_irq() {}
+
+// SysTick current value register. Tests can install a hook that is
+// called on each read to simulate the counter running (and the SysTick
+// interrupt preempting the code) while the time is being read.
+struct HostSysTickValue
+{
+    uint32_t value = 0;
+    void (*onRead)() = nullptr;
+
+    operator uint32_t()
+    {
+        if (onRead != nullptr)
+            onRead();
+        return value;
+    }
+
+    HostSysTickValue &operator=(uint32_t newValue)
+    {
+        value = newValue;
+        return *this;
+    }
+};
+
+// Simulated SysTick registers (see host_hal.cpp)
+struct SysTick_Type
+{
+    uint32_t CTRL;
+    uint32_t LOAD;
+    HostSysTickValue VAL;
+    uint32_t CALIB;
+};
+
+// Simulated system control block registers (see host_hal.cpp)
+struct SCB_Type
+{
+    uint32_t ICSR;
+};
+
+#define SCB_ICSR_PENDSTSET_Msk (1UL << 26)
+
+extern SysTick_Type HostSysTick;
+extern SCB_Type HostSCB;
+
+#define SysTick (&HostSysTick)
+#define SCB (&HostSCB)
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Minimal HAL shim for the host build
+ */
+
+#ifndef STM32F1XX_HAL_H
+#define STM32F1XX_HAL_H
+
+#include "stm32f1xx.h"
+
+// Increments the HAL tick (called by the SysTick handler)
+void HAL_IncTick();
+
+// Returns the HAL tick (milliseconds since start)
+uint32_t HAL_GetTick();
+
+#endif
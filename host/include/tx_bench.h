@@ -0,0 +1,24 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Transmit ring simulation and benchmark (host build)
+ */
+
+#ifndef TX_BENCH_H
+#define TX_BENCH_H
+
+// Writes numbered messages at several rates into a `TxRing` (see tx_ring.h)
+// connected to a simulated UART and USB transport, which complete the
+// transfers asynchronously in simulated time, for each overflow policy and
+// with a mix of normal and low priority messages. Verifies the received stream
+// and reports the throughput, the number of lost and corrupted messages and
+// the time spent blocking. Also measures the processing time of `TxRing::Write`.
+// Returns 0 on success, 1 if the received stream is inconsistent, contains
+// corrupted messages or lost messages have not been counted as dropped.
+int RunTxBenchmark();
+
+#endif
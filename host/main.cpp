@@ -0,0 +1,170 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Main code of the host build
+ */
+
+#include "main.h"
+#include "dispatch_bench.h"
+#include "event_processor.h"
+#include "format_bench.h"
+#include "generator.h"
+#include "host_capture.h"
+#include "record_decoder.h"
+#include "replay.h"
+#include "tx_bench.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+// The unit tests (see test/) provide their own main()
+#if !defined(PIO_UNIT_TESTING)
+
+// Writes a single register
+static void WriteReg(uint64_t time, uint8_t reg, uint8_t value)
+{
+    uint8_t data[2] = { (uint8_t)(reg | 0x80), value };
+    SimulateSpiTrx(time, data, ARRAY_LEN(data));
+}
+
+// Runs a typical LoRaWAN class A cycle (SF7 uplink, RX1 and RX2 without downlink)
+static void RunDemo()
+{
+    uint64_t t = 1000000;
+
+    // TX: SF7, BW 125kHz, CR 4/5, explicit header, CRC on, 13 bytes payload
+    WriteReg(t, 0x01, 0x80);
+    WriteReg(t += 100, 0x1d, 0x72);
+    WriteReg(t += 100, 0x1e, 0x74);
+    WriteReg(t += 100, 0x26, 0x04);
+    WriteReg(t += 100, 0x22, 13);
+    WriteReg(t += 100, 0x01, 0x83);
+    uint64_t txDone = t + 46336 + 40;
+    SimulateDioEdge(0, txDone);
+    ProcessEvents();
+
+    // RX1 (1s after TX done): SF7, CRC off, timeout after 5 symbols
+    t = txDone + 1000000 - 2000;
+    WriteReg(t, 0x01, 0x80);
+    WriteReg(t += 100, 0x1d, 0x72);
+    WriteReg(t += 100, 0x1e, 0x70);
+    WriteReg(t += 100, 0x1f, 5);
+    WriteReg(t += 100, 0x01, 0x86);
+    SimulateDioEdge(1, t + 5 * 1024 + 30);
+    ProcessEvents();
+
+    // RX2 (2s after TX done): SF12, CRC off, timeout after 5 symbols
+    t = txDone + 2000000 - 20000;
+    WriteReg(t, 0x01, 0x80);
+    WriteReg(t += 100, 0x1d, 0x72);
+    WriteReg(t += 100, 0x1e, 0xc0);
+    WriteReg(t += 100, 0x26, 0x0c);
+    WriteReg(t += 100, 0x1f, 5);
+    WriteReg(t += 100, 0x01, 0x86);
+    SimulateDioEdge(1, t + 5 * 32768 + 30);
+    ProcessEvents();
+}
+
+static int Usage()
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "  probe                run demo cycle\n");
+    fprintf(stderr, "  probe replay <file>  run recorded events through analysis (- for stdin)\n");
+    fprintf(stderr, "  probe generate [options]  generate LMIC traffic and run it through analysis\n");
+    fprintf(stderr, "  probe bench <file>   benchmark register dispatch with recorded transactions\n");
+    fprintf(stderr, "  probe bench-format   verify formatting against snprintf and benchmark it\n");
+    fprintf(stderr, "  probe bench-tx       simulate serial output under load and benchmark it\n");
+    fprintf(stderr, "  probe decode [--csv] [--strings <fmtstr.bin>] <file>\n");
+    fprintf(stderr, "                       convert binary output to text or CSV (- for stdin)\n");
+    fprintf(stderr, "\nGenerator options (times in us):\n");
+    fprintf(stderr, "  --cycles <n>          number of TX/RX cycles (1000)\n");
+    fprintf(stderr, "  --interval <us>       interval between cycles (5000000)\n");
+    fprintf(stderr, "  --sf <sf>             spreading factor of uplink and RX1 (7)\n");
+    fprintf(stderr, "  --bw <hz>             bandwidth (125000)\n");
+    fprintf(stderr, "  --rx2-sf <sf>         spreading factor of RX2 (12)\n");
+    fprintf(stderr, "  --payload <n>         uplink payload length (13)\n");
+    fprintf(stderr, "  --rx-delay <us>       RX1 delay (1000000)\n");
+    fprintf(stderr, "  --jitter <us>         max. deviation of radio events (20)\n");
+    fprintf(stderr, "  --downlink <percent>  cycles with downlink in RX1 (10)\n");
+    fprintf(stderr, "  --downlink-len <n>    downlink payload length (17)\n");
+    fprintf(stderr, "  --burst <n>           status reads after each opmode change (0)\n");
+    fprintf(stderr, "  --burst-interval <us> interval between status reads (50)\n");
+    fprintf(stderr, "  --service <us>        main loop processing time per event (20)\n");
+    fprintf(stderr, "  --seed <n>            random seed (1)\n");
+    fprintf(stderr, "  --quiet               suppress analysis output\n");
+    fprintf(stderr, "  --emit                write events in replay format instead\n");
+    return 2;
+}
+
+// Parses the options of the decode command and decodes the file
+static int Decode(int argc, char *argv[])
+{
+    bool csv = false;
+    const char *formatStringsPath = nullptr;
+    for (int i = 0; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if (strcmp(argv[i], "--strings") == 0 && i + 1 < argc - 1)
+            formatStringsPath = argv[++i];
+        else
+            return Usage();
+    }
+
+    return DecodeRecords(argv[argc - 1], csv, formatStringsPath);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "replay") == 0)
+    {
+        int result = Replay(argv[2]);
+        PrintStatistics();
+        Output.Flush();
+        return result;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "bench") == 0)
+        return RunDispatchBenchmark(argv[2]);
+
+    if (argc == 2 && strcmp(argv[1], "bench-format") == 0)
+        return RunFormatBenchmark();
+
+    if (argc == 2 && strcmp(argv[1], "bench-tx") == 0)
+        return RunTxBenchmark();
+
+    if (argc >= 3 && strcmp(argv[1], "decode") == 0)
+        return Decode(argc - 2, argv + 2);
+
+    if (argc >= 2 && strcmp(argv[1], "generate") == 0)
+    {
+        GeneratorConfig config;
+        if (!ParseGeneratorOptions(argc - 2, argv + 2, config))
+            return Usage();
+        return Generate(config);
+    }
+
+    if (argc != 1)
+        return Usage();
+
+    Serial.Print("SX127x Probe (host)\r\n");
+    RunDemo();
+    PrintStatistics();
+    Output.Flush();
+    return 0;
+}
+
+#endif
+
+void Error_Handler()
+{
+    abort();
+}
+
+extern "C" void ErrorHandler() __attribute__((alias("Error_Handler")));
@@ -0,0 +1,497 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Decoder for the binary output (host build)
+ */
+
+#include "record_decoder.h"
+#include "main.h"
+#include "binary_record.h"
+#include "sample_output.h"
+#include "timing_analyzer.h"
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define READ_BUF_LEN 65536
+// Placeholder for CSV events without timestamp
+#define NO_TIME INT32_MIN
+// Maximum length of the text of a format record
+#define MAX_FORMATTED_LEN 1024
+
+// Format strings of a probe built with DEFERRED_FORMAT
+// (contents of the section "fmtstr", indexed by format ID)
+static std::vector<char> formatStrings;
+
+
+// Outputs the analysis results as CSV (one line per event).
+// The CSV is written to stdout directly (not via `Serial`) so
+// it does not depend on the output format of the build.
+class CsvSampleOutput
+{
+public:
+    CsvSampleOutput() : sampleNo(0), fCnt(-1), window(0)
+    {
+        fputs("sample,fcnt,event,window,time,modulation,frequency,payload,airtime,rampup,margin_start,margin_end,correction\r\n", stdout);
+    }
+
+    void SampleStart(int sampleNo, int32_t fCnt)
+    {
+        this->sampleNo = sampleNo;
+        this->fCnt = fCnt;
+        window = 0;
+    }
+
+    void TxDone(int32_t txStartTime, const ModulationInfo &modulation, int payloadLength, int32_t airTime, int32_t rampupTime)
+    {
+        PrintEvent("tx", txStartTime, &modulation);
+        printf(",%d,%ld,%ld,,,\r\n", payloadLength, (long)airTime, (long)rampupTime);
+    }
+
+    void PayloadLengthMismatch(int, int) {}
+    void Frame(const LoraWanFrame &) {}
+
+    void RxStart(int window, int32_t time)
+    {
+        this->window = window;
+        PrintEvent("rx_start", time, nullptr);
+        fputs(",,,,,,\r\n", stdout);
+    }
+
+    void RxDone(int, int32_t time)
+    {
+        PrintEvent("rx_done", time, nullptr);
+        fputs(",,,,,,\r\n", stdout);
+    }
+
+    void RxTimeout(int, int32_t time)
+    {
+        PrintEvent("rx_timeout", time, nullptr);
+        fputs(",,,,,,\r\n", stdout);
+    }
+
+    void RxAnalysis(const ModulationInfo &modulation, int payloadLength, int32_t airTime, int32_t windowEndTime, int32_t marginStart)
+    {
+        PrintEvent("downlink", windowEndTime - airTime, &modulation);
+        printf(",%d,%ld,,%ld,,\r\n", payloadLength, (long)airTime, (long)marginStart);
+    }
+
+    void TimeoutAnalysis(const ModulationInfo &modulation, int32_t timeoutLength, int32_t rampupTime,
+            int32_t marginStart, int32_t marginEnd, int32_t correction)
+    {
+        PrintEvent("timeout", NO_TIME, &modulation);
+        printf(",,%ld,%ld,%ld,%ld,%ld\r\n", (long)timeoutLength, (long)rampupTime,
+                (long)marginStart, (long)marginEnd, (long)correction);
+    }
+
+    void OutOfSync(const char *)
+    {
+        PrintEvent("out_of_sync", NO_TIME, nullptr);
+        fputs(",,,,,,\r\n", stdout);
+    }
+
+    // Text records (statistics etc.) are not included in the CSV output
+    void Text(const uint8_t *, size_t) {}
+
+private:
+    void PrintEvent(const char *event, int32_t time, const ModulationInfo *modulation)
+    {
+        printf("%d,", sampleNo);
+        if (fCnt >= 0)
+            printf("%ld", (long)fCnt);
+        printf(",%s,", event);
+        if (window != 0)
+            printf("%d", window);
+        fputs(",", stdout);
+        if (time != NO_TIME)
+            printf("%ld", (long)time);
+        fputs(",", stdout);
+
+        if (modulation == nullptr)
+        {
+            fputs(",", stdout);
+            return;
+        }
+
+        if (modulation->longRangeMode == LongrangeModeLora)
+            printf("SF%d/%lu", modulation->spreadingFactor, (unsigned long)BANDWIDTH_TABLE[modulation->bandwidthIndex]);
+        else
+            printf("FSK/%lu", (unsigned long)modulation->fskBitRate);
+        printf(",%lu", (unsigned long)modulation->frequency);
+    }
+
+    int sampleNo;
+    int32_t fCnt;
+    int window;
+};
+
+// Outputs the analysis results as text (like the probe in text mode)
+class TextDecoderOutput : public TextSampleOutput
+{
+public:
+    void Text(const uint8_t *text, size_t len) { Serial.Write(text, len); }
+};
+
+
+static bool LoadFormatStrings(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+
+    formatStrings.clear();
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+        formatStrings.insert(formatStrings.end(), buf, buf + n);
+    // terminate the last string even if the file is truncated
+    formatStrings.push_back(0);
+
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+// Formats the arguments of a format record with the format string
+// referenced by the record (all integers are passed as 64-bit values).
+// Returns the length of the text, or -1 if the format ID is unknown or
+// the arguments don't match the format string.
+static int FormatRecord(RecordReader &reader, char *text, size_t size)
+{
+    uint32_t formatId = reader.GetVarint();
+    if (!reader.IsValid() || formatId >= formatStrings.size())
+        return -1;
+
+    const char *fmt = &formatStrings[formatId];
+    size_t len = 0;
+    while (*fmt != 0 && len < size - 1)
+    {
+        if (*fmt != '%')
+        {
+            text[len++] = *fmt++;
+            continue;
+        }
+
+        // copy flags, width and precision; replace the length modifier
+        char spec[24];
+        size_t specLen = 0;
+        spec[specLen++] = *fmt++;
+        while (*fmt != 0 && strchr("-+ #0123456789.", *fmt) != nullptr && specLen < sizeof(spec) - 4)
+            spec[specLen++] = *fmt++;
+        while (*fmt != 0 && strchr("hlLjzt", *fmt) != nullptr)
+            fmt++;
+
+        char conversion = *fmt++;
+        int n;
+        if (conversion == '%')
+        {
+            n = snprintf(text + len, size - len, "%%");
+        }
+        else if (conversion == 's')
+        {
+            char str[MAX_RECORD_LEN];
+            reader.GetString(str, sizeof(str));
+            spec[specLen++] = 's';
+            spec[specLen] = 0;
+            n = snprintf(text + len, size - len, spec, str);
+        }
+        else if (conversion == 'c')
+        {
+            int64_t value = reader.GetSignedVarint64();
+            spec[specLen++] = 'c';
+            spec[specLen] = 0;
+            n = snprintf(text + len, size - len, spec, (int)value);
+        }
+        else if (conversion != 0 && strchr("diouxX", conversion) != nullptr)
+        {
+            int64_t value = reader.GetSignedVarint64();
+            spec[specLen++] = 'l';
+            spec[specLen++] = 'l';
+            spec[specLen++] = conversion;
+            spec[specLen] = 0;
+            if (conversion == 'd' || conversion == 'i')
+                n = snprintf(text + len, size - len, spec, (long long)value);
+            else
+                n = snprintf(text + len, size - len, spec, (unsigned long long)value);
+        }
+        else
+        {
+            return -1; // unsupported conversion
+        }
+
+        if (!reader.IsValid() || n < 0)
+            return -1;
+        len += (size_t)n < size - len ? n : size - len - 1;
+    }
+
+    // all arguments must have been consumed
+    if (reader.Remaining() != 0)
+        return -1;
+    return len;
+}
+
+static bool GetModulation(RecordReader &reader, ModulationInfo &modulation)
+{
+    memset(&modulation, 0, sizeof(modulation));
+    if (reader.GetByte() != 0)
+    {
+        modulation.longRangeMode = LongrangeModeLora;
+        modulation.spreadingFactor = reader.GetByte();
+        modulation.bandwidthIndex = reader.GetByte();
+        if (modulation.spreadingFactor < 6 || modulation.spreadingFactor > 12 || modulation.bandwidthIndex >= NUM_BANDWIDTHS)
+            return false;
+    }
+    else
+    {
+        modulation.longRangeMode = LongrangeModeFSK;
+        modulation.fskBitRate = reader.GetVarint();
+        modulation.fskFrequencyDeviation = reader.GetVarint();
+    }
+    modulation.frequency = reader.GetVarint() * 1000;
+    return reader.IsValid();
+}
+
+// Decodes a single record and passes it to the output.
+// `lastTime` is the timestamp of the previous event of the sample.
+// Returns false if the record is invalid.
+template <typename Sink>
+static bool DecodeRecord(const uint8_t *record, size_t len, Sink &output, int32_t &lastTime)
+{
+    if (len == 0)
+        return false;
+
+    RecordReader reader(record + 1, len - 1);
+    ModulationInfo modulation;
+
+    switch (record[0])
+    {
+    case RecordText:
+        output.Text(record + 1, len - 1);
+        return true;
+
+    case RecordFormat:
+    {
+        char text[MAX_FORMATTED_LEN];
+        int textLen = FormatRecord(reader, text, sizeof(text));
+        if (textLen < 0)
+            return false;
+        output.Text((const uint8_t *)text, textLen);
+        return true;
+    }
+
+    case RecordOutputDropped:
+    {
+        unsigned long numMessages = reader.GetVarint();
+        unsigned long numBytes = reader.GetVarint();
+        if (!reader.IsValid())
+            return false;
+        char text[64];
+        int textLen = snprintf(text, sizeof(text), OUTPUT_DROPPED_FORMAT, numMessages, numBytes);
+        output.Text((const uint8_t *)text, textLen);
+        return true;
+    }
+
+    case RecordSampleStart:
+    {
+        int sampleNo = reader.GetVarint();
+        int32_t fCnt = (int32_t)reader.GetVarint() - 1;
+        if (!reader.IsValid())
+            return false;
+        output.SampleStart(sampleNo, fCnt);
+        return true;
+    }
+
+    case RecordTxDone:
+    {
+        int32_t txStartTime = reader.GetSignedVarint();
+        if (!GetModulation(reader, modulation))
+            return false;
+        int payloadLength = reader.GetVarint();
+        int32_t airTime = reader.GetVarint();
+        int32_t rampupTime = reader.GetSignedVarint();
+        if (!reader.IsValid())
+            return false;
+        lastTime = 0;
+        output.TxDone(txStartTime, modulation, payloadLength, airTime, rampupTime);
+        return true;
+    }
+
+    case RecordPayloadLengthMismatch:
+    {
+        int configuredLength = reader.GetVarint();
+        int fifoLength = reader.GetVarint();
+        if (!reader.IsValid())
+            return false;
+        output.PayloadLengthMismatch(configuredLength, fifoLength);
+        return true;
+    }
+
+    case RecordLoraWanFrame:
+    {
+        LoraWanFrame frame;
+        frame.mType = (LoraWanMType)(reader.GetByte() >> 5);
+        if (frame.IsDataFrame())
+        {
+            frame.devAddr = 0;
+            for (int i = 0; i < 4; i++)
+                frame.devAddr |= (uint32_t)reader.GetByte() << (8 * i);
+            frame.fCtrl = reader.GetByte();
+            frame.fCnt = (uint16_t)reader.GetVarint();
+            frame.fPort = (int16_t)((int)reader.GetVarint() - 1);
+            frame.fOptsLen = frame.fCtrl & 0x0f;
+            for (int i = 0; i < frame.fOptsLen; i++)
+                frame.fOpts[i] = reader.GetByte();
+        }
+        if (!reader.IsValid())
+            return false;
+        output.Frame(frame);
+        return true;
+    }
+
+    case RecordRxStart:
+    case RecordRxDone:
+    case RecordRxTimeout:
+    {
+        int window = reader.GetByte();
+        int32_t time = lastTime + reader.GetSignedVarint();
+        if (!reader.IsValid())
+            return false;
+        lastTime = time;
+        if (record[0] == RecordRxStart)
+            output.RxStart(window, time);
+        else if (record[0] == RecordRxDone)
+            output.RxDone(window, time);
+        else
+            output.RxTimeout(window, time);
+        return true;
+    }
+
+    case RecordRxAnalysis:
+    {
+        if (!GetModulation(reader, modulation))
+            return false;
+        int payloadLength = reader.GetVarint();
+        int32_t airTime = reader.GetVarint();
+        int32_t marginStart = reader.GetSignedVarint();
+        if (!reader.IsValid())
+            return false;
+        output.RxAnalysis(modulation, payloadLength, airTime, lastTime, marginStart);
+        return true;
+    }
+
+    case RecordTimeoutAnalysis:
+    {
+        if (!GetModulation(reader, modulation))
+            return false;
+        int32_t timeoutLength = reader.GetVarint();
+        int32_t rampupTime = reader.GetSignedVarint();
+        int32_t marginStart = reader.GetSignedVarint();
+        int32_t marginEnd = reader.GetSignedVarint();
+        int32_t correction = reader.GetSignedVarint();
+        if (!reader.IsValid())
+            return false;
+        output.TimeoutAnalysis(modulation, timeoutLength, rampupTime, marginStart, marginEnd, correction);
+        return true;
+    }
+
+    case RecordOutOfSync:
+    {
+        char stage[MAX_RECORD_LEN];
+        memcpy(stage, record + 1, len - 1);
+        stage[len - 1] = 0;
+        output.OutOfSync(stage);
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+template <typename Sink>
+static bool DecodeStream(FILE *file, Sink &output, unsigned long &numRecords, unsigned long &numInvalid)
+{
+    static uint8_t buf[READ_BUF_LEN];
+    uint8_t framed[MAX_FRAMED_RECORD_LEN];
+    uint8_t record[MAX_FRAMED_RECORD_LEN];
+    size_t framedLen = 0;
+    bool isOverlong = false;
+    int32_t lastTime = 0;
+
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            uint8_t byte = buf[i];
+            if (byte != 0)
+            {
+                if (framedLen < sizeof(framed))
+                    framed[framedLen++] = byte;
+                else
+                    isOverlong = true;
+                continue;
+            }
+
+            // end of record
+            int len = isOverlong ? -1 : CobsDecode(framed, framedLen, record);
+            if (len > 0 && DecodeRecord(record, len, output, lastTime))
+                numRecords++;
+            else
+                numInvalid++;
+
+            framedLen = 0;
+            isOverlong = false;
+        }
+
+        Output.Flush();
+    }
+
+    // incomplete last record
+    if (framedLen > 0)
+        numInvalid++;
+
+    return ferror(file) == 0;
+}
+
+int DecodeRecords(const char *path, bool csv, const char *formatStringsPath)
+{
+    if (formatStringsPath != nullptr && !LoadFormatStrings(formatStringsPath))
+        return 1;
+
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+
+    unsigned long numRecords = 0;
+    unsigned long numInvalid = 0;
+    bool ok;
+    if (csv)
+    {
+        CsvSampleOutput output;
+        ok = DecodeStream(file, output, numRecords, numInvalid);
+    }
+    else
+    {
+        TextDecoderOutput output;
+        ok = DecodeStream(file, output, numRecords, numInvalid);
+    }
+    Output.Flush();
+
+    if (file != stdin)
+        fclose(file);
+
+    fprintf(stderr, "%lu records decoded, %lu invalid records skipped\n", numRecords, numInvalid);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Replay of recorded events (host build)
+ */
+
+#include "replay.h"
+#include "main.h"
+#include "event_processor.h"
+#include "host_capture.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#define READ_BUF_LEN 65536
+// Maximum line length (a 256 byte FIFO burst with separators fits easily)
+#define MAX_LINE_LEN 1024
+// Maximum number of data bytes in an SPI transaction
+#define MAX_TRX_LEN 300
+
+
+static bool ParseLine(const char *line, size_t len, unsigned long lineNo,
+        EventFileHandler handler, void *context);
+static int HexDigit(char ch);
+static void ReplayEvent(const RecordedEvent &event, void *context);
+
+
+int Replay(const char *path)
+{
+    unsigned long long numEvents = 0;
+    auto startTime = std::chrono::steady_clock::now();
+
+    bool ok = ReadEventFile(path, ReplayEvent, &numEvents);
+
+    Output.Flush();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    double seconds = elapsed.count();
+    fprintf(stderr, "%llu events in %.3fs (%.0f events/s)\n", numEvents, seconds,
+            seconds > 0 ? numEvents / seconds : 0.0);
+
+    return ok ? 0 : 1;
+}
+
+// Queues the event and processes it right away (so the queue never overflows)
+static void ReplayEvent(const RecordedEvent &event, void *context)
+{
+    if (event.type == RecordedEventSpi)
+        SimulateSpiTrx(event.time, event.data, event.len);
+    else
+        SimulateDioEdge(event.type == RecordedEventDio0 ? 0 : 1, event.time);
+
+    *(unsigned long long *)context += ProcessEvents();
+}
+
+bool ReadEventFile(const char *path, EventFileHandler handler, void *context)
+{
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+
+    static char buf[READ_BUF_LEN + MAX_LINE_LEN];
+    size_t lineStart = 0;
+    size_t bufLen = 0;
+    unsigned long lineNo = 0;
+    bool ok = true;
+
+    while (ok)
+    {
+        // Move the incomplete line to the front and refill the buffer
+        size_t carry = bufLen - lineStart;
+        memmove(buf, buf + lineStart, carry);
+        size_t n = fread(buf + carry, 1, READ_BUF_LEN, file);
+        bufLen = carry + n;
+        lineStart = 0;
+        bool isEof = n == 0;
+        if (isEof)
+        {
+            if (carry == 0)
+                break;
+            buf[bufLen++] = '\n'; // terminate last line
+        }
+
+        while (true)
+        {
+            const char *nl = (const char *)memchr(buf + lineStart, '\n', bufLen - lineStart);
+            if (nl == nullptr)
+                break;
+
+            size_t lineEnd = nl - buf;
+            lineNo++;
+            if (!ParseLine(buf + lineStart, lineEnd - lineStart, lineNo, handler, context))
+            {
+                ok = false;
+                break;
+            }
+
+            lineStart = lineEnd + 1;
+        }
+
+        if (isEof)
+            break;
+
+        if (bufLen - lineStart > MAX_LINE_LEN)
+        {
+            fprintf(stderr, "Line %lu: line too long\n", lineNo + 1);
+            ok = false;
+        }
+    }
+
+    if (file != stdin)
+        fclose(file);
+
+    return ok;
+}
+
+bool ReadEventText(const char *text, EventFileHandler handler, void *context)
+{
+    unsigned long lineNo = 0;
+    const char *line = text;
+    while (*line != 0)
+    {
+        const char *nl = strchr(line, '\n');
+        size_t len = nl != nullptr ? nl - line : strlen(line);
+        lineNo++;
+        if (!ParseLine(line, len, lineNo, handler, context))
+            return false;
+
+        line += len;
+        if (*line == '\n')
+            line++;
+    }
+
+    return true;
+}
+
+// Parses a line and passes the event to the handler
+static bool ParseLine(const char *line, size_t len, unsigned long lineNo,
+        EventFileHandler handler, void *context)
+{
+    const char *p = line;
+    const char *end = line + len;
+    if (p < end && end[-1] == '\r')
+        end--;
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    if (p == end || *p == '#')
+        return true;
+
+    // time stamp
+    uint64_t time = 0;
+    const char *timeStart = p;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        time = time * 10 + (*p - '0');
+        p++;
+    }
+    if (p == timeStart || p == end || (*p != ' ' && *p != '\t'))
+    {
+        fprintf(stderr, "Line %lu: invalid time stamp\n", lineNo);
+        return false;
+    }
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+
+    // event type
+    const char *type = p;
+    while (p < end && *p != ' ' && *p != '\t')
+        p++;
+    size_t typeLen = p - type;
+
+    if (typeLen == 4 && memcmp(type, "DIO0", 4) == 0)
+    {
+        handler({ time, RecordedEventDio0, nullptr, 0 }, context);
+        return true;
+    }
+
+    if (typeLen == 4 && memcmp(type, "DIO1", 4) == 0)
+    {
+        handler({ time, RecordedEventDio1, nullptr, 0 }, context);
+        return true;
+    }
+
+    if (typeLen != 3 || memcmp(type, "SPI", 3) != 0)
+    {
+        fprintf(stderr, "Line %lu: unknown event type\n", lineNo);
+        return false;
+    }
+
+    // SPI data
+    uint8_t data[MAX_TRX_LEN];
+    size_t dataLen = 0;
+    while (p < end)
+    {
+        if (*p == ' ' || *p == '\t')
+        {
+            p++;
+            continue;
+        }
+
+        int hi = HexDigit(*p);
+        int lo = p + 1 < end ? HexDigit(p[1]) : -1;
+        if (hi < 0 || lo < 0)
+        {
+            fprintf(stderr, "Line %lu: invalid SPI data\n", lineNo);
+            return false;
+        }
+        if (dataLen == MAX_TRX_LEN)
+        {
+            fprintf(stderr, "Line %lu: SPI transaction too long\n", lineNo);
+            return false;
+        }
+
+        data[dataLen++] = (uint8_t)((hi << 4) | lo);
+        p += 2;
+    }
+
+    handler({ time, RecordedEventSpi, data, dataLen }, context);
+    return true;
+}
+
+static int HexDigit(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
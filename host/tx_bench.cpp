@@ -0,0 +1,352 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Transmit ring simulation and benchmark (host build)
+ */
+
+#include "tx_bench.h"
+#include "tx_ring.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Same dimensions as the UART and USB serial output
+#define TX_BUF_LEN 1024
+#define TX_QUEUE_LEN 16
+
+// Length of each message (including CR LF)
+#define MESSAGE_LEN 48
+// Number of messages per simulation
+#define NUM_MESSAGES 5000
+// Minimum duration of each benchmark run (in seconds)
+#define MIN_BENCHMARK_TIME 0.5
+// Number of benchmark runs (the best run counts)
+#define NUM_BENCHMARK_RUNS 5
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+// Characteristics of the simulated link
+struct LinkProfile
+{
+    const char *name;
+    // Transmission time per byte (in us)
+    double byteTime;
+    // Fixed time per transfer (in us)
+    double transferTime;
+};
+
+static const LinkProfile LINK_PROFILES[] = {
+    // 115200 bps, 10 bits per byte
+    { "UART", 1e6 / 11520, 0 },
+    // about 1 MB/s with a latency per transfer
+    { "USB", 1.0, 125 },
+};
+
+// Offered load (relative to the link capacity without the fixed time per transfer)
+static const double LOADS[] = { 0.5, 0.9, 1.0, 1.5, 3.0 };
+
+// Every DEBUG_INTERVAL-th message is a low priority debug message
+#define DEBUG_INTERVAL 4
+
+// Time step while `Write()` blocks (in us)
+#define BLOCK_STEP 100
+
+// Simulated transport: the transfer is started by the ring and completed by
+// the simulation loop (or while the ring blocks). The simulated time is
+// advanced by the simulation loop and by `Millis()`.
+template <TxOverflowPolicy POLICY>
+struct MockTransport
+{
+    typedef TxRing<TX_BUF_LEN, TX_QUEUE_LEN, MockTransport, POLICY> Ring;
+
+    static bool IsReady() { return !isBusy; }
+
+    static void Transmit(const uint8_t *data, size_t len)
+    {
+        transferData = data;
+        transferLen = len;
+        isBusy = true;
+        completionTime = time + link->transferTime + len * link->byteTime;
+    }
+
+    // Only called while the ring blocks: the time passes
+    static uint32_t Millis()
+    {
+        double step = BLOCK_STEP;
+        if (isBusy && completionTime - time <= step)
+        {
+            step = completionTime - time;
+            time = completionTime;
+            CompleteTransfer();
+        }
+        else
+        {
+            time += step;
+        }
+        blockedTime += step;
+        return (uint32_t)(time / 1000);
+    }
+
+    // Transfer complete (like the interrupt handler)
+    static void CompleteTransfer()
+    {
+        received.append((const char *)transferData, transferLen);
+        isBusy = false;
+        ring->TransmissionCompleted();
+    }
+
+    static void Reset(const LinkProfile *link)
+    {
+        MockTransport::link = link;
+        ring = new Ring();
+        isBusy = false;
+        time = 0;
+        completionTime = 0;
+        blockedTime = 0;
+        received.clear();
+    }
+
+    static Ring *ring;
+    static const LinkProfile *link;
+    static const uint8_t *transferData;
+    static size_t transferLen;
+    // Transfer in progress
+    static bool isBusy;
+    // Simulated time and end of current transfer (in us)
+    static double time;
+    static double completionTime;
+    // Total time spent blocking in `Write()` (in us)
+    static double blockedTime;
+    static std::string received;
+};
+
+template <TxOverflowPolicy POLICY> typename MockTransport<POLICY>::Ring *MockTransport<POLICY>::ring = nullptr;
+template <TxOverflowPolicy POLICY> const LinkProfile *MockTransport<POLICY>::link = nullptr;
+template <TxOverflowPolicy POLICY> const uint8_t *MockTransport<POLICY>::transferData = nullptr;
+template <TxOverflowPolicy POLICY> size_t MockTransport<POLICY>::transferLen = 0;
+template <TxOverflowPolicy POLICY> bool MockTransport<POLICY>::isBusy = false;
+template <TxOverflowPolicy POLICY> double MockTransport<POLICY>::time = 0;
+template <TxOverflowPolicy POLICY> double MockTransport<POLICY>::completionTime = 0;
+template <TxOverflowPolicy POLICY> double MockTransport<POLICY>::blockedTime = 0;
+template <TxOverflowPolicy POLICY> std::string MockTransport<POLICY>::received;
+
+static const char *POLICY_NAMES[] = { "drop-newest", "drop-oldest", "block", "coalesce" };
+
+struct SimulationResult
+{
+    double throughput;
+    // Analysis (normal priority) and debug (low priority) messages
+    unsigned long numReceived[2];
+    unsigned long numLost[2];
+    unsigned long numCorrupted;
+    // Drops counted by the ring
+    unsigned long numDropped;
+    double blockedTime;
+    bool isConsistent;
+};
+
+static bool IsDebugMessage(unsigned long messageNo)
+{
+    return messageNo % DEBUG_INTERVAL == DEBUG_INTERVAL - 1;
+}
+
+// Message with number, padded with dots and terminated with CR LF
+static void FormatMessage(char *message, unsigned long messageNo)
+{
+    int n = snprintf(message, MESSAGE_LEN + 1, "%s %08lu ", IsDebugMessage(messageNo) ? "Debug" : "Message",
+            messageNo);
+    memset(message + n, '.', MESSAGE_LEN - 2 - n);
+    message[MESSAGE_LEN - 2] = '\r';
+    message[MESSAGE_LEN - 1] = '\n';
+    message[MESSAGE_LEN] = 0;
+}
+
+// Checks the received messages: complete messages must arrive in order and
+// without duplicates. Incomplete messages (caused by discarded data) are
+// counted as corrupted.
+static void VerifyStream(const std::string &received, SimulationResult &result)
+{
+    result.numReceived[0] = result.numReceived[1] = 0;
+    result.numCorrupted = 0;
+    result.isConsistent = true;
+    long lastMessageNo = -1;
+    char expected[MESSAGE_LEN + 1];
+
+    size_t start = 0;
+    while (start < received.size())
+    {
+        size_t end = received.find('\n', start);
+        end = end == std::string::npos ? received.size() : end + 1;
+
+        unsigned long messageNo;
+        if (end - start == MESSAGE_LEN && sscanf(received.c_str() + start, "%*s %lu", &messageNo) == 1
+                && messageNo < NUM_MESSAGES)
+        {
+            FormatMessage(expected, messageNo);
+            if (memcmp(received.data() + start, expected, MESSAGE_LEN) != 0)
+            {
+                result.numCorrupted++;
+            }
+            else if ((long)messageNo <= lastMessageNo)
+            {
+                result.isConsistent = false;
+            }
+            else
+            {
+                result.numReceived[IsDebugMessage(messageNo) ? 1 : 0]++;
+                lastMessageNo = messageNo;
+            }
+        }
+        else
+        {
+            result.numCorrupted++;
+        }
+
+        start = end;
+    }
+
+    unsigned long numDebug = NUM_MESSAGES / DEBUG_INTERVAL;
+    result.numLost[0] = NUM_MESSAGES - numDebug - result.numReceived[0];
+    result.numLost[1] = numDebug - result.numReceived[1];
+}
+
+// Writes messages at a constant rate and runs the transport in simulated time.
+// If `Write()` blocks, the following messages are written late.
+template <TxOverflowPolicy POLICY>
+static SimulationResult Simulate(const LinkProfile &link, double load)
+{
+    typedef MockTransport<POLICY> Transport;
+    Transport::Reset(&link);
+
+    double writeInterval = MESSAGE_LEN * link.byteTime / load;
+    double nextWriteTime = 0;
+    unsigned long numWritten = 0;
+    char message[MESSAGE_LEN + 1];
+
+    while (true)
+    {
+        bool isWriteDue = numWritten < NUM_MESSAGES
+                && (!Transport::isBusy || nextWriteTime < Transport::completionTime);
+        if (isWriteDue)
+        {
+            Transport::time = std::max(Transport::time, nextWriteTime);
+            FormatMessage(message, numWritten);
+            Transport::ring->Write((const uint8_t *)message, MESSAGE_LEN,
+                    IsDebugMessage(numWritten) ? TxPriorityLow : TxPriorityNormal);
+            numWritten++;
+            nextWriteTime += writeInterval;
+        }
+        else if (Transport::isBusy)
+        {
+            Transport::time = Transport::completionTime;
+            Transport::CompleteTransfer();
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    SimulationResult result;
+    VerifyStream(Transport::received, result);
+    result.numDropped = Transport::ring->DropStatistics().numDroppedMessages;
+    result.blockedTime = Transport::blockedTime;
+    result.throughput = Transport::time > 0 ? Transport::received.size() / Transport::time * 1e6 : 0;
+    delete Transport::ring;
+    return result;
+}
+
+static SimulationResult Simulate(TxOverflowPolicy policy, const LinkProfile &link, double load)
+{
+    switch (policy)
+    {
+    case TxDropOldest:
+        return Simulate<TxDropOldest>(link, load);
+    case TxBlock:
+        return Simulate<TxBlock>(link, load);
+    case TxCoalesce:
+        return Simulate<TxCoalesce>(link, load);
+    default:
+        return Simulate<TxDropNewest>(link, load);
+    }
+}
+
+// Measures the processing time of `Write()` and `TransmissionCompleted()`
+// with a transport that completes each transfer after the next write (so
+// data is both appended to pending chunks and queued as new chunks).
+// Returns the bytes per second.
+static double BenchmarkWrite()
+{
+    typedef MockTransport<TxDropNewest> Transport;
+    Transport::Reset(&LINK_PROFILES[0]);
+
+    char message[MESSAGE_LEN + 1];
+    FormatMessage(message, 0);
+    uint64_t numBytes = 0;
+    double seconds;
+    auto startTime = std::chrono::steady_clock::now();
+
+    do
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            Transport::ring->Write((const uint8_t *)message, MESSAGE_LEN);
+            Transport::ring->Write((const uint8_t *)message, MESSAGE_LEN);
+            if (Transport::isBusy)
+            {
+                Transport::isBusy = false;
+                Transport::ring->TransmissionCompleted();
+            }
+        }
+        numBytes += 2000 * MESSAGE_LEN;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+        seconds = elapsed.count();
+    } while (seconds < MIN_BENCHMARK_TIME);
+
+    delete Transport::ring;
+    return numBytes / seconds;
+}
+
+int RunTxBenchmark()
+{
+    bool isConsistent = true;
+
+    printf("%d messages of %d bytes (every %d. with low priority), buffer %d bytes, %d chunks\n", NUM_MESSAGES,
+            MESSAGE_LEN, DEBUG_INTERVAL, TX_BUF_LEN, TX_QUEUE_LEN);
+    printf("                                         analysis          debug\n");
+    printf("link  policy       load   throughput  received  lost  received  lost  corrupted  dropped  blocked\n");
+    for (size_t i = 0; i < ARRAY_LEN(LINK_PROFILES); i++)
+    {
+        const LinkProfile &link = LINK_PROFILES[i];
+        for (int policy = TxDropNewest; policy <= TxCoalesce; policy++)
+        {
+            for (size_t j = 0; j < ARRAY_LEN(LOADS); j++)
+            {
+                SimulationResult result = Simulate((TxOverflowPolicy)policy, link, LOADS[j]);
+                // every lost message must have been counted as dropped,
+                // and messages are never partially dropped
+                bool isAccounted = result.numDropped == result.numLost[0] + result.numLost[1];
+                printf("%-4s  %-11s  %3.0f%%  %7.0f B/s  %8lu  %4lu  %8lu  %4lu  %9lu  %7lu  %5.0f ms%s%s%s\n",
+                        link.name, POLICY_NAMES[policy], LOADS[j] * 100, result.throughput, result.numReceived[0],
+                        result.numLost[0], result.numReceived[1], result.numLost[1], result.numCorrupted,
+                        result.numDropped, result.blockedTime / 1000, result.isConsistent ? "" : "  INCONSISTENT",
+                        isAccounted ? "" : "  UNACCOUNTED", result.numCorrupted == 0 ? "" : "  CORRUPTED");
+                if (!result.isConsistent || !isAccounted || result.numCorrupted != 0)
+                    isConsistent = false;
+            }
+        }
+    }
+
+    double writeRate = 0;
+    for (int i = 0; i < NUM_BENCHMARK_RUNS; i++)
+        writeRate = std::max(writeRate, BenchmarkWrite());
+    printf("Write: %.1f MB/s\n", writeRate / 1e6);
+
+    return isConsistent ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Binary output records
+ */
+
+#ifndef BINARY_RECORD_H
+#define BINARY_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Output analysis results as binary records instead of text
+#if !defined(BINARY_OUTPUT)
+#define BINARY_OUTPUT 0
+#endif
+
+// Output text as format string ID and raw arguments (formatted by the host)
+#if !defined(DEFERRED_FORMAT)
+#define DEFERRED_FORMAT 0
+#endif
+
+#if DEFERRED_FORMAT && !BINARY_OUTPUT
+#error "DEFERRED_FORMAT requires BINARY_OUTPUT"
+#endif
+
+// A record consists of the record type (1 byte) followed by the fields.
+// Integers are encoded as varints (7 bits per byte, least significant
+// group first, bit 7 set if more bytes follow); signed integers are
+// zigzag encoded first. Times are in us. The timestamps of the TX and RX
+// events are encoded as the difference to the previous timestamp of
+// the sample (the TX done time being 0).
+//
+// Records are framed with COBS (consistent overhead byte stuffing) and
+// terminated with a 0 byte. So a receiver can synchronize at any 0 byte.
+
+// Maximum length of a record (unframed)
+#define MAX_RECORD_LEN 128
+// Maximum length of a record including COBS overhead and delimiter
+#define MAX_FRAMED_RECORD_LEN (MAX_RECORD_LEN + MAX_RECORD_LEN / 254 + 2)
+
+enum RecordType
+{
+    // Text output (statistics, error messages etc.): characters
+    RecordText = 1,
+    // Sample start: sample number, FCnt + 1 (0 if not a LoRaWAN data frame)
+    RecordSampleStart,
+    // TX start and done: TX start timestamp, modulation, payload length, air time, ramp-up time
+    RecordTxDone,
+    // Payload length mismatch: configured length, FIFO length
+    RecordPayloadLengthMismatch,
+    // LoRaWAN frame: MHDR, DevAddr (4 bytes), FCtrl, FCnt, FPort + 1, FOpts
+    RecordLoraWanFrame,
+    // RX start: window (1 or 2), timestamp
+    RecordRxStart,
+    // Downlink received: window, timestamp
+    RecordRxDone,
+    // RX timeout: window, timestamp
+    RecordRxTimeout,
+    // Downlink analysis: modulation, payload length, air time, start margin
+    RecordRxAnalysis,
+    // Timeout analysis: modulation, timeout length, ramp-up time, start margin, end margin, correction
+    RecordTimeoutAnalysis,
+    // Out of sync: stage (text)
+    RecordOutOfSync,
+    // Deferred text output: format string ID, arguments (integers as signed
+    // 64-bit varints, strings as length and characters)
+    RecordFormat,
+    // Output dropped by the serial sink since the previous record of this
+    // type: number of messages, number of bytes
+    RecordOutputDropped
+};
+
+// Text of the loss marker (text output and decoder): number of messages, number of bytes
+#define OUTPUT_DROPPED_FORMAT "*** Output dropped: %lu messages, %lu bytes ***\r\n"
+
+// Modulation fields: LoRa: 1, spreading factor, bandwidth index, frequency (kHz);
+// FSK: 0, bit rate (bps), frequency deviation (Hz), frequency (kHz).
+
+
+// Assembles a record
+class RecordWriter
+{
+public:
+    RecordWriter(RecordType type) : len(1) { buf[0] = (uint8_t)type; }
+
+    void PutByte(uint8_t value)
+    {
+        if (len < MAX_RECORD_LEN)
+            buf[len++] = value;
+    }
+
+    void PutVarint(uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            PutByte((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        PutByte((uint8_t)value);
+    }
+
+    void PutSignedVarint(int32_t value) { PutVarint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31)); }
+
+    void PutVarint64(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            PutByte((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        PutByte((uint8_t)value);
+    }
+
+    void PutSignedVarint64(int64_t value) { PutVarint64(((uint64_t)value << 1) ^ (uint64_t)(value >> 63)); }
+
+    void PutString(const char *str)
+    {
+        size_t strLen = 0;
+        while (str[strLen] != 0)
+            strLen++;
+        PutVarint(strLen);
+        while (*str != 0)
+            PutByte((uint8_t)*str++);
+    }
+
+    const uint8_t *Data() const { return buf; }
+    size_t Length() const { return len; }
+
+private:
+    uint8_t buf[MAX_RECORD_LEN];
+    size_t len;
+};
+
+// Reads the fields of a record
+class RecordReader
+{
+public:
+    RecordReader(const uint8_t *data, size_t len) : p(data), end(data + len), isValid(true) {}
+
+    uint8_t GetByte()
+    {
+        if (p == end)
+        {
+            isValid = false;
+            return 0;
+        }
+        return *p++;
+    }
+
+    uint32_t GetVarint()
+    {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            uint8_t byte = GetByte();
+            value |= (uint32_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+        isValid = false;
+        return 0;
+    }
+
+    int32_t GetSignedVarint()
+    {
+        uint32_t value = GetVarint();
+        return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+
+    uint64_t GetVarint64()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 70; shift += 7)
+        {
+            uint8_t byte = GetByte();
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+        isValid = false;
+        return 0;
+    }
+
+    int64_t GetSignedVarint64()
+    {
+        uint64_t value = GetVarint64();
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    // Reads a string into `str` (truncated to `size - 1` characters;
+    // if `size` is 0, the string is skipped and nothing is written)
+    void GetString(char *str, size_t size)
+    {
+        uint32_t strLen = GetVarint();
+        if (strLen > Remaining())
+        {
+            isValid = false;
+            strLen = 0;
+        }
+        for (uint32_t i = 0; i < strLen; i++)
+        {
+            uint8_t ch = *p++;
+            if (i + 1 < size)
+                *str++ = (char)ch;
+        }
+        if (size != 0)
+            *str = 0;
+    }
+
+    const uint8_t *Current() const { return p; }
+    size_t Remaining() const { return end - p; }
+    // Indicates that no field was read past the end of the record
+    bool IsValid() const { return isValid; }
+
+private:
+    const uint8_t *p;
+    const uint8_t *end;
+    bool isValid;
+};
+
+// Encodes the record with COBS and appends the 0 delimiter.
+// `framed` must provide space for `len + len / 254 + 2` bytes.
+// Returns the length of the framed record.
+size_t CobsEncode(const uint8_t *data, size_t len, uint8_t *framed);
+
+// Decodes a COBS encoded record (without the delimiter).
+// `data` must provide space for `len` bytes.
+// Returns the length of the record, or -1 if the encoding is invalid.
+int CobsDecode(const uint8_t *framed, size_t len, uint8_t *data);
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Timing statistics per channel (carrier frequency)
+ */
+
+#ifndef CHANNEL_STATISTICS_H
+#define CHANNEL_STATISTICS_H
+
+#include <stdint.h>
+
+// Maximum number of channels tracked (must be a power of 2).
+// Regional plans use at most 16 uplink plus a few RX channels in practice.
+#define NUM_CHANNEL_SLOTS 32
+
+// Counters of a single channel
+struct ChannelCounters
+{
+    // Carrier frequency in Hz (0 for an unused slot)
+    uint32_t frequency;
+    uint32_t numUplinks;
+    uint32_t numRx1Downlinks;
+    uint32_t numRx2Downlinks;
+    uint32_t numTimeouts;
+    // Sum of the smaller of the start and end margin of all analyzed RX windows
+    int64_t marginSum;
+    uint32_t numMargins;
+};
+
+// Statistics per channel, stored in a fixed-size hash table
+// with open addressing (linear probing).
+class ChannelStatistics
+{
+public:
+    ChannelStatistics();
+
+    void CountUplink(uint32_t frequency);
+    // Counts a downlink received in RX1 or RX2 (margin in us)
+    void CountDownlink(uint32_t frequency, bool isRx2, int32_t margin);
+    // Counts an RX timeout (margin in us)
+    void CountTimeout(uint32_t frequency, int32_t margin);
+
+    void Print();
+
+private:
+    // Returns the counters of the channel (inserted if needed),
+    // or nullptr if the frequency is unknown or the table is full
+    ChannelCounters *Find(uint32_t frequency);
+
+    ChannelCounters slots[NUM_CHANNEL_SLOTS];
+    // Slot indexes in the order the channels were first used
+    uint8_t order[NUM_CHANNEL_SLOTS];
+    int numChannels;
+    // Number of events not counted as the table is full
+    uint32_t numUntrackedEvents;
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Extension and merging of hardware captured edge times
+ */
+
+#ifndef EDGE_CAPTURE_H
+#define EDGE_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Capture timer resolution: the timer runs at 8 MHz (125ns per tick)
+#define CAPTURE_TICKS_PER_MICRO_SHIFT 3
+
+// Converts the 16-bit values latched by the input capture channels
+// of a free-running timer into 64-bit timestamps and returns the
+// edges in chronological order.
+//
+// The class does not access any hardware. The timer interrupt handler
+// passes the status flags and capture values; a host simulation can
+// drive it the same way.
+class EdgeCapture
+{
+public:
+    // Captured edge
+    struct Edge
+    {
+        uint8_t channel;
+        uint16_t value;
+    };
+
+    // Edge with extended timestamp
+    struct TimedEdge
+    {
+        uint8_t channel;
+        uint64_t ticks;
+    };
+
+    EdgeCapture() : epoch(0) {}
+
+    // Extends the captured edges to 64 bit and sorts them chronologically.
+    // `overflowPending` indicates that the timer has overflowed and the
+    // overflow hasn't been accounted for yet (see `OnOverflow()`).
+    // Returns the number of edges written to `result`.
+    size_t Merge(const Edge *edges, size_t numEdges, bool overflowPending, TimedEdge *result) const
+    {
+        for (size_t i = 0; i < numEdges; i++)
+        {
+            TimedEdge timedEdge = { edges[i].channel, Extend(edges[i].value, overflowPending) };
+
+            // insertion sort (at most one edge per channel)
+            size_t j = i;
+            while (j > 0 && result[j - 1].ticks > timedEdge.ticks)
+            {
+                result[j] = result[j - 1];
+                j--;
+            }
+            result[j] = timedEdge;
+        }
+
+        return numEdges;
+    }
+
+    // Extends a 16-bit capture value to 64 bit
+    uint64_t Extend(uint16_t value, bool overflowPending) const
+    {
+        // If an overflow is pending, values in the lower half have
+        // been captured after the overflow, values in the upper half
+        // before it. This holds as long as the overflow is processed
+        // within half a timer period (4ms).
+        uint64_t e = epoch;
+        if (overflowPending && value < 0x8000)
+            e += 0x10000;
+        return e + value;
+    }
+
+    // Accounts for a timer overflow (called from the timer interrupt handler)
+    void OnOverflow() { epoch += 0x10000; }
+
+    // Converts timer ticks to microseconds
+    static uint64_t TicksToMicros(uint64_t ticks) { return ticks >> CAPTURE_TICKS_PER_MICRO_SHIFT; }
+
+private:
+    uint64_t epoch;
+};
+
+#endif
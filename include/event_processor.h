@@ -0,0 +1,60 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Event queue and event processing (independent of hardware)
+ */
+
+#ifndef EVENT_PROCESSOR_H
+#define EVENT_PROCESSOR_H
+
+#include <stdint.h>
+
+enum EventType
+{
+    EventTypeSpiTrx,
+    EventTypeDone, // DIO0 rising edge
+    EventTypeTimeout, // DIO1 rising edge
+    EventTypeGap
+};
+
+// Buffer for payload data of SPI transaction.
+// The buffer is used as a circular buffer. It's big enough for
+// a full 256 byte FIFO burst plus the surrounding transactions.
+// The size must be a power of 2.
+#define SPI_DATA_BUF_LEN 512
+extern uint8_t SpiDataBuf[SPI_DATA_BUF_LEN];
+
+// Queue of events (filled by interrupt handlers, processed by main loop)
+#define EVENT_QUEUE_LEN 16
+
+// Queues an event (called from interrupt handlers).
+// For SPI transactions, `spiPos` is the total number of bytes
+// received via SPI at the end of the transaction (wrapping at 2^32).
+// It is ignored for all other events.
+void QueueEvent(EventType eventType, uint64_t time, uint32_t spiPos = 0);
+
+// Processes all pending events and writes the resulting output
+// in a single chunk (called from main loop).
+// Returns the number of processed events.
+int ProcessEvents();
+
+// Processes the oldest pending event without writing the output.
+// Returns false if no event is pending.
+bool ProcessNextEvent();
+
+// Counts a batch of events processed with `ProcessNextEvent()`
+// and writes the resulting output.
+void CompleteBatch(int batchSize);
+
+// Prints the event processing statistics
+void PrintStatistics();
+
+// Returns the total number of bytes written to the SPI buffer so far.
+// Must be provided by the capture code. It is called with interrupts disabled.
+uint32_t SpiWritePosition();
+
+#endif
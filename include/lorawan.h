@@ -0,0 +1,107 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * LoRaWAN MAC frame decoder
+ */
+
+#ifndef LORAWAN_H
+#define LORAWAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Delay between end of uplink and RX1 (RECEIVE_DELAY1, in us)
+#define LORAWAN_RECEIVE_DELAY1 1000000
+// Delay between end of join request and RX1 (JOIN_ACCEPT_DELAY1, in us)
+#define LORAWAN_JOIN_ACCEPT_DELAY1 5000000
+// Delay between RX1 and RX2 (in us)
+#define LORAWAN_RX2_OFFSET 1000000
+
+// Maximum length of the FOpts field
+#define LORAWAN_MAX_FOPTS_LEN 15
+
+// LoRaWAN MAC commands relevant for the analysis
+#define LORAWAN_CID_RX_PARAM_SETUP 0x05
+#define LORAWAN_CID_RX_TIMING_SETUP 0x08
+
+// Message type (MType field of MHDR)
+enum LoraWanMType
+{
+    LoraWanJoinRequest = 0,
+    LoraWanJoinAccept = 1,
+    LoraWanUnconfirmedDataUp = 2,
+    LoraWanUnconfirmedDataDown = 3,
+    LoraWanConfirmedDataUp = 4,
+    LoraWanConfirmedDataDown = 5,
+    LoraWanRejoinRequest = 6,
+    LoraWanProprietary = 7
+};
+
+// Unencrypted part of a LoRaWAN PHYPayload (LoRaWAN 1.0.x).
+// The fields after `mType` are only valid for data frames.
+struct LoraWanFrame
+{
+    LoraWanMType mType;
+    uint32_t devAddr;
+    uint8_t fCtrl;
+    uint16_t fCnt;
+    // FPort (-1 if the frame has no FPort)
+    int16_t fPort;
+    uint8_t fOptsLen;
+    uint8_t fOpts[LORAWAN_MAX_FOPTS_LEN];
+
+    bool IsDataFrame() const { return mType >= LoraWanUnconfirmedDataUp && mType <= LoraWanConfirmedDataDown; }
+    bool IsUplink() const { return mType == LoraWanJoinRequest || mType == LoraWanRejoinRequest || (IsDataFrame() && (mType & 1) == 0); }
+    // Indicates if FOpts contains the given MAC command
+    bool HasMacCommand(uint8_t cid) const;
+};
+
+// Parses the header of a LoRaWAN PHYPayload of `len` bytes.
+// `read(offset)` returns the byte at the given offset; this
+// allows to parse data in place, e.g. in a circular buffer.
+// Returns false if the data is not a valid LoRaWAN frame.
+template <typename ByteReader>
+bool ParseLoraWanFrame(ByteReader read, size_t len, LoraWanFrame &frame)
+{
+    if (len < 1)
+        return false;
+
+    // MHDR: MType, RFU, major version (LoRaWAN R1 = 0)
+    uint8_t mhdr = read(0);
+    if ((mhdr & 0x03) != 0)
+        return false;
+    frame.mType = (LoraWanMType)(mhdr >> 5);
+
+    if (frame.mType == LoraWanJoinRequest)
+        return len == 23;
+    if (frame.mType == LoraWanJoinAccept)
+        return len == 17 || len == 33;
+    if (!frame.IsDataFrame())
+        return frame.mType == LoraWanProprietary;
+
+    // MHDR, DevAddr, FCtrl, FCnt, FOpts, MIC
+    // (the minimum length must be checked before FCtrl is read)
+    if (len < 12)
+        return false;
+    frame.fCtrl = read(5);
+    frame.fOptsLen = frame.fCtrl & 0x0f;
+    size_t headerLen = 8 + frame.fOptsLen;
+    if (len < headerLen + 4)
+        return false;
+
+    frame.devAddr = (uint32_t)read(1) | ((uint32_t)read(2) << 8) | ((uint32_t)read(3) << 16) | ((uint32_t)read(4) << 24);
+    frame.fCnt = (uint16_t)(read(6) | (read(7) << 8));
+    for (size_t i = 0; i < frame.fOptsLen; i++)
+        frame.fOpts[i] = read(8 + i);
+    frame.fPort = len > headerLen + 4 ? read(headerLen) : -1;
+    return true;
+}
+
+// Prints a summary of the frame (message type, address, counter and MAC commands)
+void PrintLoraWanFrame(const LoraWanFrame &frame);
+
+#endif
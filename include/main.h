@@ -15,12 +15,19 @@
 #include <stdint.h>
 #include <stm32f1xx.h>
 
-#if defined(UART_OUTPUT)
-    #define Serial Uart
+#if defined(HOST_BUILD)
+    #define SerialSink HostSerial
+    #include "host_serial.h"
+#elif defined(UART_OUTPUT)
+    #define SerialSink Uart
     #include "uart.h"
 #else
-    #define Serial USBSerial
+    #define SerialSink USBSerial
     #include "usb_serial.h"
 #endif
 
+// Analysis output is staged and written to the serial sink in batches
+#define Serial Output
+#include "output_buffer.h"
+
 #endif
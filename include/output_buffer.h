@@ -0,0 +1,152 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Staging buffer for analysis output
+ */
+
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include "binary_record.h"
+#include "format.h"
+#include "tx_ring.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Collects the output of several analysis steps and
+// writes it to the serial sink in a single chunk.
+// If the buffer runs full, it is flushed early.
+// With BINARY_OUTPUT, text is wrapped in text records.
+// If the serial sink has dropped output, a loss marker is written
+// before the next chunk.
+class OutputBuffer
+{
+public:
+    OutputBuffer() : len(0), priority(TxPriorityNormal), numReportedMessages(0), numReportedBytes(0) {}
+
+    void Write(const uint8_t *data, size_t len);
+    void Print(const char *str);
+#if !DEFERRED_FORMAT
+    // Formatted output (see format.h for the supported conversions)
+    template <typename... Args>
+    void Printf(const char *fmt, Args... args)
+    {
+#if BINARY_OUTPUT
+        char text[256];
+        size_t n = FormatToBuffer(text, sizeof(text), fmt, args...);
+        WriteText(text, n);
+#else
+        Format(WriteFormatted, this, fmt, args...);
+#endif
+    }
+#endif
+    // Hex dump (debug output, written with low priority)
+    void PrintHex(const uint8_t *data, size_t len, _Bool crlf);
+    // Write a binary record (framed with COBS)
+    void WriteRecord(const uint8_t *record, size_t len);
+
+    // Write the staged output to the serial sink
+    void Flush();
+
+#if DEFERRED_FORMAT
+    // Write a format record with the format string ID and the raw arguments
+    template <typename... Args>
+    void PrintDeferred(uint32_t formatId, Args... args)
+    {
+        RecordWriter record(RecordFormat);
+        record.PutVarint(formatId);
+        PutArgs(record, args...);
+        WriteRecord(record.Data(), record.Length());
+    }
+#endif
+
+private:
+    void WriteHex(const uint8_t *data, size_t len, _Bool crlf);
+    void ReportDroppedOutput();
+
+#if BINARY_OUTPUT
+    void WriteText(const char *text, size_t len);
+#else
+    static void WriteFormatted(void *context, const char *data, size_t len);
+#endif
+
+#if DEFERRED_FORMAT
+    static void PutArgs(RecordWriter &) {}
+
+    template <typename T, typename... Args>
+    static void PutArgs(RecordWriter &record, T arg, Args... args)
+    {
+        PutArg(record, arg);
+        PutArgs(record, args...);
+    }
+
+    static void PutArg(RecordWriter &record, int value) { record.PutSignedVarint64(value); }
+    static void PutArg(RecordWriter &record, unsigned value) { record.PutSignedVarint64(value); }
+    static void PutArg(RecordWriter &record, long value) { record.PutSignedVarint64(value); }
+    static void PutArg(RecordWriter &record, unsigned long value) { record.PutSignedVarint64(value); }
+    static void PutArg(RecordWriter &record, long long value) { record.PutSignedVarint64(value); }
+    static void PutArg(RecordWriter &record, unsigned long long value) { record.PutSignedVarint64(value); }
+    static void PutArg(RecordWriter &record, const char *str) { record.PutString(str); }
+#endif
+
+    size_t len;
+    // Priority of the staged output
+    TxPriority priority;
+    // Dropped output already reported by a loss marker
+    uint32_t numReportedMessages;
+    uint32_t numReportedBytes;
+};
+
+extern OutputBuffer Output;
+
+// Never called; only used to check the arguments against the format string
+void CheckFormat(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Formatted output via `Serial` (use instead of `Serial.Printf` so the
+// compiler checks the arguments against the format string).
+// With DEFERRED_FORMAT, the format string is placed in the section "fmtstr"
+// and only its offset within the section (the format ID) and the arguments
+// are output. The host formats the text using the section extracted from the
+// ELF file (see tools/extract_format_strings.py).
+#if DEFERRED_FORMAT
+
+extern "C" const char __start_fmtstr[];
+
+#define SERIAL_PRINTF(fmt, ...) \
+    do \
+    { \
+        static const char format[] __attribute__((section("fmtstr"), used)) = fmt; \
+        (void)sizeof((CheckFormat(fmt, ##__VA_ARGS__), 0)); \
+        Serial.PrintDeferred(format - __start_fmtstr, ##__VA_ARGS__); \
+    } while (false)
+
+#else
+
+// The host build places the format strings in the section "fmtstr" as well
+// so the tests can check all call sites (see host/include/format_samples.h)
+#if defined(HOST_BUILD)
+#define COLLECT_FORMAT_STRING(fmt) \
+    static const char format[] __attribute__((section("fmtstr"), used)) = fmt
+#else
+#define COLLECT_FORMAT_STRING(fmt) \
+    do \
+    { \
+    } while (false)
+#endif
+
+#define SERIAL_PRINTF(fmt, ...) \
+    do \
+    { \
+        COLLECT_FORMAT_STRING(fmt); \
+        (void)sizeof((CheckFormat(fmt, ##__VA_ARGS__), 0)); \
+        Serial.Printf(fmt, ##__VA_ARGS__); \
+    } while (false)
+
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Common base of the radio specific SPI decoders
+ */
+
+#ifndef RADIO_DECODER_H
+#define RADIO_DECODER_H
+
+#include "timing_analyzer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Base class of the decoders for the SPI protocol of a radio chip.
+//
+// The decoder is selected at compile time. `Derived` must implement:
+//
+//     void DecodeTrx(uint64_t time, const uint8_t *startTrx, const uint8_t *endTrx);
+//     void DecodeDio0(uint64_t time);
+//     void DecodeDio1(uint64_t time);
+//
+// The calls are resolved statically (no virtual functions).
+//
+// The SPI data is located in a circular buffer. `startTrx` points to the
+// first byte of the transaction, `endTrx` to the byte after the last one.
+// If the transaction wraps around, `endTrx` is smaller than `startTrx`.
+// The position of the transaction in the stream of SPI data (total number
+// of bytes received before it) is passed as `startPos`. Data referenced after
+// the transaction has been decoded must be checked with `IsOverwritten()`.
+template <typename Derived>
+class RadioDecoder
+{
+public:
+    // `isOverwritten` checks if the DMA has started to overwrite the SPI data
+    // at the given position (nullptr if the data is never overwritten)
+    RadioDecoder(const uint8_t *buf, size_t bufSize, TimingAnalyzer &ta, bool (*isOverwritten)(uint32_t pos) = nullptr)
+        : timingAnalyzer(ta), circularBufferStart(buf), circularBufferEnd(buf + bufSize),
+          trxStartPos(0), isOverwritten(isOverwritten) {}
+
+    // Called for each SPI transaction
+    void OnTrx(uint64_t time, const uint8_t *startTrx, const uint8_t *endTrx, uint32_t startPos = 0)
+    {
+        trxStartPos = startPos;
+        static_cast<Derived *>(this)->DecodeTrx(time, startTrx, endTrx);
+    }
+
+    // Called when DIO0 goes high
+    void OnDio0(uint64_t time) { static_cast<Derived *>(this)->DecodeDio0(time); }
+
+    // Called when DIO1 goes high
+    void OnDio1(uint64_t time) { static_cast<Derived *>(this)->DecodeDio1(time); }
+
+protected:
+    // Length of the transaction
+    size_t TrxLength(const uint8_t *startTrx, const uint8_t *endTrx) const
+    {
+        size_t len = endTrx - startTrx;
+        if (endTrx < startTrx)
+            len += circularBufferEnd - circularBufferStart;
+        return len;
+    }
+
+    // Byte at the given offset of the transaction
+    uint8_t TrxByte(const uint8_t *startTrx, size_t offset) const
+    {
+        const uint8_t *p = startTrx + offset;
+        if (p >= circularBufferEnd)
+            p -= circularBufferEnd - circularBufferStart;
+        return *p;
+    }
+
+    // Checks if the SPI data at the given position has been overwritten
+    // since it was decoded
+    bool IsOverwritten(uint32_t pos) const { return isOverwritten != nullptr && isOverwritten(pos); }
+
+    TimingAnalyzer &timingAnalyzer;
+    const uint8_t *circularBufferStart;
+    const uint8_t *circularBufferEnd;
+    // Position of the transaction being decoded
+    uint32_t trxStartPos;
+
+private:
+    bool (*isOverwritten)(uint32_t pos);
+};
+
+#endif
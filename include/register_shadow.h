@@ -0,0 +1,142 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Shadow copy of the SX127x registers
+ */
+
+#ifndef REGISTER_SHADOW_H
+#define REGISTER_SHADOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// SX127x registers (common and LoRa mode)
+#define REG_FIFO 0x00
+#define REG_OP_MODE 0x01
+#define REG_FSK_BITRATE_MSB 0x02
+#define REG_FSK_BITRATE_LSB 0x03
+#define REG_FSK_FDEV_MSB 0x04
+#define REG_FSK_FDEV_LSB 0x05
+#define REG_FRF_MSB 0x06
+#define REG_FRF_MID 0x07
+#define REG_FRF_LSB 0x08
+#define REG_FIFO_ADDR_PTR 0x0d
+#define REG_MODEM_CONFIG1 0x1d
+#define REG_MODEM_CONFIG2 0x1e
+#define REG_SYMB_TIMEOUT_LSB 0x1f
+#define REG_PREAMBLE_MSB 0x20
+#define REG_PREAMBLE_LSB 0x21
+#define REG_PAYLOAD_LENGTH 0x22
+#define REG_MODEM_CONFIG3 0x26
+#define REG_SYNC_WORD 0x39
+#define REG_FSK_BITRATE_FRAC 0x5d
+
+#define NUM_REGISTERS 128
+
+// Registers 0x0d to 0x3f have a different meaning in FSK mode. The shadow
+// keeps them in a separate page. The FSK page register `reg` is stored at
+// index `FSK_PAGE | reg`.
+#define FSK_PAGE_FIRST 0x0d
+#define FSK_PAGE_LAST 0x3f
+#define FSK_PAGE 0x80
+
+// SX127x registers (FSK mode, index in shadow)
+#define REG_FSK_PREAMBLE_DETECT (FSK_PAGE | 0x1f)
+#define REG_FSK_PREAMBLE_MSB (FSK_PAGE | 0x25)
+#define REG_FSK_PREAMBLE_LSB (FSK_PAGE | 0x26)
+#define REG_FSK_SYNC_CONFIG (FSK_PAGE | 0x27)
+#define REG_FSK_PACKET_CONFIG1 (FSK_PAGE | 0x30)
+#define REG_FSK_PACKET_CONFIG2 (FSK_PAGE | 0x31)
+#define REG_FSK_PAYLOAD_LENGTH (FSK_PAGE | 0x32)
+
+// Number of registers in the shadow (including the FSK page)
+#define NUM_SHADOW_REGISTERS 192
+
+// Copy of the SX127x register map as written by the MCU.
+// `reg` is the shadow index, i.e. the register address for common
+// and LoRa registers and `FSK_PAGE | address` for FSK page registers.
+// Each register has a dirty flag, which is set when the register
+// value changes and cleared when the derived parameters are updated.
+class RegisterShadow
+{
+public:
+    RegisterShadow()
+    {
+        memset(registers, 0, sizeof(registers));
+        memset(dirty, 0, sizeof(dirty));
+
+        // reset values of registers used for the analysis
+        // (except for OpMode: LoRa is assumed until the mode is known)
+        registers[REG_OP_MODE] = 0x80;
+        registers[REG_FRF_MSB] = 0x6c;
+        registers[REG_FRF_MID] = 0x80;
+        registers[REG_FRF_LSB] = 0x00;
+        registers[REG_MODEM_CONFIG1] = 0x72;
+        registers[REG_MODEM_CONFIG2] = 0x70;
+        registers[REG_SYMB_TIMEOUT_LSB] = 0x64;
+        registers[REG_PREAMBLE_MSB] = 0x00;
+        registers[REG_PREAMBLE_LSB] = 0x08;
+        registers[REG_PAYLOAD_LENGTH] = 0x01;
+        registers[REG_MODEM_CONFIG3] = 0x00;
+        registers[REG_SYNC_WORD] = 0x12;
+
+        registers[REG_FSK_BITRATE_MSB] = 0x1a;
+        registers[REG_FSK_BITRATE_LSB] = 0x0b;
+        registers[REG_FSK_FDEV_MSB] = 0x00;
+        registers[REG_FSK_FDEV_LSB] = 0x52;
+        registers[REG_FSK_PREAMBLE_DETECT] = 0xaa;
+        registers[REG_FSK_PREAMBLE_MSB] = 0x00;
+        registers[REG_FSK_PREAMBLE_LSB] = 0x03;
+        registers[REG_FSK_SYNC_CONFIG] = 0x93;
+        registers[REG_FSK_PACKET_CONFIG1] = 0x90;
+        registers[REG_FSK_PACKET_CONFIG2] = 0x40;
+        registers[REG_FSK_PAYLOAD_LENGTH] = 0x40;
+    }
+
+    // Stores a register value
+    void Write(uint8_t reg, uint8_t value)
+    {
+        // drivers often rewrite unchanged values; they don't make the register dirty
+        if (registers[reg] == value)
+            return;
+
+        registers[reg] = value;
+        dirty[reg >> 5] |= 1U << (reg & 0x1fU);
+    }
+
+    uint8_t Value(uint8_t reg) const { return registers[reg]; }
+
+    bool IsDirty(uint8_t reg) const { return (dirty[reg >> 5] & (1U << (reg & 0x1fU))) != 0; }
+
+    bool IsAnyDirty() const
+    {
+        uint32_t any = 0;
+        for (int i = 0; i < NUM_SHADOW_REGISTERS / 32; i++)
+            any |= dirty[i];
+        return any != 0;
+    }
+
+    // Returns the shadow index of a register address
+    // (depending on whether LoRa or FSK mode is active)
+    uint8_t Index(uint8_t reg) const
+    {
+        bool isFsk = (registers[REG_OP_MODE] & 0x80) == 0;
+        return isFsk && reg >= FSK_PAGE_FIRST && reg <= FSK_PAGE_LAST ? reg | FSK_PAGE : reg;
+    }
+
+    // Dirty flags of registers `32 * index` to `32 * index + 31` (one bit per register)
+    uint32_t DirtyFlags(int index) const { return dirty[index]; }
+
+    void ClearDirty() { memset(dirty, 0, sizeof(dirty)); }
+
+private:
+    uint8_t registers[NUM_SHADOW_REGISTERS];
+    uint32_t dirty[NUM_SHADOW_REGISTERS / 32];
+};
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Output of analysis results (text or binary)
+ */
+
+#ifndef SAMPLE_OUTPUT_H
+#define SAMPLE_OUTPUT_H
+
+#include "binary_record.h"
+#include "lorawan.h"
+#include <stdint.h>
+
+enum LongRangeMode
+{
+    LongrangeModeFSK,
+    LongrangeModeLora
+};
+
+// Modulation parameters of a transmission or RX window
+struct ModulationInfo
+{
+    LongRangeMode longRangeMode;
+    uint8_t spreadingFactor;
+    uint8_t bandwidthIndex;
+    // FSK bit rate in bps
+    uint32_t fskBitRate;
+    // FSK frequency deviation in Hz
+    uint32_t fskFrequencyDeviation;
+    // Carrier frequency in Hz (0 if unknown)
+    uint32_t frequency;
+};
+
+// Outputs the analysis results as text.
+// Times are in us relative to the end of the transmission.
+class TextSampleOutput
+{
+public:
+    void SampleStart(int sampleNo, int32_t fCnt);
+    void TxDone(int32_t txStartTime, const ModulationInfo &modulation, int payloadLength, int32_t airTime, int32_t rampupTime);
+    void PayloadLengthMismatch(int configuredLength, int fifoLength);
+    void Frame(const LoraWanFrame &frame);
+    void RxStart(int window, int32_t time);
+    void RxDone(int window, int32_t time);
+    void RxTimeout(int window, int32_t time);
+    void RxAnalysis(const ModulationInfo &modulation, int payloadLength, int32_t airTime, int32_t windowEndTime, int32_t marginStart);
+    void TimeoutAnalysis(const ModulationInfo &modulation, int32_t timeoutLength, int32_t rampupTime,
+            int32_t marginStart, int32_t marginEnd, int32_t correction);
+    void OutOfSync(const char *stage);
+
+private:
+    static void PrintRelativeTimestamp(int32_t timestamp);
+    static void PrintModulation(const ModulationInfo &modulation);
+};
+
+// Outputs the analysis results as binary records (see binary_record.h)
+class BinarySampleOutput
+{
+public:
+    BinarySampleOutput() : lastTime(0) {}
+
+    void SampleStart(int sampleNo, int32_t fCnt);
+    void TxDone(int32_t txStartTime, const ModulationInfo &modulation, int payloadLength, int32_t airTime, int32_t rampupTime);
+    void PayloadLengthMismatch(int configuredLength, int fifoLength);
+    void Frame(const LoraWanFrame &frame);
+    void RxStart(int window, int32_t time);
+    void RxDone(int window, int32_t time);
+    void RxTimeout(int window, int32_t time);
+    void RxAnalysis(const ModulationInfo &modulation, int payloadLength, int32_t airTime, int32_t windowEndTime, int32_t marginStart);
+    void TimeoutAnalysis(const ModulationInfo &modulation, int32_t timeoutLength, int32_t rampupTime,
+            int32_t marginStart, int32_t marginEnd, int32_t correction);
+    void OutOfSync(const char *stage);
+
+private:
+    void PutTimestamp(RecordWriter &record, int32_t time);
+    static void PutModulation(RecordWriter &record, const ModulationInfo &modulation);
+    static void Write(const RecordWriter &record);
+
+    // Timestamp of the previous event of the sample
+    int32_t lastTime;
+};
+
+#if BINARY_OUTPUT
+typedef BinarySampleOutput SampleOutput;
+#else
+typedef TextSampleOutput SampleOutput;
+#endif
+
+#endif
@@ -39,8 +39,27 @@
 #define SPI_MODE 0
 #endif
 
+// Capture mode: the edges of NSS, DIO0 and DIO1 are timestamped in hardware
+// by the input capture channels of TIM4. This requires additional wiring:
+// DIO0 to PB6, DIO1 to PB7 and NSS to PB8 (in addition to PB12).
+#if !defined(CAPTURE_MODE)
+#define CAPTURE_MODE 0
+#endif
+
+#define CAPTURE_TIM_INSTANCE TIM4
+#define CAPTURE_PORT GPIOB
+#define CAPTURE_DIO0_PIN GPIO_PIN_6
+#define CAPTURE_DIO1_PIN GPIO_PIN_7
+#define CAPTURE_NSS_PIN GPIO_PIN_8
+#define CAPTURE_DIO0_CHANNEL TIM_CHANNEL_1
+#define CAPTURE_DIO1_CHANNEL TIM_CHANNEL_2
+#define CAPTURE_NSS_CHANNEL TIM_CHANNEL_3
+#define CAPTURE_IRQn TIM4_IRQn
+#define CAPTURE_IRQHandler TIM4_IRQHandler
+
 extern SPI_HandleTypeDef hspi;
 extern DMA_HandleTypeDef hdma_spi_rx;
+extern TIM_HandleTypeDef htim_capture;
 
 void DioTriggered(int dio);
 void SpiTrxCompleted();
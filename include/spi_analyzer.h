@@ -11,36 +11,96 @@
 #ifndef SPI_ANALYZER_H
 #define SPI_ANALYZER_H
 
+#include "radio_decoder.h"
+#include "register_shadow.h"
 #include "timing_analyzer.h"
 #include <stddef.h>
 #include <stdint.h>
 
-class SpiAnalyzer
+// Decoder for the SX127x register based SPI protocol
+class SpiAnalyzer : public RadioDecoder<SpiAnalyzer>
 {
 public:
-    SpiAnalyzer(const uint8_t *buf, size_t bufSize, TimingAnalyzer &ta)
-        : timingAnalyzer(ta), circularBufferStart(buf), circularBufferEnd(buf + bufSize),
-          symbolTimeout(0x64), preambleLength(8) {}
-    void OnTrx(uint32_t time, const uint8_t *startTrx, const uint8_t *endTrx);
+    // Parameters derived from the registers
+    enum Param
+    {
+        ParamFrequency,
+        ParamBandwidth,
+        ParamCodingRate,
+        ParamImplicitHeader,
+        ParamSpreadingFactor,
+        ParamCrcOn,
+        ParamSymbolTimeout,
+        ParamPreambleLength,
+        ParamPayloadLength,
+        ParamLowDataRateOptimization,
+        ParamSyncWord,
+        ParamFskBitPeriod,
+        ParamFskFrequencyDeviation,
+        ParamFskPreambleDetectSize,
+        ParamFskPreambleLength,
+        ParamFskSyncSize,
+        ParamFskVariableLength,
+        ParamFskCrcOn,
+        ParamFskAddressFiltering,
+        ParamFskPayloadLength,
+        NUM_PARAMS
+    };
+
+    SpiAnalyzer(const uint8_t *buf, size_t bufSize, TimingAnalyzer &ta, bool (*isOverwritten)(uint32_t pos) = nullptr)
+        : RadioDecoder(buf, bufSize, ta, isOverwritten), frequency(0), syncWord(0), isReceiving(false),
+          txFifoStart(nullptr), txFifoPos(0), txFifoLength(0)
+    {
+        // registers that are never written keep their reset values
+        SetAllParameters();
+    }
+
+    // Register values as written by the MCU
+    const RegisterShadow &Registers() const { return registers; }
+    // Carrier frequency in Hz (as of the last TX/RX start)
+    uint32_t Frequency() const { return frequency; }
+    // LoRa sync word (as of the last TX/RX start)
+    uint8_t SyncWord() const { return syncWord; }
+
+    // Number of bytes written to the FIFO for the upcoming transmission
+    size_t TxFifoLength() const { return txFifoLength; }
+    // Indicates if the bytes written to the FIFO are available (written in a single burst
+    // and not overwritten in the SPI buffer yet)
+    bool HasTxFifoData() const { return txFifoStart != nullptr && !IsOverwritten(txFifoPos); }
+    // Byte written to the FIFO at the given offset (read from the SPI buffer;
+    // valid until the SPI buffer has been overwritten)
+    uint8_t TxFifoByte(size_t offset) const { return TrxByte(txFifoStart, offset + 1); }
 
 private:
+    friend class RadioDecoder<SpiAnalyzer>;
+
+    void DecodeTrx(uint64_t time, const uint8_t *startTrx, const uint8_t *endTrx);
+    void DecodeDio0(uint64_t time) { timingAnalyzer.OnDoneInterrupt(time); }
+    void DecodeDio1(uint64_t time) { timingAnalyzer.OnTimeoutInterrupt(time); }
     void OnFifoRead(const uint8_t *startTrx, const uint8_t *endTrx);
-    void OnRegWrite(uint32_t time, uint8_t reg, uint8_t value);
-    void OnOpModeChanged(uint32_t time, uint8_t value);
-    void OnSymbTimeoutLsbChanged(uint8_t value);
-    void OnModemConfig1(uint8_t value);
-    void OnModemConfig2(uint8_t value);
-    void OnModemConfig3(uint8_t value);
-    void OnPreambleMsbChanged(uint8_t value);
-    void OnPreambleLsbChanged(uint8_t value);
-    void OnPayloadLengthChanged(uint8_t value);
+    void OnFifoWrite(const uint8_t *startTrx, const uint8_t *endTrx);
+    void OnTxPayload();
+    void OnRegWriteBurst(uint64_t time, uint8_t reg, const uint8_t *values, size_t len);
+    void OnOpModeChanged(uint64_t time, uint8_t value);
+    void UpdateParameters();
+    void SetAllParameters();
+    uint32_t ParameterValue(Param param) const;
+    void SetParameter(Param param, uint32_t value);
 
 private:
-    TimingAnalyzer &timingAnalyzer;
-    const uint8_t *circularBufferStart;
-    const uint8_t *circularBufferEnd;
-    uint16_t symbolTimeout;
-    uint16_t preambleLength;
+    RegisterShadow registers;
+    uint32_t frequency;
+    uint8_t syncWord;
+    bool isReceiving;
+
+    // FIFO burst write with the TX payload (transaction in SPI buffer,
+    // nullptr if the payload has been written in several bursts)
+    const uint8_t *txFifoStart;
+    // Position of the FIFO burst write in the stream of SPI data
+    uint32_t txFifoPos;
+    // Number of bytes written to the FIFO since the last transmission
+    // (both are reset when the transmission starts)
+    size_t txFifoLength;
 };
 
 #endif
@@ -0,0 +1,89 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * SPI communication analyzer for SX126x and LLCC68
+ */
+
+#ifndef SX126X_ANALYZER_H
+#define SX126X_ANALYZER_H
+
+#include "radio_decoder.h"
+#include "timing_analyzer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// SX126x commands (opcodes)
+#define SX126X_CLEAR_IRQ_STATUS 0x02
+#define SX126X_GET_IRQ_STATUS 0x12
+#define SX126X_GET_RX_BUFFER_STATUS 0x13
+#define SX126X_GET_PACKET_STATUS 0x14
+#define SX126X_READ_BUFFER 0x1e
+#define SX126X_SET_RX 0x82
+#define SX126X_SET_TX 0x83
+#define SX126X_SET_RF_FREQUENCY 0x86
+#define SX126X_SET_PACKET_TYPE 0x8a
+#define SX126X_SET_MODULATION_PARAMS 0x8b
+#define SX126X_SET_PACKET_PARAMS 0x8c
+#define SX126X_SET_LORA_SYMB_NUM_TIMEOUT 0xa0
+#define SX126X_GET_STATUS 0xc0
+
+// SX126x packet types (SetPacketType)
+#define SX126X_PACKET_TYPE_GFSK 0x00
+#define SX126X_PACKET_TYPE_LORA 0x01
+
+// Decoder for the SX126x/LLCC68 command based SPI protocol.
+//
+// The SX126x signals TX done, RX done and RX timeout on DIO1 (as
+// configured by practically all drivers). DIO1 during TX is a TX done.
+// DIO1 during RX is an RX done if the MCU then reads the received packet,
+// otherwise it is a timeout. So the decision is deferred until the next
+// relevant command. The BUSY signal is not monitored.
+//
+// The parameters of SetModulationParams and SetPacketParams depend on
+// the packet type set with SetPacketType. Drivers may send more parameter
+// bytes than used by the packet type, so the transaction length is only
+// checked for the minimum.
+class Sx126xAnalyzer : public RadioDecoder<Sx126xAnalyzer>
+{
+public:
+    Sx126xAnalyzer(const uint8_t *buf, size_t bufSize, TimingAnalyzer &ta, bool (*isOverwritten)(uint32_t pos) = nullptr)
+        : RadioDecoder(buf, bufSize, ta, isOverwritten), radioMode(RadioModeStandby), isDio1Pending(false),
+          dio1Time(0), numTimeoutSymbols(0), frequency(0), packetType(SX126X_PACKET_TYPE_GFSK) {}
+
+    // Carrier frequency in Hz
+    uint32_t Frequency() const { return frequency; }
+
+private:
+    friend class RadioDecoder<Sx126xAnalyzer>;
+
+    enum RadioMode
+    {
+        RadioModeStandby,
+        RadioModeTx,
+        RadioModeRx
+    };
+
+    void DecodeTrx(uint64_t time, const uint8_t *startTrx, const uint8_t *endTrx);
+    void DecodeDio0(uint64_t) {}
+    void DecodeDio1(uint64_t time);
+    void ResolveDio1(uint8_t opcode);
+    void OnSetRx(uint64_t time, const uint8_t *startTrx, size_t len);
+    void OnSetPacketType(const uint8_t *startTrx, size_t len);
+    void OnSetModulationParams(const uint8_t *startTrx, size_t len);
+    void OnSetPacketParams(const uint8_t *startTrx, size_t len);
+    void OnSetRfFrequency(const uint8_t *startTrx, size_t len);
+
+    RadioMode radioMode;
+    bool isDio1Pending;
+    uint64_t dio1Time;
+    uint8_t numTimeoutSymbols;
+    uint32_t frequency;
+    // Packet type (GFSK after reset)
+    uint8_t packetType;
+};
+
+#endif
@@ -14,34 +14,70 @@
 #include <stdint.h>
 #include <stm32f1xx_hal.h>
 
+// Milliseconds since start (lower 32 bits)
 extern volatile uint32_t UptimeMillis;
+// Upper 32 bits of milliseconds since start
+// (incremented each time `UptimeMillis` wraps around)
+extern volatile uint32_t UptimeMillisEpoch;
 
-static inline uint32_t GetMicros()
+// Reciprocal of the number of SysTick ticks per microsecond (Q1.31 fixed point),
+// i.e. ceil(2^31 / ticksPerMicro). See `InitMicros()`.
+extern uint32_t SysTickMicrosFactor;
+
+// Initializes the conversion from SysTick ticks to microseconds.
+// Must be called after the system clock and the SysTick timer
+// have been configured.
+void InitMicros();
+
+// Computes the time in microseconds from the number of completed
+// SysTick periods (milliseconds) and the SysTick counter value.
+// The SysTick counter counts down from LOAD to 0.
+// `st * SysTickMicrosFactor >> 31` is identical to
+// `st / ((SysTick->LOAD + 1) / 1000)` for all values of `st`
+// but avoids the divisions.
+static inline uint64_t MicrosFromTicks(uint64_t ms, uint32_t st)
+{
+    uint32_t us = (uint32_t)(((uint64_t)st * SysTickMicrosFactor) >> 31);
+    return (ms + 1) * 1000 - us;
+}
+
+// Returns the time since start in microseconds.
+// Must not be called from an interrupt handler.
+static inline uint64_t GetMicros()
 {
+    uint32_t epoch;
     uint32_t ms;
     uint32_t st;
 
     do
     {
+        epoch = UptimeMillisEpoch;
         ms = UptimeMillis;
         st = SysTick->VAL;
         asm volatile("nop");
         asm volatile("nop");
-    } while (ms != UptimeMillis);
+    } while (ms != UptimeMillis || epoch != UptimeMillisEpoch);
 
-    return ms * 1000 - st / ((SysTick->LOAD + 1) / 1000);
+    return MicrosFromTicks(((uint64_t)epoch << 32) | ms, st);
 }
 
-static inline uint32_t GetMicrosFromISR()
+// Returns the time since start in microseconds.
+// Must be called from an interrupt handler that cannot
+// be preempted by the SysTick interrupt.
+static inline uint64_t GetMicrosFromISR()
 {
     uint32_t st = SysTick->VAL;
     uint32_t pending = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
-    uint32_t ms = UptimeMillis;
+    uint64_t ms = ((uint64_t)UptimeMillisEpoch << 32) | UptimeMillis;
 
-    if (pending == 0)
+    // If the SysTick counter has wrapped around but the SysTick
+    // handler hasn't run yet, the millisecond count is one behind.
+    // This only applies if the counter value was read after the
+    // wraparound (i.e. it is still close to LOAD).
+    if (pending != 0 && st > SysTick->LOAD / 2)
         ms++;
 
-    return ms * 1000 - st / ((SysTick->LOAD + 1) / 1000);
+    return MicrosFromTicks(ms, st);
 }
 
 #endif
@@ -11,13 +11,30 @@
 #ifndef TIMING_ANALYZER_H
 #define TIMING_ANALYZER_H
 
+#include "channel_statistics.h"
+#include "lorawan.h"
+#include "sample_output.h"
 #include <stdint.h>
-#include <math.h>
 
 #if !defined(MEASURED_CLOCK)
 #define MEASURED_CLOCK 1000
 #endif
 
+// Calibration factor 1000 / clock as unsigned Q1.63 fixed-point number
+// (evaluated at compile time; no floating-point code is generated)
+#define CALIBRATION_FACTOR_FOR(clock) ((uint64_t)(1000.0 / (clock) * 9223372036854775808.0))
+// Calibration factor for the measured clock of the probe
+#define CALIBRATION_FACTOR CALIBRATION_FACTOR_FOR(MEASURED_CLOCK)
+
+static_assert(MEASURED_CLOCK > 500.0 && MEASURED_CLOCK < 2000.0, "MEASURED_CLOCK is out of range");
+
+
+// Number of bandwidth settings (RegModemConfig1)
+#define NUM_BANDWIDTHS 10
+
+// Bandwidth in Hz (rounded) for each bandwidth setting
+extern const uint32_t BANDWIDTH_TABLE[NUM_BANDWIDTHS];
+
 
 enum LoraTxRxStage
 {
@@ -37,27 +54,32 @@ enum LoraTxRxResult
     LoraResultDownlinkInRx2
 };
 
-enum LongRangeMode
-{
-    LongrangeModeFSK,
-    LongrangeModeLora
-};
-
 
 class TimingAnalyzer
 {
 public:
     TimingAnalyzer();
 
-    void OnTxStart(uint32_t time);
-    void OnRxStart(uint32_t time);
-    void OnDoneInterrupt(uint32_t time);
-    void OnTimeoutInterrupt(uint32_t time);
-    void OnDataReceived(uint8_t rxPayloadLength);
+    void OnTxStart(uint64_t time);
+    void OnRxStart(uint64_t time);
+    void OnDoneInterrupt(uint64_t time);
+    void OnTimeoutInterrupt(uint64_t time);
+    void OnDataReceived(int rxPayloadLength);
+    // Called when the MCU switches the radio from RX to another mode
+    void OnRxStopped(uint64_t time);
+
+    // Reset analysis to idle (waiting for the next TX start)
+    void ResetStage();
+
+    void PrintChannelStatistics() { channelStatistics.Print(); }
 
     void SetLongRangeMode(LongRangeMode mode) { this->longRangeMode = mode; }
+    // Carrier frequency in Hz (0 if unknown)
+    void SetFrequency(uint32_t frequency) { this->frequency = frequency; }
     void SetRxSymbolTimeout(uint16_t numTimeoutSymbols) { this->numTimeoutSymbols = numTimeoutSymbols; }
-    void SetBandwidth(uint32_t bandwidth) { this->bandwidth = bandwidth; }
+    // RX timeout in us (if the radio uses a timer instead of the symbol timeout, 0 otherwise)
+    void SetRxTimeoutDuration(uint32_t rxTimeoutDuration) { this->rxTimeoutDuration = rxTimeoutDuration; }
+    void SetBandwidth(uint8_t bandwidthIndex) { this->bandwidthIndex = bandwidthIndex; }
     void SetCodingRate(uint8_t codingRate) { this->codingRate = codingRate; }
     void SetImplicitHeader(uint8_t implicitHeader) { this->implicitHeader = implicitHeader; }
     void SetSpreadingFactor(uint8_t spreadingFactor) { this->spreadingFactor = spreadingFactor; }
@@ -65,35 +87,89 @@ public:
     void SetPreambleLength(uint16_t preambleLength) { this->preambleLength = preambleLength; }
     void SetTxPayloadLength(uint8_t txPayloadLength) { this->txPayloadLength = txPayloadLength; }
     void SetLowDataRateOptimization(uint8_t lowDataRateOptimization) { this->lowDataRateOptimization = lowDataRateOptimization; }
+    // LoRaWAN frame being transmitted (nullptr if not a LoRaWAN frame)
+    void SetTxFrame(const LoraWanFrame *frame);
+    // Number of bytes written to the FIFO for the transmission (-1 if unknown)
+    void SetTxFifoLength(int txFifoLength) { this->txFifoLength = txFifoLength; }
+
+    // FSK bit period in 1/512 us (16 * BitRate + BitRateFrac)
+    void SetFskBitPeriod(uint32_t fskBitPeriod) { this->fskBitPeriod = fskBitPeriod; }
+    void SetFskFrequencyDeviation(uint32_t fskFrequencyDeviation) { this->fskFrequencyDeviation = fskFrequencyDeviation; }
+    void SetFskPreambleDetectSize(uint8_t fskPreambleDetectSize) { this->fskPreambleDetectSize = fskPreambleDetectSize; }
+    void SetFskPreambleLength(uint16_t fskPreambleLength) { this->fskPreambleLength = fskPreambleLength; }
+    void SetFskSyncSize(uint8_t fskSyncSize) { this->fskSyncSize = fskSyncSize; }
+    void SetFskVariableLength(uint8_t fskVariableLength) { this->fskVariableLength = fskVariableLength; }
+    void SetFskCrcOn(uint8_t fskCrcOn) { this->fskCrcOn = fskCrcOn; }
+    void SetFskAddressFiltering(uint8_t fskAddressFiltering) { this->fskAddressFiltering = fskAddressFiltering; }
+    void SetFskPayloadLength(uint16_t fskPayloadLength) { this->fskPayloadLength = fskPayloadLength; }
+
+    // Air time of a packet with the given payload length in us (current modulation parameters)
+    int32_t PayloadAirTime(int payloadLength);
+    // Duration of the given number of LoRa symbols in us (current modulation parameters)
+    int32_t SymbolDuration(int numSymbols);
+
+    // Applies the clock calibration to a time difference in us
+    static int32_t CalibratedTime(int32_t time) { return CalibratedTime(time, CALIBRATION_FACTOR); }
+    // Applies the given calibration factor (see `CALIBRATION_FACTOR_FOR`)
+    static int32_t CalibratedTime(int32_t time, uint64_t calibrationFactor);
 
 private:
-    void ResetStage();
     void OnRxTxCompleted();
 
-    static int32_t CalibratedTime(int32_t time) { return (int32_t) round(time * 1000.0 / MEASURED_CLOCK); }
-    void PrintRxAnalysis(int32_t windowStartTime, int32_t windowEndTime, int payloadLength);
-    void PrintTimeoutAnalysis(int32_t windowStartTime, int32_t windowEndTime);
-    void PrintParameters(int32_t duration, int payloadLength);
-    static void PrintRelativeTimestamp(int32_t timestamp);
+    // Difference between two timestamps (in uncalibrated microseconds)
+    static int32_t TimeDiff(uint64_t time, uint64_t reference) { return (int32_t)(int64_t)(time - reference); }
+    // The analysis functions return the (smaller) margin in us
+    int32_t PrintRxAnalysis(int32_t windowStartTime, int32_t windowEndTime, int payloadLength);
+    int32_t PrintTimeoutAnalysis(int32_t windowStartTime, int32_t windowEndTime, bool isRx2);
+    void UpdateRxDelay();
+    void LearnRxDelay(int32_t windowStartTime, bool isRx2);
+    int32_t ExpectedWindowStart(int32_t windowStartTime, bool isRx2);
+    void PrintParameters(int32_t txStartTime, int payloadLength);
+    // Current modulation parameters for the given channel (carrier frequency)
+    ModulationInfo Modulation(uint32_t channelFrequency);
+    void PrintPayloadLengthCheck();
+    // Payload length of the transmission as configured
+    int ConfiguredTxPayloadLength();
+    // Payload length of the transmission (number of bytes in the FIFO if known)
+    int TxPayloadLength();
 
     void OutOfSync(const char* stage);
-    int32_t PayloadAirTime(uint8_t payloadLength);
-    int32_t SymbolDuration(int numSymbols);
-
+    int32_t FskAirTime(int payloadLength);
+    int32_t FskByteDuration(int numBytes);
+    // Duration of the preamble that is not needed for detection
+    int32_t PreambleMargin();
+    // Duration of the preamble needed for detection
+    int32_t PreambleDetectionTime();
+
+    SampleOutput sampleOutput;
     int sampleNo;
     LoraTxRxStage stage;
     LoraTxRxResult result;
-    uint32_t txUncalibratedStartTime;
+    uint64_t txUncalibratedStartTime;
     int32_t txStartTime;
-    int32_t txUncalibratedEndTime;
+    uint64_t txUncalibratedEndTime;
     int32_t rx1Start;
     int32_t rx1End;
     int32_t rx2Start;
     int32_t rx2End;
 
+    // Carrier frequency of the uplink and the current RX window
+    uint32_t txFrequency;
+    uint32_t rxFrequency;
+    ChannelStatistics channelStatistics;
+
+    LoraWanFrame txFrame;
+    bool hasTxFrame;
+    // RX1 delay of LoRaWAN data frames (in us, 0 if not known yet)
+    int32_t rxDelay;
+    // RX1 delay of the current cycle (in us, 0 if not known)
+    int32_t cycleRxDelay;
+
     LongRangeMode longRangeMode;
-    uint32_t bandwidth;
+    uint32_t frequency;
+    uint8_t bandwidthIndex;
     uint16_t numTimeoutSymbols;
+    uint32_t rxTimeoutDuration;
     uint8_t codingRate;
     uint8_t implicitHeader;
     uint8_t spreadingFactor;
@@ -101,6 +177,33 @@ private:
     uint16_t preambleLength;
     uint8_t txPayloadLength;
     uint8_t lowDataRateOptimization;
+    int txFifoLength;
+
+    uint32_t fskBitPeriod;
+    uint32_t fskFrequencyDeviation;
+    uint8_t fskPreambleDetectSize;
+    uint16_t fskPreambleLength;
+    uint8_t fskSyncSize;
+    uint8_t fskVariableLength;
+    uint8_t fskCrcOn;
+    uint8_t fskAddressFiltering;
+    uint16_t fskPayloadLength;
 };
 
+
+// Computes round(time * 1000 / clock) with integer arithmetic only.
+// The magnitude is multiplied with the Q1.63 calibration factor using two
+// 32x32->64 bit multiplications; the 96 bit product is rounded half away
+// from zero like round(). The result is compared with
+// `llround(time * 1000.0 / clock)` for several clock values in
+// test/test_calibration; it is identical as long as it fits into 32 bits.
+inline int32_t TimingAnalyzer::CalibratedTime(int32_t time, uint64_t calibrationFactor)
+{
+    uint32_t magnitude = time < 0 ? -(uint32_t)time : (uint32_t)time;
+    uint64_t productLow = (uint64_t)magnitude * (uint32_t)calibrationFactor;
+    uint64_t productHigh = (uint64_t)magnitude * (uint32_t)(calibrationFactor >> 32);
+    uint32_t result = (uint32_t)((productHigh + (productLow >> 32) + 0x40000000U) >> 31);
+    return time < 0 ? -(int32_t)result : (int32_t)result;
+}
+
 #endif
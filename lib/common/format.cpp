@@ -0,0 +1,169 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Type-safe formatted output (replacement for vsnprintf)
+ */
+
+#include "format.h"
+#include <string.h>
+
+// Sufficient for a 64-bit integer in decimal with sign
+#define MAX_DIGITS 21
+
+static const char *HEX_DIGITS_UPPER = "0123456789ABCDEF";
+static const char *HEX_DIGITS_LOWER = "0123456789abcdef";
+static const char *PADDING = "                ";
+static const char *ZEROS = "0000000000000000";
+
+static void Pad(FormatWriter writer, void *context, const char *padding, size_t len)
+{
+    while (len > 0)
+    {
+        size_t n = len < 16 ? len : 16;
+        writer(context, padding, n);
+        len -= n;
+    }
+}
+
+void FormatArgs(FormatWriter writer, void *context, const char *fmt, const FormatArg *args, size_t numArgs)
+{
+    const FormatArg *argsEnd = args + numArgs;
+
+    while (*fmt != 0)
+    {
+        // literal text up to the next conversion
+        const char *start = fmt;
+        while (*fmt != 0 && *fmt != '%')
+            fmt++;
+        if (fmt > start)
+            writer(context, start, fmt - start);
+        if (*fmt == 0)
+            break;
+
+        // conversion specification
+        const char *specStart = fmt;
+        fmt++;
+        bool leftJustify = false;
+        bool zeroPad = false;
+        while (*fmt == '-' || *fmt == '0')
+        {
+            if (*fmt == '-')
+                leftJustify = true;
+            else
+                zeroPad = true;
+            fmt++;
+        }
+        size_t width = 0;
+        while (*fmt >= '0' && *fmt <= '9')
+        {
+            width = width * 10 + (*fmt - '0');
+            fmt++;
+        }
+        while (*fmt == 'l' || *fmt == 'h')
+            fmt++;
+
+        char conversion = *fmt;
+        if (conversion == 0)
+        {
+            // incomplete specification: output as is
+            writer(context, specStart, fmt - specStart);
+            break;
+        }
+        fmt++;
+
+        if (conversion == '%')
+        {
+            writer(context, "%", 1);
+            continue;
+        }
+
+        if (strchr("diuxXcs", conversion) == nullptr)
+        {
+            // unsupported conversion: output as is
+            writer(context, specStart, fmt - specStart);
+            continue;
+        }
+
+        if (args == argsEnd)
+            continue; // missing argument
+
+        const FormatArg &arg = *args++;
+
+        // assemble the text of the argument (right-aligned in `digits`)
+        char digits[MAX_DIGITS];
+        char *end = digits + sizeof(digits);
+        const char *text = end;
+        size_t textLen;
+        bool isNegative = false;
+
+        if (arg.type == FormatArg::TypeString)
+        {
+            text = arg.str != nullptr ? arg.str : "(null)";
+            textLen = strlen(text);
+            zeroPad = false;
+        }
+        else if (conversion == 'c')
+        {
+            digits[0] = (char)arg.value;
+            text = digits;
+            textLen = 1;
+            zeroPad = false;
+        }
+        else
+        {
+            unsigned long value = arg.value;
+            char *p = end;
+            if (conversion == 'x' || conversion == 'X')
+            {
+                const char *hexDigits = conversion == 'x' ? HEX_DIGITS_LOWER : HEX_DIGITS_UPPER;
+                do
+                {
+                    *--p = hexDigits[value & 0xfU];
+                    value >>= 4;
+                } while (value != 0);
+            }
+            else
+            {
+                if (arg.type == FormatArg::TypeSigned && (long)value < 0)
+                {
+                    isNegative = true;
+                    value = 0 - value;
+                }
+                do
+                {
+                    *--p = (char)('0' + value % 10);
+                    value /= 10;
+                } while (value != 0);
+            }
+            text = p;
+            textLen = end - p;
+        }
+
+        size_t len = textLen + (isNegative ? 1 : 0);
+        size_t padLen = width > len ? width - len : 0;
+
+        if (padLen > 0 && !leftJustify && !zeroPad)
+            Pad(writer, context, PADDING, padLen);
+        if (isNegative)
+            writer(context, "-", 1);
+        if (padLen > 0 && !leftJustify && zeroPad)
+            Pad(writer, context, ZEROS, padLen);
+        writer(context, text, textLen);
+        if (padLen > 0 && leftJustify)
+            Pad(writer, context, PADDING, padLen);
+    }
+}
+
+void FormatBuffer::Append(void *context, const char *data, size_t len)
+{
+    FormatBuffer *buffer = (FormatBuffer *)context;
+    size_t avail = buffer->end - buffer->p;
+    if (len > avail)
+        len = avail;
+    memcpy(buffer->p, data, len);
+    buffer->p += len;
+}
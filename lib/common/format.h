@@ -0,0 +1,90 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Type-safe formatted output (replacement for vsnprintf)
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Formatting supports the subset of printf used by the probe:
+//
+//  *  conversions `d`, `i`, `u`, `x`, `X`, `c`, `s` and `%%`
+//  *  flags `-` (left-justify) and `0` (pad with zeros)
+//  *  minimum field width
+//  *  length modifiers `l` and `h` (accepted and ignored)
+//
+// The representation of an argument is derived from its C++ type, not from
+// the format string: an integer is never interpreted as a pointer and vice
+// versa. Integers are printed as decimal (`d`, `i`, `u`), hexadecimal (`x`, `X`)
+// or as a character (`c`); strings are printed as is. Conversions without a
+// matching argument produce no output. No memory is allocated, and there is
+// no shared buffer, so formatting is reentrant.
+
+// Formatting argument (type-erased)
+struct FormatArg
+{
+    enum Type
+    {
+        TypeNone,
+        TypeSigned,
+        TypeUnsigned,
+        TypeString
+    };
+
+    FormatArg() : type(TypeNone), value(0), str(nullptr) {}
+    FormatArg(int value) : type(TypeSigned), value((unsigned long)(long)value), str(nullptr) {}
+    FormatArg(long value) : type(TypeSigned), value((unsigned long)value), str(nullptr) {}
+    FormatArg(unsigned value) : type(TypeUnsigned), value(value), str(nullptr) {}
+    FormatArg(unsigned long value) : type(TypeUnsigned), value(value), str(nullptr) {}
+    FormatArg(const char *str) : type(TypeString), value(0), str(str) {}
+
+    Type type;
+    // Value of integer (two's complement if signed)
+    unsigned long value;
+    const char *str;
+};
+
+// Function called with each piece of formatted text
+typedef void (*FormatWriter)(void *context, const char *data, size_t len);
+
+// Formats the arguments and passes the text in pieces to the writer.
+void FormatArgs(FormatWriter writer, void *context, const char *fmt, const FormatArg *args, size_t numArgs);
+
+// Formats the arguments and passes the text in pieces to the writer.
+template <typename... Args>
+inline void Format(FormatWriter writer, void *context, const char *fmt, Args... args)
+{
+    // the extra element avoids an empty array if there are no arguments
+    const FormatArg formatArgs[] = { FormatArg(args)..., FormatArg() };
+    FormatArgs(writer, context, fmt, formatArgs, sizeof...(Args));
+}
+
+// Character buffer for formatting (excess text is truncated)
+struct FormatBuffer
+{
+    char *p;
+    char *end;
+
+    static void Append(void *context, const char *data, size_t len);
+};
+
+// Formats the arguments into `buf` (like `snprintf`). The text is always
+// terminated and truncated if needed. Returns the length of the text.
+template <typename... Args>
+inline size_t FormatToBuffer(char *buf, size_t size, const char *fmt, Args... args)
+{
+    FormatBuffer buffer = { buf, buf + size - 1 };
+    Format(FormatBuffer::Append, &buffer, fmt, args...);
+    *buffer.p = 0;
+    return buffer.p - buf;
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Lock-free single-producer/single-consumer ring buffer
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free ring buffer for passing items from a single producer
+// (typically an interrupt handler) to a single consumer (typically
+// the main loop).
+//
+//  *  `head` is the number of items ever added (written by producer only)
+//  *  `tail` is the number of items ever removed (written by consumer only)
+//  *  head == tail => empty
+//  *  head - tail == CAPACITY => full
+// Both counters run freely and wrap around at 2^32. As the capacity is
+// a power of two, the item index is derived with a mask and all
+// `CAPACITY` slots can be used.
+//
+// The producer publishes an item with a release store of `head` after
+// the item has been written. The consumer reads `head` with an acquire
+// load before accessing the item, and releases the slot with a release
+// store of `tail` after it is done with it. On a single-core Cortex-M3
+// this results in plain loads/stores and a DMB; on a multi-core host it
+// results in the required memory fences.
+//
+// Several interrupt handlers may act as the producer provided they run
+// at the same priority and thus cannot preempt each other.
+template <typename T, size_t CAPACITY>
+class SpscRing
+{
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+    static_assert(CAPACITY <= 0x80000000U, "capacity too big");
+
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    // Adds an item (producer only). Returns false if the ring is full.
+    bool Push(const T &item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t t = tail.load(std::memory_order_acquire);
+        if (h - t >= CAPACITY)
+            return false;
+
+        items[h & MASK] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Removes the oldest item (consumer only). Returns false if the ring is empty.
+    bool Pop(T &item)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t h = head.load(std::memory_order_acquire);
+        if (h == t)
+            return false;
+
+        item = items[t & MASK];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Number of items in the ring (exact if called by the consumer or producer,
+    // a snapshot otherwise)
+    size_t Size() const
+    {
+        uint32_t t = tail.load(std::memory_order_acquire);
+        uint32_t h = head.load(std::memory_order_acquire);
+        return h - t;
+    }
+
+    bool IsEmpty() const { return Size() == 0; }
+
+    static constexpr size_t Capacity() { return CAPACITY; }
+
+private:
+    static constexpr uint32_t MASK = CAPACITY - 1;
+
+    T items[CAPACITY];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+};
+
+#endif
@@ -0,0 +1,396 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Transmit ring buffer for asynchronous serial output
+ */
+
+#ifndef TX_RING_H
+#define TX_RING_H
+
+#include "common.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Maximum time to wait for free space with `TxBlock` (in ms)
+#if !defined(TX_BLOCK_TIMEOUT)
+#define TX_BLOCK_TIMEOUT 10
+#endif
+
+// Behavior if a message does not fit into the transmit buffer
+enum TxOverflowPolicy
+{
+    // Drop the new message
+    TxDropNewest,
+    // Drop the pending data not yet being transmitted (the chunk being
+    // transmitted is kept), then drop the new message if it still doesn't fit
+    TxDropOldest,
+    // Wait for space (up to TX_BLOCK_TIMEOUT), then drop the new message
+    TxBlock,
+    // Drop the new message and all further messages until half of the buffer
+    // is free again so the loss is coalesced into one gap
+    TxCoalesce
+};
+
+// Priority of a message
+enum TxPriority
+{
+    TxPriorityNormal,
+    // Debug output: only accepted if a quarter of the buffer remains free
+    TxPriorityLow
+};
+
+// Number of messages and bytes dropped (counters wrap around)
+struct TxDropStatistics
+{
+    uint32_t numDroppedMessages;
+    uint32_t numDroppedBytes;
+};
+
+// Buffer for data to be transmitted asynchronously (by DMA or USB).
+//
+// The data is kept in a circular buffer and a queue of chunks. A chunk is a
+// contiguous part of the buffer that is transmitted in a single transfer.
+// New data is appended to the newest chunk unless it is already being
+// transmitted or the buffer wraps around.
+//
+// Circular buffer:
+//  *  0 <= head < BUF_LEN
+//  *  0 <= tail < BUF_LEN
+//  *  head == tail => empty or full
+// Whether the buffer is empty or full needs to be derived
+// from the chunk queue: the buffer is empty if the chunk queue is empty.
+// `bufHead` points to the positions where the next character
+// should be inserted. `bufTail` points to the character after
+// the last character that has been transmitted.
+//
+// Chunk queue:
+//  *  0 <= head < QUEUE_LEN
+//  *  0 <= tail < QUEUE_LEN
+//  *  head == tail => empty
+//  *  head + 1 == tail => full (modulo QUEUE_LEN)
+// `queueHead` points to the position where the next item must be added.
+// `queueTail` points to the next item that needs to be processed
+// or is being processed.
+// With current item's index, `chunkBreak` points to the end
+// of the data to be transmitted (0 for the end of the buffer). The start
+// can be retrieved with index - 1 (modulo QUEUE_LEN).
+//
+// `Transport` provides the static functions:
+//
+//  *  `bool IsReady()`: indicates if a transfer can be started
+//  *  `void Transmit(const uint8_t *data, size_t len)`: starts a transfer;
+//     when it has completed, `TransmissionCompleted()` must be called
+//     (from the interrupt handler, never from within `Transmit()`)
+//  *  `uint32_t Millis()`: current time in ms (for `TxBlock`)
+//
+// If a started transfer will not complete (e.g. the USB connection has been
+// reset), `TransmissionAborted()` must be called instead.
+//
+// Each call of `Write()` is a message. A message is either written
+// completely or dropped (see `TxOverflowPolicy`); messages longer than the
+// buffer are always dropped. Low priority messages are only accepted if a quarter
+// of the buffer remains free for normal messages; they never cause other
+// data to be dropped.
+//
+// `Write()` must be called from the main loop only.
+template <size_t BUF_LEN, size_t QUEUE_LEN, typename Transport, TxOverflowPolicy POLICY>
+class TxRing
+{
+    static_assert(QUEUE_LEN >= 4, "queue too short");
+
+public:
+    TxRing() : bufHead(0), bufTail(0), queueHead(0), queueTail(0), isTransmitting(false), isCongested(false)
+    {
+        chunkBreak[0] = 0;
+        chunkMessages[0] = 0;
+        dropStatistics.numDroppedMessages = 0;
+        dropStatistics.numDroppedBytes = 0;
+    }
+
+    // Appends the message and starts the transmission if the transport is idle.
+    // Returns false if the message has been dropped.
+    bool Write(const uint8_t *data, size_t len, TxPriority priority = TxPriorityNormal)
+    {
+        if (len == 0)
+            return true;
+
+        // the space for the entire message is checked so it's never partially
+        // written; a message longer than the buffer can never fit
+        if (len > BUF_LEN || !MakeSpace(len, priority))
+        {
+            dropStatistics.numDroppedMessages++;
+            dropStatistics.numDroppedBytes += len;
+            return false;
+        }
+
+        Append(data, len);
+        return true;
+    }
+
+    // Starts the transmission of the next chunk if the transport is idle
+    void StartTransmit()
+    {
+        InterruptGuard guard;
+
+        if (queueTail == queueHead || isTransmitting || !Transport::IsReady())
+            return; // queue empty or transport busy
+
+        int startPos = bufTail;
+        int endPos = chunkBreak[queueTail];
+        if (endPos == 0)
+            endPos = BUF_LEN;
+
+        isTransmitting = true;
+        Transport::Transmit(buf + startPos, endPos - startPos);
+    }
+
+    // Releases the transmitted chunk and starts the next one
+    // (called by the interrupt handler)
+    void TransmissionCompleted()
+    {
+        {
+            InterruptGuard guard;
+
+            bufTail = chunkBreak[queueTail];
+            int qTail = queueTail + 1;
+            if (qTail >= (int)QUEUE_LEN)
+                qTail = 0;
+            queueTail = qTail;
+            isTransmitting = false;
+        }
+
+        StartTransmit();
+    }
+
+    // Abandons the transfer in progress if it will never complete
+    // (e.g. USB reset or disconnect); the chunk is kept and transmitted
+    // again by the next `StartTransmit()` (called from the interrupt handler)
+    void TransmissionAborted()
+    {
+        isTransmitting = false;
+    }
+
+    bool IsTransmitting() const { return isTransmitting; }
+
+    // Indicates if all data has been transmitted
+    bool IsEmpty() const { return queueHead == queueTail; }
+
+    // Number of dropped messages and bytes so far
+    const TxDropStatistics &DropStatistics() const { return dropStatistics; }
+
+private:
+    // Checks if the message fits and applies the overflow policy if it doesn't.
+    // Returns true if the message can be appended.
+    bool MakeSpace(size_t len, TxPriority priority)
+    {
+        if (priority == TxPriorityLow)
+            return HasSpace(len + BUF_LEN / 4);
+
+        if (POLICY == TxCoalesce && isCongested)
+        {
+            // drop everything until the buffer has drained to half of its size
+            if (!HasSpace(BUF_LEN / 2))
+                return false;
+            isCongested = false;
+        }
+
+        if (HasSpace(len))
+            return true;
+
+        if (POLICY == TxDropOldest)
+        {
+            FlushPending();
+        }
+        else if (POLICY == TxBlock)
+        {
+            uint32_t startTime = Transport::Millis();
+            while (!HasSpace(len) && Transport::Millis() - startTime < TX_BLOCK_TIMEOUT)
+            {
+                // nothing will free space if the transport is stalled
+                StartTransmit();
+                if (!isTransmitting)
+                    break;
+            }
+        }
+
+        if (HasSpace(len))
+            return true;
+
+        if (POLICY == TxCoalesce)
+            isCongested = true;
+        return false;
+    }
+
+    // Checks if `len` bytes can be appended
+    bool HasSpace(size_t len)
+    {
+        InterruptGuard guard;
+
+        int qHead = queueHead;
+        int qTail = queueTail;
+        if (qHead == qTail)
+            return len <= BUF_LEN;
+
+        // a message can add up to 2 chunks (if it wraps around)
+        int numChunks = qHead - qTail;
+        if (numChunks < 0)
+            numChunks += QUEUE_LEN;
+        if (numChunks + 2 >= (int)QUEUE_LEN)
+            return false;
+
+        int freeLen = bufTail - bufHead;
+        if (freeLen < 0)
+            freeLen += BUF_LEN;
+        return len <= (size_t)freeLen;
+    }
+
+    // Appends the data (space must be available)
+    void Append(const uint8_t *data, size_t len)
+    {
+        while (len > 0)
+        {
+            int tail = bufTail;
+            int head = bufHead;
+            size_t availChunkSize = head < tail ? tail - head : BUF_LEN - head;
+
+            // Copy data to transmit buffer
+            size_t size = len <= availChunkSize ? len : availChunkSize;
+            memcpy(buf + head, data, size);
+            head += size;
+            if (head >= (int)BUF_LEN)
+                head = 0;
+
+            // try to increase existing chunk
+            // if it's not being transmitted yet
+            if (!TryAppend(head))
+            {
+                // create new chunk
+                int qHead = queueHead;
+                int next = qHead + 1;
+                if (next >= (int)QUEUE_LEN)
+                    next = 0;
+
+                chunkBreak[qHead] = head;
+                chunkMessages[qHead] = 0;
+                bufHead = head;
+                queueHead = next;
+            }
+
+            int newest = queueHead - 1;
+            if (newest < 0)
+                newest = QUEUE_LEN - 1;
+            chunkEndsMessage[newest] = size == len;
+
+            StartTransmit();
+
+            data += size;
+            len -= size;
+        }
+
+        // count the message in the chunk containing its end
+        int newest = queueHead - 1;
+        if (newest < 0)
+            newest = QUEUE_LEN - 1;
+        chunkMessages[newest]++;
+    }
+
+    // Tries to append to newest pending chunk,
+    // provided it's not yet being transmitted
+    bool TryAppend(int head)
+    {
+        InterruptGuard guard;
+
+        int qTail = queueTail;
+        int qHead = queueHead;
+        if (qTail == qHead)
+            return false; // no pending chunk
+
+        qTail++;
+        if (qTail >= (int)QUEUE_LEN)
+            qTail = 0;
+        if (qTail == qHead)
+            return false; // a single chunk (already being transmitted)
+
+        qHead--;
+        if (qHead < 0)
+            qHead = QUEUE_LEN - 1;
+
+        if (chunkBreak[qHead] == 0)
+            return false; // non-contiguous chunk
+
+        bufHead = head;
+        chunkBreak[qHead] = head;
+
+        return true;
+    }
+
+    // Discards the pending data except the chunk being transmitted
+    // and the rest of the message it ends with
+    void FlushPending()
+    {
+        InterruptGuard guard;
+
+        int qTail = queueTail;
+        if (isTransmitting)
+        {
+            // preserve the chunk being transmitted and the chunks
+            // up to the end of the message it's part of
+            bool endsMessage;
+            do
+            {
+                endsMessage = chunkEndsMessage[qTail];
+                qTail++;
+                if (qTail >= (int)QUEUE_LEN)
+                    qTail = 0;
+            } while (!endsMessage && qTail != queueHead);
+        }
+
+        if (qTail == queueHead)
+            return; // no pending data
+
+        int head = bufHead;
+        int newHead = isTransmitting ? chunkBreak[qTail > 0 ? qTail - 1 : QUEUE_LEN - 1] : bufTail;
+        int len = head - newHead;
+        if (len <= 0)
+            len += BUF_LEN;
+        dropStatistics.numDroppedBytes += len;
+        for (int i = qTail; i != queueHead; i = i + 1 < (int)QUEUE_LEN ? i + 1 : 0)
+            dropStatistics.numDroppedMessages += chunkMessages[i];
+
+        if (isTransmitting)
+        {
+            queueHead = qTail;
+            bufHead = newHead;
+        }
+        else
+        {
+            queueHead = queueTail = 0;
+            bufHead = bufTail = 0;
+        }
+    }
+
+    uint8_t buf[BUF_LEN];
+    volatile int bufHead;
+    volatile int bufTail;
+
+    volatile int chunkBreak[QUEUE_LEN];
+    volatile int queueHead;
+    volatile int queueTail;
+
+    volatile bool isTransmitting;
+
+    // Number of messages ending in each chunk
+    uint16_t chunkMessages[QUEUE_LEN];
+    // Indicates if the chunk ends on a message boundary
+    bool chunkEndsMessage[QUEUE_LEN];
+    // Drops messages until the buffer has drained (for `TxCoalesce`)
+    bool isCongested;
+    TxDropStatistics dropStatistics;
+};
+
+#endif
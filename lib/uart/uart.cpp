@@ -9,8 +9,7 @@
  */
 #include "common.h"
 #include "uart.h"
-#include <cstdarg>
-#include <cstring>
+#include "tx_ring.h"
 #include <stm32f1xx_hal.h>
 
 #define UART_RX_PIN GPIO_PIN_3
@@ -30,186 +29,36 @@ UartImpl Uart;
 static UART_HandleTypeDef uart;
 static DMA_HandleTypeDef hdma_uart_tx;
 
-// Buffer for data to be transmitted via UART
-//  *  0 <= head < buf_len
-//  *  0 <= tail < buf_len
-//  *  head == tail => empty or full
-// Whether the buffer is empty or full needs to be derived
-// from the data chunk queue: the buffer is empty if the
-// chunk queue is empty.
-// `txBufHead` points to the positions where the next character
-// should be inserted. `txBufTail` points to the character after
-// the last character that has been transmitted.
-#define TX_BUF_LEN 1024
-static uint8_t txBuf[TX_BUF_LEN];
-static volatile int txBufHead = 0;
-static volatile int txBufTail = 0;
-
-// Queue of UART transmission data chunks:
-//  *  0 <= head < queue_len
-//  *  0 <= tail < queue_len
-//  *  head == tail => empty
-//  *  head + 1 == tail => full (modulo TX_QUEUE_LEN)
-// `txQueueHead` points to the position where the next item must be added.
-// `txQueueTail` points to the next item that needs to be processed
-// or is being processed.
-// With current item's index, `txChunkBreak` points to the end
-// of the data to be transmitted. The start can be retrieved with
-// index - 1 (modulo TX_QUEUE_LEN).
-#define TX_QUEUE_LEN 16
-static volatile int txChunkBreak[TX_QUEUE_LEN];
-static volatile int txQueueHead = 0;
-static volatile int txQueueTail = 0;
-
-static char formatBuf[128];
-
-static const char *HEX_DIGITS = "0123456789ABCDEF";
-
-void UartImpl::Print(const char *str)
+// Transmission via UART with DMA
+struct UartTransport
 {
-    Write((const uint8_t *)str, strlen(str));
-}
-
-void UartImpl::Printf(const char *fmt, ...)
-{
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(formatBuf, sizeof(formatBuf), fmt, args);
-    va_end(args);
-    Print(formatBuf);
-}
+    static bool IsReady() { return uart.gState == HAL_UART_STATE_READY; }
+    static void Transmit(const uint8_t *data, size_t len) { HAL_UART_Transmit_DMA(&uart, (uint8_t *)data, len); }
+    static uint32_t Millis() { return HAL_GetTick(); }
+};
 
-void UartImpl::PrintHex(const uint8_t *data, size_t len, _Bool crlf)
-{
-    while (len > 0)
-    {
-        char *p = formatBuf;
-        char *end = formatBuf + sizeof(formatBuf);
+// Behavior if the transmit buffer is full (see `TxOverflowPolicy`)
+#if !defined(UART_TX_POLICY)
+#define UART_TX_POLICY TxDropNewest
+#endif
 
-        while (len > 0 && p + 4 <= end)
-        {
-            uint8_t byte = *data++;
-            *p++ = HEX_DIGITS[byte >> 4U];
-            *p++ = HEX_DIGITS[byte & 0xfU];
-            *p++ = ' ';
-            len--;
-        }
-
-        if (len == 0 && crlf)
-        {
-            p[-1] = '\r';
-            *p++ = '\n';
-        }
-
-        Write((const uint8_t *)formatBuf, p - formatBuf);
-    }
-}
-
-void UartImpl::Write(const uint8_t *data, size_t len)
-{
-    int bufTail = txBufTail;
-    int bufHead = txBufHead;
-    if (bufHead == bufTail && txQueueHead != txQueueTail)
-        return; // tx data buffer is full - discard data
-
-    size_t availChunkSize = bufHead < bufTail ? bufTail - bufHead : TX_BUF_LEN - bufHead;
-
-    // Copy data to transmit buffer
-    size_t size = len <= availChunkSize ? len : availChunkSize;
-    memcpy(txBuf + bufHead, data, size);
-    bufHead += size;
-    if (bufHead >= TX_BUF_LEN)
-        bufHead = 0;
-
-    // try to increase existing chunk
-    // if it's not being transmitted yet
-
-    if (!TryAppend(bufHead))
-    {
-        // create new chunk
-        int queueHead = txQueueHead;
-        txChunkBreak[queueHead] = bufHead;
-
-        queueHead++;
-        if (queueHead >= TX_QUEUE_LEN)
-            queueHead = 0;
-        if (queueHead == txQueueTail)
-        {
-            // chunk queue is full
-            ErrorHandler();
-            return;
-        }
-
-        txBufHead = bufHead;
-        txQueueHead = queueHead;
-    }
-
-    // start transmission
-    StartTransmit();
-
-    if (size < len)
-        Write(data + size, len - size);
-}
+#define TX_BUF_LEN 1024
+#define TX_QUEUE_LEN 16
+static TxRing<TX_BUF_LEN, TX_QUEUE_LEN, UartTransport, UART_TX_POLICY> txRing;
 
-bool UartImpl::TryAppend(int bufHead)
+bool UartImpl::Write(const uint8_t *data, size_t len, TxPriority priority)
 {
-    // Try to append to newest pending chunk,
-    // provided it's not yet being transmitted
-
-    InterruptGuard guard;
-    
-    int queueTail = txQueueTail;
-    int queueHead = txQueueHead;
-    if (queueTail == queueHead)
-        return false; // no pending chunk
-
-    queueTail++;
-    if (queueTail >= TX_QUEUE_LEN)
-        queueTail = 0;
-    if (queueTail == queueHead)
-        return false; // a single chunk (already being transmitted)
-
-    queueHead--;
-    if (queueHead < 0)
-        queueHead = TX_QUEUE_LEN - 1;
-
-    if (txChunkBreak[queueHead] == 0)
-        return false; // non-contiguous chunk
-
-    txBufHead = bufHead;
-    txChunkBreak[queueHead] = bufHead;
-
-    return true;
+    return txRing.Write(data, len, priority);
 }
 
-void UartImpl::StartTransmit()
+TxDropStatistics UartImpl::DropStatistics()
 {
-    InterruptGuard guard;
-
-    if (uart.gState != HAL_UART_STATE_READY || txQueueTail == txQueueHead)
-        return; // UART busy or queue empty
-
-    int startPos = txBufTail;
-    int endPos = txChunkBreak[txQueueTail];
-    if (endPos == 0)
-        endPos = TX_BUF_LEN;
-
-    HAL_UART_Transmit_DMA(&uart, txBuf + startPos, endPos - startPos);
+    return txRing.DropStatistics();
 }
 
 void UartImpl::TransmissionCompleted()
 {
-    {
-        InterruptGuard guard;
-
-        int queueTail = txQueueTail;
-        txBufTail = txChunkBreak[queueTail]; 
-        txQueueTail++;
-        if (txQueueTail >= TX_QUEUE_LEN)
-            txQueueTail = 0;
-    }
-
-    Uart.StartTransmit();
+    txRing.TransmissionCompleted();
 }
 
 extern "C" void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
@@ -235,8 +84,6 @@ void UartImpl::Init()
     // DMA UART IRQn interrupt configuration
     HAL_NVIC_SetPriority(DMA_UART_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(DMA_UART_IRQn);
-
-    txChunkBreak[txQueueHead] = txBufHead;
 }
 
 extern "C" void HAL_UART_MspInit(UART_HandleTypeDef *huart)
@@ -11,6 +11,7 @@
 #ifndef UART_H
 #define UART_H
 
+#include "tx_ring.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -19,16 +20,14 @@ class UartImpl
 {
 public:
     void Init();
-    void Write(const uint8_t *data, size_t len);
-    void Print(const char *str);
-    void Printf(const char *fmt, ...);
-    void PrintHex(const uint8_t *data, size_t len, _Bool crlf);
+    // Writes a message; returns false if it has been dropped as the transmit
+    // buffer is full (see UART_TX_POLICY)
+    bool Write(const uint8_t *data, size_t len, TxPriority priority = TxPriorityNormal);
 
-    static void TransmissionCompleted();
+    // Number of messages and bytes dropped so far
+    TxDropStatistics DropStatistics();
 
-private:
-    static void StartTransmit();
-    static bool TryAppend(int bufHead);
+    static void TransmissionCompleted();
 };
 
 extern UartImpl Uart;
@@ -10,6 +10,7 @@
 
 #include "common.h"
 #include "usb_serial.h"
+#include "tx_ring.h"
 #include "stm32f1xx.h"
 #include "stm32f1xx_hal.h"
 #include "stm32f1xx_ll_gpio.h"
@@ -17,8 +18,6 @@
 #include "usbd_core.h"
 #include "usbd_cdc.h"
 #include "usbd_desc.h"
-#include <cstdarg>
-#include <cstdio>
 #include <cstring>
 
 
@@ -31,39 +30,31 @@ USBSerialImpl USBSerial;
 extern PCD_HandleTypeDef hpcd_USB_FS;
 static USBD_HandleTypeDef hUsbDevice;
 
-static bool isTransmitting = false;
 
+// Transmission via USB CDC
+struct UsbTransport
+{
+    static bool IsReady() { return USBSerial.IsConnected() && USBSerial.IsTxIdle(); }
 
-// Buffer for data to be transmitted via USB Serial
-//  *  0 <= head < buf_len
-//  *  0 <= tail < buf_len
-//  *  head == tail => empty or full
-// Whether the buffer is empty or full needs to be derived
-// from the data chunk queue: the buffer is empty if the
-// chunk queue is empty.
-// `txBufHead` points to the positions where the next character
-// should be inserted. `txBufTail` points to the character after
-// the last character that has been transmitted.
-#define TX_BUF_LEN 1024
-static uint8_t txBuf[TX_BUF_LEN];
-static volatile int txBufHead = 0;
-static volatile int txBufTail = 0;
+    static void Transmit(const uint8_t *data, size_t len)
+    {
+        USBD_CDC_SetTxBuffer(&hUsbDevice, (uint8_t *)data, len);
+        uint8_t result = USBD_CDC_TransmitPacket(&hUsbDevice);
+        if (result != USBD_OK)
+            ErrorHandler();
+    }
 
-// Queue of USB Serial transmission data chunks:
-//  *  0 <= head < queue_len
-//  *  0 <= tail < queue_len
-//  *  head == tail => empty
-//  *  head + 1 == tail => full (modulo TX_QUEUE_LEN)
-// `txQueueHead` points to the position where the next item must be added.
-// `txQueueTail` points to the next item that needs to be processed
-// or is being processed.
-// With current item's index, `txChunkBreak` points to the end
-// of the data to be transmitted. The start can be retrieved with
-// index - 1 (modulo TX_QUEUE_LEN).
+    static uint32_t Millis() { return HAL_GetTick(); }
+};
+
+// Behavior if the transmit buffer is full (see `TxOverflowPolicy`)
+#if !defined(USB_TX_POLICY)
+#define USB_TX_POLICY TxDropOldest
+#endif
+
+#define TX_BUF_LEN 1024
 #define TX_QUEUE_LEN 16
-static volatile int txChunkBreak[TX_QUEUE_LEN];
-static volatile int txQueueHead = 0;
-static volatile int txQueueTail = 0;
+static TxRing<TX_BUF_LEN, TX_QUEUE_LEN, UsbTransport, USB_TX_POLICY> txRing;
 
 // Circular buffer for data received via USB Serial
 //  *  0 <= head < buf_len
@@ -81,184 +72,19 @@ static volatile int rxBufTail = 0;
 // Receive buffer for USB driver
 static uint8_t usbRxBuf[CDC_DATA_FS_OUT_PACKET_SIZE];
 
-static char formatBuf[128];
-
-static const char *HEX_DIGITS = "0123456789ABCDEF";
-
-void USBSerialImpl::Print(const char *str)
+bool USBSerialImpl::Write(const uint8_t *data, size_t len, TxPriority priority)
 {
-    Write((const uint8_t *)str, strlen(str));
+    return txRing.Write(data, len, priority);
 }
 
-void USBSerialImpl::Printf(const char *fmt, ...)
+TxDropStatistics USBSerialImpl::DropStatistics()
 {
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(formatBuf, sizeof(formatBuf), fmt, args);
-    va_end(args);
-    Print(formatBuf);
-}
-
-void USBSerialImpl::PrintHex(const uint8_t *data, size_t len, _Bool crlf)
-{
-    while (len > 0)
-    {
-        char *p = formatBuf;
-        char *end = formatBuf + sizeof(formatBuf);
-
-        while (len > 0 && p + 4 <= end)
-        {
-            uint8_t byte = *data++;
-            *p++ = HEX_DIGITS[byte >> 4U];
-            *p++ = HEX_DIGITS[byte & 0xfU];
-            *p++ = ' ';
-            len--;
-        }
-
-        if (len == 0 && crlf)
-        {
-            p[-1] = '\r';
-            *p++ = '\n';
-        }
-
-        Write((const uint8_t *)formatBuf, p - formatBuf);
-    }
-}
-
-void USBSerialImpl::Write(const uint8_t *data, size_t len)
-{
-    if (txBufHead == txBufTail && txQueueHead != txQueueTail) {
-        // tx data buffer is full; flush it
-        if (!FlushTxBuffer())
-            return; // no space available; discard remaining data
-    }
-
-    int bufTail = txBufTail;
-    int bufHead = txBufHead;
-    size_t availChunkSize = bufHead < bufTail ? bufTail - bufHead : TX_BUF_LEN - bufHead;
-
-    // Copy data to transmit buffer
-    size_t size = len <= availChunkSize ? len : availChunkSize;
-    memcpy(txBuf + bufHead, data, size);
-    bufHead += size;
-    if (bufHead >= TX_BUF_LEN)
-        bufHead = 0;
-
-    // try to increase existing chunk
-    // if it's not being transmitted yet
-
-    if (!TryAppend(bufHead))
-    {
-        // create new chunk
-        int queueHead = txQueueHead;
-        txChunkBreak[queueHead] = bufHead;
-
-        queueHead++;
-        if (queueHead >= TX_QUEUE_LEN)
-            queueHead = 0;
-        if (queueHead == txQueueTail)
-        {
-            // chunk queue is full - unlikely to happen
-            return;
-        }
-
-        txBufHead = bufHead;
-        txQueueHead = queueHead;
-    }
-
-    // start transmission
-    StartTransmit();
-
-    if (size < len)
-        Write(data + size, len - size);
-}
-
-bool USBSerialImpl::TryAppend(int bufHead)
-{
-    // Try to append to newest pending chunk,
-    // provided it's not yet being transmitted
-
-    InterruptGuard guard;
-    
-    int queueTail = txQueueTail;
-    int queueHead = txQueueHead;
-    if (queueTail == queueHead)
-        return false; // no pending chunk
-
-    queueTail++;
-    if (queueTail >= TX_QUEUE_LEN)
-        queueTail = 0;
-    if (queueTail == queueHead)
-        return false; // a single chunk (already being transmitted)
-
-    queueHead--;
-    if (queueHead < 0)
-        queueHead = TX_QUEUE_LEN - 1;
-
-    if (txChunkBreak[queueHead] == 0)
-        return false; // non-contiguous chunk
-
-    txBufHead = bufHead;
-    txChunkBreak[queueHead] = bufHead;
-
-    return true;
-}
-
-// Flush buffer.
-bool USBSerialImpl::FlushTxBuffer()
-{
-    InterruptGuard guard;
-
-    if (isTransmitting) {
-        // preserve the buffer being transmitted
-        txQueueHead = txQueueTail + 1;
-        if (txQueueHead >= TX_QUEUE_LEN)
-            txQueueHead = 0;
-        txBufHead = txChunkBreak[txQueueTail];
-        return txBufHead != txBufTail;
-
-    } else {
-        txQueueHead = txQueueTail = 0;
-        txBufHead = txBufTail = 0;
-        return true;
-    }
-}
-
-void USBSerialImpl::StartTransmit()
-{
-    InterruptGuard guard;
-
-    if (txQueueTail == txQueueHead
-            || !USBSerial.IsConnected()
-            || !USBSerial.IsTxIdle())
-        return; // Queue empty or USB not connected or USB TX busy
-
-    int startPos = txBufTail;
-    int endPos = txChunkBreak[txQueueTail];
-    if (endPos == 0)
-        endPos = TX_BUF_LEN;
-
-    USBD_CDC_SetTxBuffer(&hUsbDevice, txBuf + startPos, endPos - startPos);
-    uint8_t result = USBD_CDC_TransmitPacket(&hUsbDevice);
-    if (result != USBD_OK)
-        ErrorHandler();
-    isTransmitting = true;
+    return txRing.DropStatistics();
 }
 
 void USBSerialImpl::TransmissionCompleted()
 {
-    {
-        InterruptGuard guard;
-
-        txBufTail = txChunkBreak[txQueueTail]; 
-        txQueueTail++;
-        if (txQueueTail >= TX_QUEUE_LEN)
-            txQueueTail = 0;
-
-        isTransmitting = false;
-    }
-
-    USBSerial.StartTransmit();
+    txRing.TransmissionCompleted();
 }
 
 size_t USBSerialImpl::Available()
@@ -362,20 +188,24 @@ void USBSerialImpl::Reset()
 
 int8_t USBSerialImpl::CDCInit()
 {
-    USBD_CDC_SetTxBuffer(&hUsbDevice, txBuf, 0);
+    // a transfer started before a reset will not complete
+    txRing.TransmissionAborted();
+    USBD_CDC_SetTxBuffer(&hUsbDevice, nullptr, 0);
     USBD_CDC_SetRxBuffer(&hUsbDevice, usbRxBuf);
     return USBD_OK;
 }
 
 int8_t USBSerialImpl::CDCDeInit()
 {
+    // USB reset or disconnect: the transfer in progress will not complete
+    txRing.TransmissionAborted();
     return USBD_OK;
 }
 
 int8_t USBSerialImpl::CDCControl(uint8_t cmd, uint8_t* buf, uint16_t length)
 {
-    if (!isTransmitting && hUsbDevice.dev_state == USBD_STATE_CONFIGURED)
-        StartTransmit();
+    if (hUsbDevice.dev_state == USBD_STATE_CONFIGURED)
+        txRing.StartTransmit();
 
     return USBD_OK;
 }
@@ -11,6 +11,7 @@
 #ifndef USB_SERIAL_H
 #define USB_SERIAL_H
 
+#include "tx_ring.h"
 #include <cstdbool>
 #include <cstddef>
 #include <cstdint>
@@ -20,10 +21,12 @@ class USBSerialImpl
 {
 public:
     void Init();
-    void Write(const uint8_t *data, size_t len);
-    void Print(const char *str);
-    void Printf(const char *fmt, ...);
-    void PrintHex(const uint8_t *data, size_t len, _Bool crlf);
+    // Writes a message; returns false if it has been dropped as the transmit
+    // buffer is full (see USB_TX_POLICY)
+    bool Write(const uint8_t *data, size_t len, TxPriority priority = TxPriorityNormal);
+
+    // Number of messages and bytes dropped so far
+    TxDropStatistics DropStatistics();
 
     /// Number of available bytes in RX buffer
     size_t Available();
@@ -36,9 +39,6 @@ public:
 private:
     void Reset();
 
-    static bool FlushTxBuffer();
-    static bool TryAppend(int bufHead);
-    static void StartTransmit();
     static void TransmissionCompleted();
     static void InstallDataInSerial();
 
@@ -0,0 +1,64 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Binary output records
+ */
+
+#include "binary_record.h"
+
+
+size_t CobsEncode(const uint8_t *data, size_t len, uint8_t *framed)
+{
+    // Each block starts with a code byte: the offset to the next 0 byte
+    // (or 0xff for a block of 254 non-zero bytes without a 0 byte)
+    uint8_t *code = framed;
+    uint8_t *p = framed + 1;
+    uint8_t blockLen = 1;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (data[i] != 0)
+        {
+            *p++ = data[i];
+            blockLen++;
+        }
+
+        if (data[i] == 0 || blockLen == 0xff)
+        {
+            *code = blockLen;
+            code = p++;
+            blockLen = 1;
+        }
+    }
+
+    *code = blockLen;
+    *p++ = 0;
+    return p - framed;
+}
+
+int CobsDecode(const uint8_t *framed, size_t len, uint8_t *data)
+{
+    const uint8_t *p = framed;
+    const uint8_t *end = framed + len;
+    uint8_t *out = data;
+
+    while (p < end)
+    {
+        uint8_t blockLen = *p++;
+        if (blockLen == 0 || p + blockLen - 1 > end)
+            return -1;
+
+        for (int i = 1; i < blockLen; i++)
+            *out++ = *p++;
+
+        // a 0 byte follows unless the block is full or the end is reached
+        if (blockLen != 0xff && p < end)
+            *out++ = 0;
+    }
+
+    return out - data;
+}
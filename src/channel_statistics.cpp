@@ -0,0 +1,111 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Timing statistics per channel (carrier frequency)
+ */
+
+#include "main.h"
+#include "channel_statistics.h"
+#include <string.h>
+
+static_assert((NUM_CHANNEL_SLOTS & (NUM_CHANNEL_SLOTS - 1)) == 0, "NUM_CHANNEL_SLOTS must be a power of 2");
+static_assert(NUM_CHANNEL_SLOTS >= 2 && NUM_CHANNEL_SLOTS <= 256, "NUM_CHANNEL_SLOTS is out of range");
+
+// Number of bits of a slot index
+constexpr int IndexBits(uint32_t numSlots)
+{
+    return numSlots <= 1 ? 0 : 1 + IndexBits(numSlots >> 1);
+}
+
+// The slot index is taken from the top bits of the hash
+#define HASH_SHIFT (32 - IndexBits(NUM_CHANNEL_SLOTS))
+
+
+ChannelStatistics::ChannelStatistics()
+    : numChannels(0), numUntrackedEvents(0)
+{
+    memset(slots, 0, sizeof(slots));
+}
+
+ChannelCounters *ChannelStatistics::Find(uint32_t frequency)
+{
+    if (frequency == 0)
+        return nullptr;
+
+    // Channel frequencies are multiples of 100 kHz or so;
+    // multiplicative hashing spreads them over the table.
+    uint32_t index = (frequency * 2654435761U) >> HASH_SHIFT;
+    for (int i = 0; i < NUM_CHANNEL_SLOTS; i++)
+    {
+        ChannelCounters *counters = &slots[index];
+        if (counters->frequency == frequency)
+            return counters;
+
+        if (counters->frequency == 0)
+        {
+            counters->frequency = frequency;
+            order[numChannels++] = (uint8_t)index;
+            return counters;
+        }
+
+        index = (index + 1) & (NUM_CHANNEL_SLOTS - 1);
+    }
+
+    numUntrackedEvents++;
+    return nullptr;
+}
+
+void ChannelStatistics::CountUplink(uint32_t frequency)
+{
+    ChannelCounters *counters = Find(frequency);
+    if (counters != nullptr)
+        counters->numUplinks++;
+}
+
+void ChannelStatistics::CountDownlink(uint32_t frequency, bool isRx2, int32_t margin)
+{
+    ChannelCounters *counters = Find(frequency);
+    if (counters == nullptr)
+        return;
+
+    if (isRx2)
+        counters->numRx2Downlinks++;
+    else
+        counters->numRx1Downlinks++;
+    counters->marginSum += margin;
+    counters->numMargins++;
+}
+
+void ChannelStatistics::CountTimeout(uint32_t frequency, int32_t margin)
+{
+    ChannelCounters *counters = Find(frequency);
+    if (counters == nullptr)
+        return;
+
+    counters->numTimeouts++;
+    counters->marginSum += margin;
+    counters->numMargins++;
+}
+
+void ChannelStatistics::Print()
+{
+    for (int i = 0; i < numChannels; i++)
+    {
+        const ChannelCounters &counters = slots[order[i]];
+        uint32_t kHz = (counters.frequency + 500) / 1000;
+        SERIAL_PRINTF("Channel %lu.%03lu MHz: uplinks: %lu, RX1: %lu, RX2: %lu, timeouts: %lu",
+                (unsigned long)(kHz / 1000), (unsigned long)(kHz % 1000),
+                (unsigned long)counters.numUplinks, (unsigned long)counters.numRx1Downlinks,
+                (unsigned long)counters.numRx2Downlinks, (unsigned long)counters.numTimeouts);
+        if (counters.numMargins != 0)
+            SERIAL_PRINTF(", mean margin: %ldus", (long)(counters.marginSum / (int64_t)counters.numMargins));
+        Serial.Print("\r\n");
+    }
+
+    if (numUntrackedEvents != 0)
+        SERIAL_PRINTF("Channel table full - %lu events not counted\r\n", (unsigned long)numUntrackedEvents);
+}
@@ -0,0 +1,263 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Event queue and event processing (independent of hardware)
+ */
+
+#include "event_processor.h"
+#include "main.h"
+#include "spsc_ring.h"
+#include "timing_analyzer.h"
+
+// Decoder for the SPI protocol of the monitored radio
+#if defined(RADIO_SX126X)
+    #include "sx126x_analyzer.h"
+    typedef Sx126xAnalyzer RadioAnalyzer;
+#else
+    #include "spi_analyzer.h"
+    typedef SpiAnalyzer RadioAnalyzer;
+#endif
+
+// Event recorded by the interrupt handlers.
+// `spiPos` is the end of the SPI data at the time of the event,
+// i.e. the end of the most recent SPI transaction. It is the total
+// number of bytes received via SPI (wrapping at 2^32). For
+// event type `EventTypeSpiTrx`, the start of the SPI data
+// is the `spiPos` of the previous event.
+// An event of type `EventTypeGap` marks the position in the
+// stream where events have been dropped due to a queue overflow.
+// Its `numDropped` is the total number of events dropped at the
+// time the marker was queued (unused for all other event types).
+struct Event
+{
+    uint64_t time;
+    uint32_t spiPos;
+    uint32_t numDropped;
+    uint8_t type;
+};
+
+uint8_t SpiDataBuf[SPI_DATA_BUF_LEN];
+
+static SpscRing<Event, EVENT_QUEUE_LEN> eventQueue;
+
+// Number of events dropped due to a full queue (written by interrupt handlers)
+static volatile uint32_t numDroppedEvents = 0;
+// Maximum number of events ever pending in the queue (written by interrupt handlers)
+static volatile uint32_t eventQueueHighWater = 0;
+
+// End of the most recent SPI transaction (only accessed by interrupt handlers)
+static uint32_t isrSpiPos = 0;
+// Indicates that events have been dropped and a gap marker still
+// needs to be queued (only accessed by interrupt handlers)
+static bool isGapPending = false;
+
+// Start of the SPI data of the next transaction (only accessed by main loop)
+static uint32_t spiPos = 0;
+// Number of SPI transactions discarded because their data had already
+// been overwritten, or overwritten during analysis (only accessed by main loop)
+static uint32_t numSpiOverruns = 0;
+// Number of dropped events already reported (only accessed by main loop)
+static uint32_t numReportedDroppedEvents = 0;
+
+// Distribution of the number of events processed per batch:
+// 1, 2, 3-4, 5-8, 9-16, more than 16
+#define NUM_BATCH_SIZE_BUCKETS 6
+static uint32_t batchSizeCounts[NUM_BATCH_SIZE_BUCKETS];
+
+static void ProcessEvent(const Event &event);
+static void OnSpiTrx(uint64_t time, uint32_t startPos, uint32_t endPos);
+static bool IsSpiDataOverwritten(uint32_t startPos);
+static void OnEventGap(uint32_t numDropped);
+static void CountBatch(int batchSize);
+
+static TimingAnalyzer timingAnalyzer;
+static RadioAnalyzer radioAnalyzer(SpiDataBuf, SPI_DATA_BUF_LEN, timingAnalyzer, IsSpiDataOverwritten);
+
+
+int ProcessEvents()
+{
+    // Process all pending events and output the result in a single write
+    int batchSize = 0;
+    while (ProcessNextEvent())
+        batchSize++;
+
+    CompleteBatch(batchSize);
+    return batchSize;
+}
+
+bool ProcessNextEvent()
+{
+    Event event;
+    if (!eventQueue.Pop(event))
+        return false;
+
+    ProcessEvent(event);
+    spiPos = event.spiPos;
+    return true;
+}
+
+void CompleteBatch(int batchSize)
+{
+    if (batchSize == 0)
+        return;
+
+    CountBatch(batchSize);
+    Output.Flush();
+}
+
+static void ProcessEvent(const Event &event)
+{
+    switch (event.type)
+    {
+    case EventTypeSpiTrx:
+        OnSpiTrx(event.time, spiPos, event.spiPos);
+        break;
+
+    case EventTypeDone:
+        radioAnalyzer.OnDio0(event.time);
+        break;
+
+    case EventTypeTimeout:
+        radioAnalyzer.OnDio1(event.time);
+        break;
+
+    case EventTypeGap:
+        OnEventGap(event.numDropped);
+        break;
+    }
+}
+
+static void OnSpiTrx(uint64_t time, uint32_t startPos, uint32_t endPos)
+{
+    uint32_t len = endPos - startPos;
+    if (len == 0)
+        return;
+
+    // Check that the DMA hasn't overwritten the data yet
+    if (IsSpiDataOverwritten(startPos))
+    {
+        numSpiOverruns++;
+        SERIAL_PRINTF("SPI buffer overrun - transaction of %lu bytes discarded\r\n", (unsigned long)len);
+        return;
+    }
+
+    const uint8_t *startTrx = SpiDataBuf + (startPos & (SPI_DATA_BUF_LEN - 1));
+    const uint8_t *endTrx = SpiDataBuf + (endPos & (SPI_DATA_BUF_LEN - 1));
+
+#if SPI_DEBUG == 1
+    if (endTrx > startTrx)
+    {
+        Serial.PrintHex(startTrx, endTrx - startTrx, true);
+    }
+    else
+    {
+        Serial.PrintHex(startTrx, SpiDataBuf + SPI_DATA_BUF_LEN - startTrx, false);
+        Serial.PrintHex(SpiDataBuf, endTrx - SpiDataBuf, true);
+    }
+#endif
+
+    radioAnalyzer.OnTrx(time, startTrx, endTrx, startPos);
+
+    // The data is decoded in place. If the DMA has overwritten it
+    // in the meantime, the decoded values might be corrupted.
+    // The analysis cannot be undone; it is reported instead.
+    if (IsSpiDataOverwritten(startPos))
+    {
+        numSpiOverruns++;
+        SERIAL_PRINTF("SPI buffer overrun during analysis - transaction of %lu bytes might be corrupted\r\n",
+                (unsigned long)len);
+    }
+}
+
+// Checks if the DMA has started to overwrite the SPI data starting at `startPos`
+// (a transaction filling the entire buffer is treated as overwritten
+// as well as start and end would be identical)
+static bool IsSpiDataOverwritten(uint32_t startPos)
+{
+    uint32_t writePos;
+    {
+        InterruptGuard guard;
+        writePos = SpiWritePosition();
+    }
+
+    return writePos - startPos >= SPI_DATA_BUF_LEN;
+}
+
+static void OnEventGap(uint32_t numDropped)
+{
+    // Events are missing: report it and restart analysis with the next TX cycle.
+    // `numDroppedEvents` cannot be used as further events might have been
+    // dropped since the marker was queued; they belong to the next gap.
+    SERIAL_PRINTF("Event queue overflow - %lu events dropped\r\n",
+            (unsigned long)(numDropped - numReportedDroppedEvents));
+    numReportedDroppedEvents = numDropped;
+
+    timingAnalyzer.ResetStage();
+}
+
+static void CountBatch(int batchSize)
+{
+    int bucket = 0;
+    while (bucket < NUM_BATCH_SIZE_BUCKETS - 1 && batchSize > (1 << bucket))
+        bucket++;
+    batchSizeCounts[bucket]++;
+}
+
+void PrintStatistics()
+{
+    SERIAL_PRINTF("Batch sizes: 1: %lu, 2: %lu, 3-4: %lu, 5-8: %lu, 9-16: %lu, >16: %lu\r\n",
+            (unsigned long)batchSizeCounts[0], (unsigned long)batchSizeCounts[1],
+            (unsigned long)batchSizeCounts[2], (unsigned long)batchSizeCounts[3],
+            (unsigned long)batchSizeCounts[4], (unsigned long)batchSizeCounts[5]);
+    SERIAL_PRINTF("Events dropped: %lu, queue high-water mark: %lu of %d\r\n",
+            (unsigned long)numDroppedEvents, (unsigned long)eventQueueHighWater, EVENT_QUEUE_LEN);
+    SERIAL_PRINTF("SPI buffer overruns: %lu\r\n", (unsigned long)numSpiOverruns);
+    timingAnalyzer.PrintChannelStatistics();
+}
+
+// Records an event that could not be queued
+static void DropEvent(uint32_t spiPos)
+{
+    isrSpiPos = spiPos;
+    numDroppedEvents++;
+}
+
+void QueueEvent(EventType eventType, uint64_t time, uint32_t spiPos)
+{
+    // Only SPI transactions advance the SPI position
+    if (eventType != EventTypeSpiTrx)
+        spiPos = isrSpiPos;
+
+    if (isGapPending)
+    {
+        // The gap marker carries the end of the last dropped SPI transaction
+        // so analysis continues with the correct SPI data, and the number
+        // of dropped events so far so the gap is reported with its own count.
+        Event gap = { time, isrSpiPos, numDroppedEvents, EventTypeGap };
+        if (!eventQueue.Push(gap))
+        {
+            DropEvent(spiPos);
+            return;
+        }
+
+        isGapPending = false;
+    }
+
+    isrSpiPos = spiPos;
+
+    Event event = { time, spiPos, 0, (uint8_t)eventType };
+    if (!eventQueue.Push(event))
+    {
+        DropEvent(spiPos);
+        isGapPending = true;
+        return;
+    }
+
+    uint32_t size = eventQueue.Size();
+    if (size > eventQueueHighWater)
+        eventQueueHighWater = size;
+}
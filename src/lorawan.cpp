@@ -0,0 +1,123 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * LoRaWAN MAC frame decoder
+ */
+
+#include "main.h"
+#include "lorawan.h"
+
+#define UNKNOWN_CID_LEN 0xff
+
+static const char *const MTYPE_NAMES[8] = {
+    "Join request",
+    "Join accept",
+    "Unconfirmed data up",
+    "Unconfirmed data down",
+    "Confirmed data up",
+    "Confirmed data down",
+    "Rejoin request",
+    "Proprietary"
+};
+
+// MAC command: name and payload length (uplink and downlink)
+struct MacCommand
+{
+    const char *name;
+    uint8_t uplinkLen;
+    uint8_t downlinkLen;
+};
+
+// MAC commands by CID (starting at 0x02)
+static const MacCommand MAC_COMMANDS[] = {
+    { "LinkCheck", 0, 2 },
+    { "LinkADR", 1, 4 },
+    { "DutyCycle", 0, 1 },
+    { "RXParamSetup", 1, 4 },
+    { "DevStatus", 2, 0 },
+    { "NewChannel", 1, 5 },
+    { "RXTimingSetup", 0, 1 },
+    { "TxParamSetup", 0, 1 },
+    { "DlChannel", 1, 4 },
+    { "Rekey", UNKNOWN_CID_LEN, UNKNOWN_CID_LEN },
+    { "ADRParamSetup", UNKNOWN_CID_LEN, UNKNOWN_CID_LEN },
+    { "DeviceTime", 0, 5 }
+};
+
+#define FIRST_CID 0x02
+#define NUM_MAC_COMMANDS (sizeof(MAC_COMMANDS) / sizeof(MAC_COMMANDS[0]))
+
+static const MacCommand *FindMacCommand(uint8_t cid)
+{
+    if (cid < FIRST_CID || cid >= FIRST_CID + NUM_MAC_COMMANDS)
+        return nullptr;
+    return &MAC_COMMANDS[cid - FIRST_CID];
+}
+
+
+bool LoraWanFrame::HasMacCommand(uint8_t cid) const
+{
+    if (!IsDataFrame())
+        return false;
+
+    size_t i = 0;
+    while (i < fOptsLen)
+    {
+        if (fOpts[i] == cid)
+            return true;
+
+        const MacCommand *cmd = FindMacCommand(fOpts[i]);
+        if (cmd == nullptr)
+            return false;
+        uint8_t len = IsUplink() ? cmd->uplinkLen : cmd->downlinkLen;
+        if (len == UNKNOWN_CID_LEN)
+            return false;
+        i += 1 + len;
+    }
+
+    return false;
+}
+
+void PrintLoraWanFrame(const LoraWanFrame &frame)
+{
+    SERIAL_PRINTF("          %s", MTYPE_NAMES[frame.mType]);
+    if (!frame.IsDataFrame())
+    {
+        Serial.Print("\r\n");
+        return;
+    }
+
+    SERIAL_PRINTF(", DevAddr = %08lx, FCnt = %u", (unsigned long)frame.devAddr, (unsigned)frame.fCnt);
+    if (frame.fPort >= 0)
+        SERIAL_PRINTF(", FPort = %d", frame.fPort);
+
+    // MAC commands in FOpts (requests in downlinks, answers in uplinks)
+    const char *suffix = frame.IsUplink() ? "Ans" : "Req";
+    size_t i = 0;
+    while (i < frame.fOptsLen)
+    {
+        uint8_t cid = frame.fOpts[i];
+        const MacCommand *cmd = FindMacCommand(cid);
+        uint8_t len = UNKNOWN_CID_LEN;
+        if (cmd != nullptr)
+            len = frame.IsUplink() ? cmd->uplinkLen : cmd->downlinkLen;
+
+        Serial.Print(i == 0 ? ", MAC: " : " ");
+        if (len == UNKNOWN_CID_LEN)
+        {
+            SERIAL_PRINTF("%02x ...", cid);
+            break;
+        }
+
+        // LinkCheck and DeviceTime are requested by the device
+        bool isDeviceRequest = cid == 0x02 || cid == 0x0d;
+        SERIAL_PRINTF("%s%s", cmd->name, isDeviceRequest ? (frame.IsUplink() ? "Req" : "Ans") : suffix);
+        i += 1 + len;
+    }
+
+    Serial.Print("\r\n");
+}
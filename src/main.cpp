@@ -5,47 +5,22 @@
  * Licensed under MIT License
  * https://opensource.org/licenses/MIT
  * 
- * Main code (SPI data decoding, output, most initialization)
+ * Main code (main loop, event capturing)
  */
 #include "main.h"
+#include "edge_capture.h"
+#include "event_processor.h"
 #include "setup.h"
-#include "spi_analyzer.h"
 #include "timing.h"
-#include "timing_analyzer.h"
-#include <cstring>
 
-enum EventType
-{
-    EventTypeSpiTrx,
-    EventTypeDone,
-    EventTypeTimeout
-};
-
-// Buffer for payload data of SPI transaction.
-// The buffer is used as a circular buffer.
-#define SPI_DATA_BUF_LEN 128
-static uint8_t spiDataBuf[128];
-
-// Queue of SPI transactions:
-//  *  0 <= head < queue_len
-//  *  0 <= tail < queue_len
-//  *  head == tail => empty
-//  *  head + 1 == tail => full (modulo EVENT_QUEUE_LEN)
-// `head` points to the position where the next item must be added.
-// `tail` points to the next item that needs to be processed.
-// For event type `EventTypeSpiTrx`, the item's index can be used
-// to retrieve the end of the SPI data. The start of the SPI data
-// is at index - 1 (modulo EVENT_QUEUE_LEN).
-#define EVENT_QUEUE_LEN 16
-static volatile EventType eventTypes[EVENT_QUEUE_LEN];
-static volatile uint32_t eventTime[EVENT_QUEUE_LEN];
-static volatile int spiTrxDataEnd[EVENT_QUEUE_LEN];
-static volatile int eventQueueHead = 0;
-static volatile int eventQueueTail = 0;
-static volatile uint8_t eventQueueOverflow = 0;
-
-static TimingAnalyzer timingAnalyzer;
-static SpiAnalyzer spiAnalyzer(spiDataBuf, SPI_DATA_BUF_LEN, timingAnalyzer);
+// Number of half buffers filled by the DMA so far (incremented
+// by the half and full transfer callbacks)
+static volatile uint32_t spiDmaHalfLaps = 0;
+
+// Interval for printing statistics (in ms, 0 to disable)
+#if !defined(STATS_INTERVAL)
+#define STATS_INTERVAL 60000
+#endif
 
 
 int main()
@@ -53,103 +28,125 @@ int main()
     setup();
 
     Serial.Print("SX127x Probe\r\n");
+    Output.Flush();
 
     // Receive SPI data into a circuar buffer indefinitely
-    HAL_SPI_Receive_DMA(&hspi, spiDataBuf, SPI_DATA_BUF_LEN);
+    HAL_SPI_Receive_DMA(&hspi, SpiDataBuf, SPI_DATA_BUF_LEN);
+
+#if STATS_INTERVAL > 0
+    uint32_t lastStatsTime = HAL_GetTick();
+#endif
 
     while (true)
     {
-        if (eventQueueOverflow != 0)
-        {
-            Serial.Print("Event queue overflow - stopping\r\n");
-            ErrorHandler();
-        }
+        ProcessEvents();
 
-        if (eventQueueHead != eventQueueTail)
+#if STATS_INTERVAL > 0
+        uint32_t now = HAL_GetTick();
+        if (now - lastStatsTime >= STATS_INTERVAL)
         {
-            int tail = eventQueueTail;
-            EventType eventType = eventTypes[tail];
-            uint32_t time = eventTime[tail];
-            int prev;
-
-            switch (eventType)
-            {
-            case EventTypeSpiTrx:
-                prev = tail - 1;
-                if (prev < 0)
-                    prev = EVENT_QUEUE_LEN - 1;
-                spiAnalyzer.OnTrx(time, spiDataBuf + spiTrxDataEnd[prev], spiDataBuf + spiTrxDataEnd[tail]);
-                break;
-            case EventTypeDone:
-                timingAnalyzer.OnDoneInterrupt(time);
-                break;
-
-            case EventTypeTimeout:
-                timingAnalyzer.OnTimeoutInterrupt(time);
-                break;
-            }
-
-            tail++;
-            if (tail >= EVENT_QUEUE_LEN)
-                tail = 0;
-            eventQueueTail = tail;
+            lastStatsTime = now;
+            PrintStatistics();
+            Output.Flush();
         }
+#endif
     }
 }
 
-void QueueEvent(EventType eventType, int spiPos)
+// Returns the total number of bytes written by the SPI DMA so far.
+// Must be called from an interrupt handler or with interrupts disabled.
+uint32_t SpiWritePosition()
 {
-    uint32_t us = GetMicrosFromISR();
-    int head = eventQueueHead;
-    if (spiPos == -1)
-    {
-        int prev = head - 1;
-        if (prev < 0)
-            prev = EVENT_QUEUE_LEN - 1;
-        spiPos = spiTrxDataEnd[prev];
-    }
-
-    eventTypes[head] = eventType;
-    eventTime[head] = us;
-    spiTrxDataEnd[head] = spiPos;
+    uint32_t pos = SPI_DATA_BUF_LEN - __HAL_DMA_GET_COUNTER(&hdma_spi_rx);
+    if (pos == SPI_DATA_BUF_LEN)
+        pos = 0;
 
-    head++;
-    if (head >= EVENT_QUEUE_LEN)
-        head = 0;
-    if (head == eventQueueTail)
-    {
-        // queue overflow
-        eventQueueOverflow = 1;
-        return;
-    }
+    // If the DMA has crossed the middle or the end of the buffer but
+    // the callback hasn't run yet, the half lap count is one behind.
+    uint32_t halfLaps = spiDmaHalfLaps;
+    uint32_t half = pos >= SPI_DATA_BUF_LEN / 2 ? 1 : 0;
+    if ((halfLaps & 1) != half)
+        halfLaps++;
 
-    eventQueueHead = head;
+    return (halfLaps >> 1) * SPI_DATA_BUF_LEN + pos;
 }
 
 // Called when an SPI transaction has completed (NSS returns to HIGH)
 void SpiTrxCompleted()
 {
-    int pos = SPI_DATA_BUF_LEN - __HAL_DMA_GET_COUNTER(&hdma_spi_rx);
-    if (pos == SPI_DATA_BUF_LEN)
-        pos = 0;
+    uint64_t time = GetMicrosFromISR();
+    QueueEvent(EventTypeSpiTrx, time, SpiWritePosition());
+}
 
-    QueueEvent(EventTypeSpiTrx, pos);
+// Called when the DMA has filled the first half of the SPI buffer
+extern "C" void HAL_SPI_RxHalfCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    spiDmaHalfLaps++;
+}
+
+// Called when the DMA has filled the second half of the SPI buffer
+extern "C" void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    spiDmaHalfLaps++;
 }
 
 // Called when the DIO0 signal goes high
 extern "C" void EXTI_DIO0_IRQHandler()
 {
-    QueueEvent(EventTypeDone, -1);
+    QueueEvent(EventTypeDone, GetMicrosFromISR());
     HAL_GPIO_EXTI_IRQHandler(DIO0_PIN);
 }
 
 // Called when the DIO1 signal goes high
 extern "C" void EXTI_DIO1_IRQHandler()
 {
-    QueueEvent(EventTypeTimeout, -1);
+    QueueEvent(EventTypeTimeout, GetMicrosFromISR());
     HAL_GPIO_EXTI_IRQHandler(DIO1_PIN);
 }
 
+#if CAPTURE_MODE == 1
+
+static EdgeCapture edgeCapture;
+
+// Called when the capture timer has latched an edge or has overflowed
+extern "C" void CAPTURE_IRQHandler()
+{
+    TIM_TypeDef *tim = CAPTURE_TIM_INSTANCE;
+    uint32_t sr = tim->SR;
+
+    // Reading the capture register clears the capture flag
+    EdgeCapture::Edge edges[3];
+    size_t numEdges = 0;
+    if ((sr & TIM_SR_CC1IF) != 0)
+        edges[numEdges++] = { EventTypeDone, (uint16_t)tim->CCR1 };
+    if ((sr & TIM_SR_CC2IF) != 0)
+        edges[numEdges++] = { EventTypeTimeout, (uint16_t)tim->CCR2 };
+    if ((sr & TIM_SR_CC3IF) != 0)
+        edges[numEdges++] = { EventTypeSpiTrx, (uint16_t)tim->CCR3 };
+
+    // An edge captured twice before being processed cannot be recovered
+    tim->SR = ~(TIM_SR_CC1OF | TIM_SR_CC2OF | TIM_SR_CC3OF);
+
+    bool overflowPending = (sr & TIM_SR_UIF) != 0;
+    EdgeCapture::TimedEdge timedEdges[3];
+    edgeCapture.Merge(edges, numEdges, overflowPending, timedEdges);
+    if (overflowPending)
+    {
+        tim->SR = ~TIM_SR_UIF;
+        edgeCapture.OnOverflow();
+    }
+
+    for (size_t i = 0; i < numEdges; i++)
+    {
+        EventType eventType = (EventType)timedEdges[i].channel;
+        uint64_t time = EdgeCapture::TicksToMicros(timedEdges[i].ticks);
+        uint32_t spiPos = eventType == EventTypeSpiTrx ? SpiWritePosition() : 0;
+        QueueEvent(eventType, time, spiPos);
+    }
+}
+
+#endif
+
 void Error_Handler()
 {
     while (true)
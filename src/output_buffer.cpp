@@ -0,0 +1,191 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Staging buffer for analysis output
+ */
+
+#include "main.h"
+#include "output_buffer.h"
+#include <cstring>
+
+#define OUTPUT_BUF_LEN 512
+static uint8_t outputBuf[OUTPUT_BUF_LEN];
+
+static const char *HEX_DIGITS = "0123456789ABCDEF";
+
+OutputBuffer Output;
+
+void OutputBuffer::Write(const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        if (this->len == OUTPUT_BUF_LEN)
+            Flush();
+
+        size_t size = OUTPUT_BUF_LEN - this->len;
+        if (size > len)
+            size = len;
+        memcpy(outputBuf + this->len, data, size);
+        this->len += size;
+        data += size;
+        len -= size;
+    }
+}
+
+void OutputBuffer::PrintHex(const uint8_t *data, size_t len, _Bool crlf)
+{
+    // stage the hex dump separately so it cannot displace analysis output
+    Flush();
+    priority = TxPriorityLow;
+    WriteHex(data, len, crlf);
+    Flush();
+    priority = TxPriorityNormal;
+}
+
+#if BINARY_OUTPUT
+
+void OutputBuffer::Print(const char *str)
+{
+    WriteText(str, strlen(str));
+}
+
+void OutputBuffer::WriteHex(const uint8_t *data, size_t len, _Bool crlf)
+{
+    char text[MAX_RECORD_LEN - 1];
+    while (len > 0)
+    {
+        size_t n = 0;
+        while (len > 0 && n + 3 <= sizeof(text) - 1)
+        {
+            uint8_t byte = *data++;
+            text[n++] = HEX_DIGITS[byte >> 4U];
+            text[n++] = HEX_DIGITS[byte & 0xfU];
+            text[n++] = ' ';
+            len--;
+        }
+
+        if (len == 0 && crlf)
+        {
+            text[n - 1] = '\r';
+            text[n++] = '\n';
+        }
+
+        WriteText(text, n);
+    }
+}
+
+// Writes the text as one or more text records
+void OutputBuffer::WriteText(const char *text, size_t len)
+{
+    while (len > 0)
+    {
+        size_t n = len < MAX_RECORD_LEN - 1 ? len : MAX_RECORD_LEN - 1;
+        uint8_t record[MAX_RECORD_LEN];
+        record[0] = RecordText;
+        memcpy(record + 1, text, n);
+        WriteRecord(record, n + 1);
+        text += n;
+        len -= n;
+    }
+}
+
+#else
+
+void OutputBuffer::Print(const char *str)
+{
+    Write((const uint8_t *)str, strlen(str));
+}
+
+void OutputBuffer::WriteFormatted(void *context, const char *data, size_t len)
+{
+    ((OutputBuffer *)context)->Write((const uint8_t *)data, len);
+}
+
+void OutputBuffer::WriteHex(const uint8_t *data, size_t len, _Bool crlf)
+{
+    while (len > 0)
+    {
+        if (OUTPUT_BUF_LEN - this->len < 4)
+            Flush();
+
+        uint8_t *p = outputBuf + this->len;
+        uint8_t *end = outputBuf + OUTPUT_BUF_LEN;
+
+        while (len > 0 && p + 4 <= end)
+        {
+            uint8_t byte = *data++;
+            *p++ = HEX_DIGITS[byte >> 4U];
+            *p++ = HEX_DIGITS[byte & 0xfU];
+            *p++ = ' ';
+            len--;
+        }
+
+        if (len == 0 && crlf)
+        {
+            p[-1] = '\r';
+            *p++ = '\n';
+        }
+
+        this->len = p - outputBuf;
+    }
+}
+
+#endif
+
+void OutputBuffer::WriteRecord(const uint8_t *record, size_t len)
+{
+    if (OUTPUT_BUF_LEN - this->len < MAX_FRAMED_RECORD_LEN)
+        Flush();
+
+    this->len += CobsEncode(record, len, outputBuf + this->len);
+}
+
+void OutputBuffer::Flush()
+{
+    if (len == 0)
+        return;
+
+    ReportDroppedOutput();
+    SerialSink.Write(outputBuf, len, priority);
+    len = 0;
+}
+
+// Writes a loss marker if the serial sink has dropped output since the last
+// marker. If the marker is dropped as well, the loss is reported again
+// with the next chunk (without counting the marker itself).
+void OutputBuffer::ReportDroppedOutput()
+{
+    TxDropStatistics dropped = SerialSink.DropStatistics();
+    uint32_t numMessages = dropped.numDroppedMessages - numReportedMessages;
+    if (numMessages == 0)
+        return;
+    uint32_t numBytes = dropped.numDroppedBytes - numReportedBytes;
+
+#if BINARY_OUTPUT
+    RecordWriter record(RecordOutputDropped);
+    record.PutVarint(numMessages);
+    record.PutVarint(numBytes);
+    uint8_t marker[MAX_FRAMED_RECORD_LEN];
+    size_t markerLen = CobsEncode(record.Data(), record.Length(), marker);
+#else
+    char text[64];
+    size_t markerLen = FormatToBuffer(text, sizeof(text), OUTPUT_DROPPED_FORMAT,
+            (unsigned long)numMessages, (unsigned long)numBytes);
+    const uint8_t *marker = (const uint8_t *)text;
+#endif
+
+    if (SerialSink.Write(marker, markerLen))
+    {
+        numReportedMessages = dropped.numDroppedMessages;
+        numReportedBytes = dropped.numDroppedBytes;
+    }
+    else
+    {
+        numReportedMessages++;
+        numReportedBytes += markerLen;
+    }
+}
@@ -0,0 +1,148 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Output of analysis results as binary records
+ */
+
+#include "main.h"
+#include "sample_output.h"
+#include <string.h>
+
+
+void BinarySampleOutput::SampleStart(int sampleNo, int32_t fCnt)
+{
+    RecordWriter record(RecordSampleStart);
+    record.PutVarint(sampleNo);
+    record.PutVarint(fCnt + 1);
+    Write(record);
+}
+
+void BinarySampleOutput::TxDone(int32_t txStartTime, const ModulationInfo &modulation, int payloadLength,
+        int32_t airTime, int32_t rampupTime)
+{
+    RecordWriter record(RecordTxDone);
+    record.PutSignedVarint(txStartTime);
+    PutModulation(record, modulation);
+    record.PutVarint(payloadLength);
+    record.PutVarint(airTime);
+    record.PutSignedVarint(rampupTime);
+    Write(record);
+
+    // TX done is the reference for the timestamps of the sample
+    lastTime = 0;
+}
+
+void BinarySampleOutput::PayloadLengthMismatch(int configuredLength, int fifoLength)
+{
+    RecordWriter record(RecordPayloadLengthMismatch);
+    record.PutVarint(configuredLength);
+    record.PutVarint(fifoLength);
+    Write(record);
+}
+
+void BinarySampleOutput::Frame(const LoraWanFrame &frame)
+{
+    RecordWriter record(RecordLoraWanFrame);
+    record.PutByte((uint8_t)(frame.mType << 5));
+    if (frame.IsDataFrame())
+    {
+        for (int i = 0; i < 4; i++)
+            record.PutByte((uint8_t)(frame.devAddr >> (8 * i)));
+        record.PutByte(frame.fCtrl);
+        record.PutVarint(frame.fCnt);
+        record.PutVarint(frame.fPort + 1);
+        for (int i = 0; i < frame.fOptsLen; i++)
+            record.PutByte(frame.fOpts[i]);
+    }
+    Write(record);
+}
+
+void BinarySampleOutput::RxStart(int window, int32_t time)
+{
+    RecordWriter record(RecordRxStart);
+    record.PutByte((uint8_t)window);
+    PutTimestamp(record, time);
+    Write(record);
+}
+
+void BinarySampleOutput::RxDone(int window, int32_t time)
+{
+    RecordWriter record(RecordRxDone);
+    record.PutByte((uint8_t)window);
+    PutTimestamp(record, time);
+    Write(record);
+}
+
+void BinarySampleOutput::RxTimeout(int window, int32_t time)
+{
+    RecordWriter record(RecordRxTimeout);
+    record.PutByte((uint8_t)window);
+    PutTimestamp(record, time);
+    Write(record);
+}
+
+void BinarySampleOutput::RxAnalysis(const ModulationInfo &modulation, int payloadLength, int32_t airTime,
+        int32_t, int32_t marginStart)
+{
+    // The end of the window is the timestamp of the preceding RX done record
+    RecordWriter record(RecordRxAnalysis);
+    PutModulation(record, modulation);
+    record.PutVarint(payloadLength);
+    record.PutVarint(airTime);
+    record.PutSignedVarint(marginStart);
+    Write(record);
+}
+
+void BinarySampleOutput::TimeoutAnalysis(const ModulationInfo &modulation, int32_t timeoutLength, int32_t rampupTime,
+        int32_t marginStart, int32_t marginEnd, int32_t correction)
+{
+    RecordWriter record(RecordTimeoutAnalysis);
+    PutModulation(record, modulation);
+    record.PutVarint(timeoutLength);
+    record.PutSignedVarint(rampupTime);
+    record.PutSignedVarint(marginStart);
+    record.PutSignedVarint(marginEnd);
+    record.PutSignedVarint(correction);
+    Write(record);
+}
+
+void BinarySampleOutput::OutOfSync(const char *stage)
+{
+    RecordWriter record(RecordOutOfSync);
+    size_t len = strlen(stage);
+    for (size_t i = 0; i < len; i++)
+        record.PutByte((uint8_t)stage[i]);
+    Write(record);
+}
+
+void BinarySampleOutput::PutTimestamp(RecordWriter &record, int32_t time)
+{
+    record.PutSignedVarint(time - lastTime);
+    lastTime = time;
+}
+
+void BinarySampleOutput::PutModulation(RecordWriter &record, const ModulationInfo &modulation)
+{
+    if (modulation.longRangeMode == LongrangeModeLora)
+    {
+        record.PutByte(1);
+        record.PutByte(modulation.spreadingFactor);
+        record.PutByte(modulation.bandwidthIndex);
+    }
+    else
+    {
+        record.PutByte(0);
+        record.PutVarint(modulation.fskBitRate);
+        record.PutVarint(modulation.fskFrequencyDeviation);
+    }
+    record.PutVarint((modulation.frequency + 500) / 1000);
+}
+
+void BinarySampleOutput::Write(const RecordWriter &record)
+{
+    Serial.WriteRecord(record.Data(), record.Length());
+}
@@ -0,0 +1,116 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Output of analysis results as text
+ */
+
+#include "main.h"
+#include "sample_output.h"
+#include "timing_analyzer.h"
+
+#define TIMESTAMP_PATTERN "%8ld: "
+
+
+void TextSampleOutput::SampleStart(int sampleNo, int32_t fCnt)
+{
+    if (fCnt >= 0)
+        SERIAL_PRINTF("--------  Sample %d (FCnt %u)  --------\r\n", sampleNo, (unsigned)fCnt);
+    else
+        SERIAL_PRINTF("--------  Sample %d  --------\r\n", sampleNo);
+}
+
+void TextSampleOutput::TxDone(int32_t txStartTime, const ModulationInfo &modulation, int payloadLength,
+        int32_t airTime, int32_t rampupTime)
+{
+    PrintRelativeTimestamp(txStartTime);
+    Serial.Print("TX start\r\n");
+    PrintRelativeTimestamp(0);
+    Serial.Print("TX done\r\n");
+
+    PrintModulation(modulation);
+    SERIAL_PRINTF(", payload = %d bytes, airtime = %ldus, ramp-up = %ldus\r\n",
+            payloadLength, (long)airTime, (long)rampupTime);
+}
+
+void TextSampleOutput::PayloadLengthMismatch(int configuredLength, int fifoLength)
+{
+    SERIAL_PRINTF("          Payload length mismatch: register = %d bytes, FIFO = %d bytes\r\n",
+            configuredLength, fifoLength);
+}
+
+void TextSampleOutput::Frame(const LoraWanFrame &frame)
+{
+    PrintLoraWanFrame(frame);
+}
+
+void TextSampleOutput::RxStart(int window, int32_t time)
+{
+    PrintRelativeTimestamp(time);
+    SERIAL_PRINTF("RX%d start\r\n", window);
+}
+
+void TextSampleOutput::RxDone(int window, int32_t time)
+{
+    PrintRelativeTimestamp(time);
+    SERIAL_PRINTF("RX%d: downlink packet received\r\n", window);
+}
+
+void TextSampleOutput::RxTimeout(int window, int32_t time)
+{
+    PrintRelativeTimestamp(time);
+    SERIAL_PRINTF("RX%d timeout\r\n", window);
+}
+
+void TextSampleOutput::RxAnalysis(const ModulationInfo &modulation, int payloadLength, int32_t airTime,
+        int32_t windowEndTime, int32_t marginStart)
+{
+    PrintModulation(modulation);
+    SERIAL_PRINTF(", payload = %d bytes, airtime = %ldus\r\n", payloadLength, (long)airTime);
+    SERIAL_PRINTF("          Start of preamble (calculated): %ld\r\n", (long)(windowEndTime - airTime));
+    SERIAL_PRINTF("          Margin: start = %ldus\r\n", (long)marginStart);
+}
+
+void TextSampleOutput::TimeoutAnalysis(const ModulationInfo &modulation, int32_t timeoutLength, int32_t rampupTime,
+        int32_t marginStart, int32_t marginEnd, int32_t correction)
+{
+    PrintModulation(modulation);
+    SERIAL_PRINTF(", airtime = %ldus, ramp-up = %ldus\r\n", (long)timeoutLength, (long)rampupTime);
+    SERIAL_PRINTF("          Margin: start = %ldus, end = %ldus\r\n", (long)marginStart, (long)marginEnd);
+    SERIAL_PRINTF("          Correction for optimum RX window: %ldus\r\n", (long)correction);
+}
+
+void TextSampleOutput::OutOfSync(const char *stage)
+{
+    Serial.Print("Probe out of sync: ");
+    Serial.Print(stage);
+    Serial.Print("\r\n");
+}
+
+void TextSampleOutput::PrintRelativeTimestamp(int32_t timestamp)
+{
+    SERIAL_PRINTF(TIMESTAMP_PATTERN, (long)timestamp);
+}
+
+void TextSampleOutput::PrintModulation(const ModulationInfo &modulation)
+{
+    if (modulation.longRangeMode == LongrangeModeLora)
+    {
+        SERIAL_PRINTF("          SF%d, %lu Hz", modulation.spreadingFactor,
+                (unsigned long)BANDWIDTH_TABLE[modulation.bandwidthIndex]);
+    }
+    else
+    {
+        SERIAL_PRINTF("          FSK, %lu bps, fdev = %lu Hz", (unsigned long)modulation.fskBitRate,
+                (unsigned long)modulation.fskFrequencyDeviation);
+    }
+
+    if (modulation.frequency != 0)
+    {
+        uint32_t kHz = (modulation.frequency + 500) / 1000;
+        SERIAL_PRINTF(", %lu.%03lu MHz", (unsigned long)(kHz / 1000), (unsigned long)(kHz % 1000));
+    }
+}
@@ -10,27 +10,36 @@
 
 #include "setup.h"
 #include "main.h"
+#include "timing.h"
 
 SPI_HandleTypeDef hspi;
 DMA_HandleTypeDef hdma_spi_rx;
 TIM_HandleTypeDef htim2;
+TIM_HandleTypeDef htim_capture;
 
 void SystemClock_Config();
 static void GPIO_Init();
 static void DMA_Init();
 static void SPI2_Init();
 static void TIM2_Init();
+#if CAPTURE_MODE == 1
+static void CaptureTimer_Init();
+#endif
 
 void setup()
 {
     HAL_Init();
 
     SystemClock_Config();
+    InitMicros();
 
     GPIO_Init();
     DMA_Init();
     SPI2_Init();
     TIM2_Init();
+#if CAPTURE_MODE == 1
+    CaptureTimer_Init();
+#endif
 
 #if defined(UART_OUTPUT)
     Uart.Init();
@@ -90,6 +99,13 @@ static void GPIO_Init()
     __HAL_RCC_GPIOB_CLK_ENABLE();
     __HAL_RCC_GPIOD_CLK_ENABLE();
 
+#if CAPTURE_MODE == 1
+    // Configure capture inputs (DIO0, DIO1, NSS)
+    GPIO_InitStruct.Pin = CAPTURE_DIO0_PIN | CAPTURE_DIO1_PIN | CAPTURE_NSS_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    HAL_GPIO_Init(CAPTURE_PORT, &GPIO_InitStruct);
+#else
     // Configure DIO0 & DIO1 pin
     GPIO_InitStruct.Pin = DIO0_PIN | DIO1_PIN;
     GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
@@ -100,6 +116,7 @@ static void GPIO_Init()
 
     HAL_NVIC_SetPriority(EXTI_DIO1_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(EXTI_DIO1_IRQn);
+#endif
 }
 
 static void SPI2_Init()
@@ -126,8 +143,10 @@ static void SPI2_Init()
     hspi.Init.CRCPolynomial = 10;
     HAL_SPI_Init(&hspi);
 
+#if CAPTURE_MODE == 0
     HAL_NVIC_SetPriority(EXTI_NSS_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(EXTI_NSS_IRQn);
+#endif
 }
 
 extern "C" void HAL_SPI_MspInit(SPI_HandleTypeDef *hspi)
@@ -143,7 +162,11 @@ extern "C" void HAL_SPI_MspInit(SPI_HandleTypeDef *hspi)
         // PB13     ------> SPI2_SCK
         // PB15     ------> SPI2_MOSI
         GPIO_InitStruct.Pin = SPI_NSS_PIN;
+#if CAPTURE_MODE == 1
+        GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+#else
         GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+#endif
         GPIO_InitStruct.Pull = GPIO_PULLUP;
         HAL_GPIO_Init(SPI_PORT, &GPIO_InitStruct);
 
@@ -238,6 +261,53 @@ void TIM2_Init()
     HAL_TIM_PWM_Start(&htim2, TIM_CHANNEL_2);
 }
 
+#if CAPTURE_MODE == 1
+
+// Free-running 16-bit timer at 8 MHz with input capture on the
+// rising edges of DIO0 (CH1), DIO1 (CH2) and NSS (CH3).
+// The timer is extended to 64 bit in software (see EdgeCapture).
+// DMA transfer of the captured values is not possible as the
+// DMA channel of TIM4_CH2 is already used for SPI2_RX.
+static void CaptureTimer_Init()
+{
+    TIM_IC_InitTypeDef sConfigIC = {0};
+
+    htim_capture.Instance = CAPTURE_TIM_INSTANCE;
+    htim_capture.Init.Prescaler = 8; // 72 MHz / 9 = 8 MHz
+    htim_capture.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim_capture.Init.Period = 0xffff;
+    htim_capture.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    htim_capture.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    HAL_TIM_IC_Init(&htim_capture);
+
+    sConfigIC.ICPolarity = TIM_INPUTCHANNELPOLARITY_RISING;
+    sConfigIC.ICSelection = TIM_ICSELECTION_DIRECTTI;
+    sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
+    sConfigIC.ICFilter = 0;
+    HAL_TIM_IC_ConfigChannel(&htim_capture, &sConfigIC, CAPTURE_DIO0_CHANNEL);
+    HAL_TIM_IC_ConfigChannel(&htim_capture, &sConfigIC, CAPTURE_DIO1_CHANNEL);
+    HAL_TIM_IC_ConfigChannel(&htim_capture, &sConfigIC, CAPTURE_NSS_CHANNEL);
+
+    HAL_NVIC_SetPriority(CAPTURE_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(CAPTURE_IRQn);
+
+    __HAL_TIM_ENABLE_IT(&htim_capture, TIM_IT_UPDATE);
+    HAL_TIM_IC_Start_IT(&htim_capture, CAPTURE_DIO0_CHANNEL);
+    HAL_TIM_IC_Start_IT(&htim_capture, CAPTURE_DIO1_CHANNEL);
+    HAL_TIM_IC_Start_IT(&htim_capture, CAPTURE_NSS_CHANNEL);
+}
+
+extern "C" void HAL_TIM_IC_MspInit(TIM_HandleTypeDef *htim_ic)
+{
+    if (htim_ic->Instance == CAPTURE_TIM_INSTANCE)
+    {
+        // Peripheral clock enable
+        __HAL_RCC_TIM4_CLK_ENABLE();
+    }
+}
+
+#endif
+
 extern "C" void HAL_TIM_Base_MspInit(TIM_HandleTypeDef *htim_base)
 {
     if (htim_base->Instance == TIM2)
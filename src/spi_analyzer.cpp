@@ -9,38 +9,13 @@
  */
 
 #include "main.h"
+#include "lorawan.h"
 #include "spi_analyzer.h"
 
 
-const uint32_t BANDWIDTH_TABLE[] = {
-    7800,
-    10400,
-    15600,
-    20800,
-    31250,
-    41700,
-    62500,
-    125000,
-    250000,
-    500000
-};
-
-void SpiAnalyzer::OnTrx(uint32_t time, const uint8_t *startTrx, const uint8_t *endTrx)
+void SpiAnalyzer::DecodeTrx(uint64_t time, const uint8_t *startTrx, const uint8_t *endTrx)
 {
-#if SPI_DEBUG == 1
-    if (endTrx > startTrx)
-    {
-        Serial.PrintHex(startTrx, endTrx - startTrx, true);
-    }
-    else
-    {
-        Serial.PrintHex(startTrx, circularBufferEnd - startTrx, false);
-        Serial.PrintHex(circularBufferStart, endTrx - circularBufferStart, true);
-    }
-#endif
-
-    const uint8_t *p = startTrx;
-    uint8_t reg = *p;
+    uint8_t reg = *startTrx;
 
     // check for FIFO read
     if (reg == 0x00)
@@ -55,136 +30,337 @@ void SpiAnalyzer::OnTrx(uint32_t time, const uint8_t *startTrx, const uint8_t *e
 
     reg = reg & 0x7fU;
 
-    p++;
-    if (p == circularBufferEnd)
-        p = circularBufferStart;
+    // FIFO write (the address doesn't increment)
+    if (reg == 0x00)
+    {
+        OnFifoWrite(startTrx, endTrx);
+        return;
+    }
+
+    const uint8_t *values = startTrx + 1;
+    if (values == circularBufferEnd)
+        values = circularBufferStart;
 
-    // save register value
-    uint8_t value = *p;
+    // Writes auto-increment the register address. The values are
+    // contiguous unless the transaction wraps around the end of the
+    // circular buffer, in which case they are processed in two parts.
+    if (values <= endTrx)
+    {
+        OnRegWriteBurst(time, reg, values, endTrx - values);
+    }
+    else
+    {
+        size_t len = circularBufferEnd - values;
+        OnRegWriteBurst(time, reg, values, len);
+        OnRegWriteBurst(time, reg + len, circularBufferStart, endTrx - circularBufferStart);
+    }
+}
 
-    p++;
-    if (p == circularBufferEnd)
-        p = circularBufferStart;
+void SpiAnalyzer::OnRegWriteBurst(uint64_t time, uint8_t reg, const uint8_t *values, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        // the register address wraps around at the end of the register map
+        uint8_t r = (reg + i) & 0x7fU;
+        registers.Write(registers.Index(r), values[i]);
 
-    // check for transaction length
-    if (p != endTrx)
-        return;
+        // OpMode triggers the analysis
+        if (r == REG_OP_MODE)
+            OnOpModeChanged(time, values[i]);
 
-    OnRegWrite(time, reg, value);
+        // setting the LoRa FIFO pointer starts a new payload
+        else if (r == REG_FIFO_ADDR_PTR && (registers.Value(REG_OP_MODE) & 0x80) != 0)
+            txFifoLength = 0;
+    }
 }
 
 void SpiAnalyzer::OnFifoRead(const uint8_t *startTrx, const uint8_t *endTrx)
 {
     // FIFO read indicates received data.
     // Interesting information is length of data.
-    if (endTrx < startTrx)
-        endTrx += circularBufferEnd - circularBufferStart;
-    uint8_t len = endTrx - startTrx - 1;
-    timingAnalyzer.OnDataReceived(len);
+    timingAnalyzer.OnDataReceived(TrxLength(startTrx, endTrx) - 1);
 }
 
-void SpiAnalyzer::OnRegWrite(uint32_t time, uint8_t reg, uint8_t value)
+void SpiAnalyzer::OnFifoWrite(const uint8_t *startTrx, const uint8_t *endTrx)
 {
-    switch (reg)
-    {
-    case 0x01: // OpMode
-        OnOpModeChanged(time, value);
-        break;
-    case 0x1d: // ModemConfig1
-        OnModemConfig1(value);
-        break;
-    case 0x1e: // ModemConfig2
-        OnModemConfig2(value);
-        break;
-    case 0x1f: // SymbTimeoutLsb
-        OnSymbTimeoutLsbChanged(value);
-        break;
-    case 0x20: // PreambleMsb
-        OnPreambleMsbChanged(value);
-        break;
-    case 0x21: // PreambleMsb
-        OnPreambleLsbChanged(value);
-        break;
-    case 0x22: // PayloadLength
-        OnPayloadLengthChanged(value);
-        break;
-    case 0x26: // ModemConfig3
-        OnModemConfig3(value);
-        break;
-    default:
-        break;
-    }
+    // FIFO write contains the TX payload (possibly written in several bursts).
+    // The data is not copied; it's read from the SPI buffer if needed.
+    txFifoStart = txFifoLength == 0 ? startTrx : nullptr;
+    txFifoPos = trxStartPos;
+    txFifoLength += TrxLength(startTrx, endTrx) - 1;
+}
+
+void SpiAnalyzer::OnTxPayload()
+{
+    // LoRaWAN frame (parsed in place in the SPI buffer unless
+    // the DMA has overwritten it since the FIFO write)
+    if (txFifoStart != nullptr && IsOverwritten(txFifoPos))
+        SERIAL_PRINTF("SPI buffer overrun - TX payload of %lu bytes not decoded\r\n", (unsigned long)txFifoLength);
+
+    LoraWanFrame frame;
+    bool isLoraWan = (registers.Value(REG_OP_MODE) & 0x80) != 0 && HasTxFifoData()
+            && ParseLoraWanFrame([this](size_t offset) { return TxFifoByte(offset); }, txFifoLength, frame);
+    timingAnalyzer.SetTxFrame(isLoraWan ? &frame : nullptr);
 }
 
-void SpiAnalyzer::OnOpModeChanged(uint32_t time, uint8_t value)
+void SpiAnalyzer::OnOpModeChanged(uint64_t time, uint8_t value)
 {
-    LongRangeMode longRangeMode = (value & 0x80) != 0 ? LongrangeModeLora : LongrangeModeFSK;
-    timingAnalyzer.SetLongRangeMode(longRangeMode);
+    bool isLora = (value & 0x80) != 0;
+    timingAnalyzer.SetLongRangeMode(isLora ? LongrangeModeLora : LongrangeModeFSK);
 
+    // RX single in LoRa mode, RX in FSK mode
     uint8_t mode = value & 0x07U;
+    bool isRx = isLora ? mode == 0x06 : mode == 0x05;
+
     if (mode == 0x03)
     {
+        UpdateParameters();
+        timingAnalyzer.SetTxFifoLength(txFifoLength != 0 ? (int)txFifoLength : -1);
+        OnTxPayload();
+        // the next transmission needs a new payload
+        txFifoStart = nullptr;
+        txFifoLength = 0;
         timingAnalyzer.OnTxStart(time);
     }
-    else if (mode == 0x06)
+    else if (isRx)
     {
+        UpdateParameters();
         timingAnalyzer.OnRxStart(time);
     }
+    else if (isReceiving)
+    {
+        timingAnalyzer.OnRxStopped(time);
+    }
+
+    isReceiving = isRx;
 }
 
-void SpiAnalyzer::OnModemConfig1(uint8_t value)
+// Register field: the bits `mask` of register `reg` contribute to
+// parameter `param`, starting at bit `shift` of the parameter value.
+struct RegisterField
 {
-    uint8_t bw = value >> 4U;
-    if (bw >= sizeof(BANDWIDTH_TABLE)/sizeof(BANDWIDTH_TABLE[0]))
-        return;
-    
-    timingAnalyzer.SetBandwidth(BANDWIDTH_TABLE[bw]);
-
-    uint8_t cr = ((value >> 1U) & 0x7U) + 4;
-    if (cr < 5 || cr > 8)
-        return;
+    uint8_t reg;
+    uint8_t mask;
+    uint8_t shift;
+    SpiAnalyzer::Param param;
+    // number of trailing zero bits of `mask`
+    uint8_t maskShift;
+};
 
-    timingAnalyzer.SetCodingRate(cr);
+// Number of trailing zero bits of a mask
+constexpr uint8_t MaskShift(uint8_t mask)
+{
+    return (mask & 1U) != 0 ? 0 : 1 + MaskShift(mask >> 1);
+}
 
-    timingAnalyzer.SetImplicitHeader(value & 0x01U);
+constexpr RegisterField Field(uint8_t reg, uint8_t mask, uint8_t shift, SpiAnalyzer::Param param)
+{
+    return { reg, mask, shift, param, MaskShift(mask) };
 }
 
-void SpiAnalyzer::OnModemConfig2(uint8_t value)
+// Register fields relevant for the analysis, ordered by parameter.
+// To analyze another register, add it here (and add a parameter
+// if it's a new one).
+static constexpr RegisterField REGISTER_FIELDS[] = {
+    Field(REG_FRF_MSB, 0xff, 16, SpiAnalyzer::ParamFrequency),
+    Field(REG_FRF_MID, 0xff, 8, SpiAnalyzer::ParamFrequency),
+    Field(REG_FRF_LSB, 0xff, 0, SpiAnalyzer::ParamFrequency),
+    Field(REG_MODEM_CONFIG1, 0xf0, 0, SpiAnalyzer::ParamBandwidth),
+    Field(REG_MODEM_CONFIG1, 0x0e, 0, SpiAnalyzer::ParamCodingRate),
+    Field(REG_MODEM_CONFIG1, 0x01, 0, SpiAnalyzer::ParamImplicitHeader),
+    Field(REG_MODEM_CONFIG2, 0xf0, 0, SpiAnalyzer::ParamSpreadingFactor),
+    Field(REG_MODEM_CONFIG2, 0x04, 0, SpiAnalyzer::ParamCrcOn),
+    Field(REG_MODEM_CONFIG2, 0x03, 8, SpiAnalyzer::ParamSymbolTimeout),
+    Field(REG_SYMB_TIMEOUT_LSB, 0xff, 0, SpiAnalyzer::ParamSymbolTimeout),
+    Field(REG_PREAMBLE_MSB, 0xff, 8, SpiAnalyzer::ParamPreambleLength),
+    Field(REG_PREAMBLE_LSB, 0xff, 0, SpiAnalyzer::ParamPreambleLength),
+    Field(REG_PAYLOAD_LENGTH, 0xff, 0, SpiAnalyzer::ParamPayloadLength),
+    Field(REG_MODEM_CONFIG3, 0x08, 0, SpiAnalyzer::ParamLowDataRateOptimization),
+    Field(REG_SYNC_WORD, 0xff, 0, SpiAnalyzer::ParamSyncWord),
+    Field(REG_FSK_BITRATE_MSB, 0xff, 12, SpiAnalyzer::ParamFskBitPeriod),
+    Field(REG_FSK_BITRATE_LSB, 0xff, 4, SpiAnalyzer::ParamFskBitPeriod),
+    Field(REG_FSK_BITRATE_FRAC, 0x0f, 0, SpiAnalyzer::ParamFskBitPeriod),
+    Field(REG_FSK_FDEV_MSB, 0x3f, 8, SpiAnalyzer::ParamFskFrequencyDeviation),
+    Field(REG_FSK_FDEV_LSB, 0xff, 0, SpiAnalyzer::ParamFskFrequencyDeviation),
+    Field(REG_FSK_PREAMBLE_DETECT, 0x60, 0, SpiAnalyzer::ParamFskPreambleDetectSize),
+    Field(REG_FSK_PREAMBLE_MSB, 0xff, 8, SpiAnalyzer::ParamFskPreambleLength),
+    Field(REG_FSK_PREAMBLE_LSB, 0xff, 0, SpiAnalyzer::ParamFskPreambleLength),
+    Field(REG_FSK_SYNC_CONFIG, 0x10, 3, SpiAnalyzer::ParamFskSyncSize),
+    Field(REG_FSK_SYNC_CONFIG, 0x07, 0, SpiAnalyzer::ParamFskSyncSize),
+    Field(REG_FSK_PACKET_CONFIG1, 0x80, 0, SpiAnalyzer::ParamFskVariableLength),
+    Field(REG_FSK_PACKET_CONFIG1, 0x10, 0, SpiAnalyzer::ParamFskCrcOn),
+    Field(REG_FSK_PACKET_CONFIG1, 0x06, 0, SpiAnalyzer::ParamFskAddressFiltering),
+    Field(REG_FSK_PACKET_CONFIG2, 0x07, 8, SpiAnalyzer::ParamFskPayloadLength),
+    Field(REG_FSK_PAYLOAD_LENGTH, 0xff, 0, SpiAnalyzer::ParamFskPayloadLength)
+};
+
+#define NUM_REGISTER_FIELDS (sizeof(REGISTER_FIELDS) / sizeof(REGISTER_FIELDS[0]))
+
+static_assert(SpiAnalyzer::NUM_PARAMS <= 32, "parameter set must fit into 32 bits");
+
+// Checks that the register fields are ordered by parameter
+constexpr bool IsOrderedByParam(size_t i = 1)
 {
-    uint8_t sf = value >> 4U;
-    if (sf >= 6 && sf <= 12)
-        timingAnalyzer.SetSpreadingFactor(sf);
+    return i >= NUM_REGISTER_FIELDS ? true
+        : REGISTER_FIELDS[i - 1].param <= REGISTER_FIELDS[i].param && IsOrderedByParam(i + 1);
+}
 
-    timingAnalyzer.SetCrcOn((value >> 2U) & 0x01U);
+static_assert(IsOrderedByParam(), "register fields must be ordered by parameter");
 
-    *(((uint8_t*)&symbolTimeout) + 1) = value & 0x03U;
-    timingAnalyzer.SetRxSymbolTimeout(symbolTimeout);
+// Returns the set of parameters (as bits) derived from the given register
+constexpr uint32_t ParamsOfRegister(unsigned reg, size_t i = 0)
+{
+    return i == NUM_REGISTER_FIELDS ? 0
+        : ((REGISTER_FIELDS[i].reg == reg ? 1U << REGISTER_FIELDS[i].param : 0U)
+            | ParamsOfRegister(reg, i + 1));
 }
 
-void SpiAnalyzer::OnSymbTimeoutLsbChanged(uint8_t value)
+// Returns the index of the first register field of the given parameter
+constexpr uint8_t FirstFieldOfParam(unsigned param, size_t i = 0)
 {
-    *(((uint8_t*)&symbolTimeout) + 0) = value;
-    timingAnalyzer.SetRxSymbolTimeout(symbolTimeout);
+    return i == NUM_REGISTER_FIELDS || REGISTER_FIELDS[i].param >= param ? i : FirstFieldOfParam(param, i + 1);
 }
 
-void SpiAnalyzer::OnPreambleMsbChanged(uint8_t value)
+#define PARAMS_4(reg) ParamsOfRegister(reg), ParamsOfRegister(reg + 1), \
+    ParamsOfRegister(reg + 2), ParamsOfRegister(reg + 3)
+#define PARAMS_16(reg) PARAMS_4(reg), PARAMS_4(reg + 4), PARAMS_4(reg + 8), PARAMS_4(reg + 12)
+#define PARAMS_64(reg) PARAMS_16(reg), PARAMS_16(reg + 16), PARAMS_16(reg + 32), PARAMS_16(reg + 48)
+
+// Set of parameters derived from each register (indexed by shadow index)
+static constexpr uint32_t REGISTER_PARAMS[NUM_SHADOW_REGISTERS] = { PARAMS_64(0), PARAMS_64(64), PARAMS_64(128) };
+
+static_assert(REGISTER_PARAMS[REG_MODEM_CONFIG2] == ((1U << SpiAnalyzer::ParamSpreadingFactor)
+        | (1U << SpiAnalyzer::ParamCrcOn) | (1U << SpiAnalyzer::ParamSymbolTimeout)), "invalid register table");
+
+#define FIRST_FIELD_4(param) FirstFieldOfParam(param), FirstFieldOfParam(param + 1), \
+    FirstFieldOfParam(param + 2), FirstFieldOfParam(param + 3)
+
+// Index of the first register field of each parameter (the fields of
+// parameter `p` are `PARAM_FIELDS[p]` to `PARAM_FIELDS[p + 1] - 1`)
+static constexpr uint8_t PARAM_FIELDS[32 + 1] = {
+    FIRST_FIELD_4(0), FIRST_FIELD_4(4), FIRST_FIELD_4(8), FIRST_FIELD_4(12),
+    FIRST_FIELD_4(16), FIRST_FIELD_4(20), FIRST_FIELD_4(24), FIRST_FIELD_4(28),
+    FirstFieldOfParam(32)
+};
+
+
+void SpiAnalyzer::UpdateParameters()
 {
-    *(((uint8_t*)&preambleLength) + 1) = value;
-    timingAnalyzer.SetPreambleLength(preambleLength);
+    // Only recompute parameters whose registers have changed
+    // since the last TX/RX start
+    uint32_t params = 0;
+    for (int i = 0; i < NUM_SHADOW_REGISTERS / 32; i++)
+    {
+        uint32_t dirty = registers.DirtyFlags(i);
+        while (dirty != 0)
+        {
+            int bit = __builtin_ctz(dirty);
+            dirty &= dirty - 1;
+            params |= REGISTER_PARAMS[i * 32 + bit];
+        }
+    }
+
+    while (params != 0)
+    {
+        Param param = (Param)__builtin_ctz(params);
+        params &= params - 1;
+        SetParameter(param, ParameterValue(param));
+    }
+
+    registers.ClearDirty();
 }
 
-void SpiAnalyzer::OnPreambleLsbChanged(uint8_t value)
+void SpiAnalyzer::SetAllParameters()
 {
-    *(((uint8_t*)&preambleLength) + 0) = value;
-    timingAnalyzer.SetPreambleLength(preambleLength);
+    for (int param = 0; param < NUM_PARAMS; param++)
+        SetParameter((Param)param, ParameterValue((Param)param));
 }
 
-void SpiAnalyzer::OnPayloadLengthChanged(uint8_t value)
+uint32_t SpiAnalyzer::ParameterValue(Param param) const
 {
-    timingAnalyzer.SetTxPayloadLength(value);
+    uint32_t value = 0;
+    for (int i = PARAM_FIELDS[param]; i < PARAM_FIELDS[param + 1]; i++)
+    {
+        const RegisterField &field = REGISTER_FIELDS[i];
+        value |= (uint32_t)((registers.Value(field.reg) & field.mask) >> field.maskShift) << field.shift;
+    }
+    return value;
 }
 
-void SpiAnalyzer::OnModemConfig3(uint8_t value)
+void SpiAnalyzer::SetParameter(Param param, uint32_t value)
 {
-    timingAnalyzer.SetLowDataRateOptimization((value >> 3U) & 0x001U);
+    switch (param)
+    {
+    case ParamFrequency:
+        // Frf = frequency * 2^19 / 32 MHz, i.e. frequency = Frf * 15625 / 256
+        frequency = (uint32_t)(((uint64_t)value * 15625 + 128) >> 8);
+        timingAnalyzer.SetFrequency(frequency);
+        break;
+    case ParamBandwidth:
+        if (value < NUM_BANDWIDTHS)
+            timingAnalyzer.SetBandwidth(value);
+        break;
+    case ParamCodingRate:
+        if (value >= 1 && value <= 4)
+            timingAnalyzer.SetCodingRate(value + 4);
+        break;
+    case ParamImplicitHeader:
+        timingAnalyzer.SetImplicitHeader(value);
+        break;
+    case ParamSpreadingFactor:
+        if (value >= 6 && value <= 12)
+            timingAnalyzer.SetSpreadingFactor(value);
+        break;
+    case ParamCrcOn:
+        timingAnalyzer.SetCrcOn(value);
+        break;
+    case ParamSymbolTimeout:
+        timingAnalyzer.SetRxSymbolTimeout(value);
+        break;
+    case ParamPreambleLength:
+        timingAnalyzer.SetPreambleLength(value);
+        break;
+    case ParamPayloadLength:
+        timingAnalyzer.SetTxPayloadLength(value);
+        break;
+    case ParamLowDataRateOptimization:
+        timingAnalyzer.SetLowDataRateOptimization(value);
+        break;
+    case ParamSyncWord:
+        syncWord = value;
+        break;
+    case ParamFskBitPeriod:
+        // bit period = (BitRate + BitRateFrac / 16) / 32 MHz = value / 512 us
+        if (value != 0)
+            timingAnalyzer.SetFskBitPeriod(value);
+        break;
+    case ParamFskFrequencyDeviation:
+        // Fdev = value * 32 MHz / 2^19
+        timingAnalyzer.SetFskFrequencyDeviation((uint32_t)(((uint64_t)value * 15625 + 128) >> 8));
+        break;
+    case ParamFskPreambleDetectSize:
+        timingAnalyzer.SetFskPreambleDetectSize(value + 1);
+        break;
+    case ParamFskPreambleLength:
+        timingAnalyzer.SetFskPreambleLength(value);
+        break;
+    case ParamFskSyncSize:
+        // SyncOn (bit 3), SyncSize (bits 0 to 2, size - 1)
+        timingAnalyzer.SetFskSyncSize((value & 0x08U) != 0 ? (value & 0x07U) + 1 : 0);
+        break;
+    case ParamFskVariableLength:
+        timingAnalyzer.SetFskVariableLength(value);
+        break;
+    case ParamFskCrcOn:
+        timingAnalyzer.SetFskCrcOn(value);
+        break;
+    case ParamFskAddressFiltering:
+        timingAnalyzer.SetFskAddressFiltering(value != 0);
+        break;
+    case ParamFskPayloadLength:
+        timingAnalyzer.SetFskPayloadLength(value);
+        break;
+    default:
+        break;
+    }
 }
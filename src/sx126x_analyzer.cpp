@@ -0,0 +1,220 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ * 
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * SPI communication analyzer for SX126x and LLCC68
+ */
+
+#include "main.h"
+#include "sx126x_analyzer.h"
+
+#define INVALID_BANDWIDTH 0xff
+
+// Bandwidth index (see BANDWIDTH_TABLE) for each SX126x bandwidth setting
+static const uint8_t SX126X_BANDWIDTHS[16] = {
+    0, // 0x00: 7.8 kHz
+    2, // 0x01: 15.6 kHz
+    4, // 0x02: 31.25 kHz
+    6, // 0x03: 62.5 kHz
+    7, // 0x04: 125 kHz
+    8, // 0x05: 250 kHz
+    9, // 0x06: 500 kHz
+    INVALID_BANDWIDTH,
+    1, // 0x08: 10.4 kHz
+    3, // 0x09: 20.8 kHz
+    5, // 0x0a: 41.7 kHz
+    INVALID_BANDWIDTH,
+    INVALID_BANDWIDTH,
+    INVALID_BANDWIDTH,
+    INVALID_BANDWIDTH,
+    INVALID_BANDWIDTH
+};
+
+
+void Sx126xAnalyzer::DecodeTrx(uint64_t time, const uint8_t *startTrx, const uint8_t *endTrx)
+{
+    size_t len = TrxLength(startTrx, endTrx);
+    uint8_t opcode = *startTrx;
+
+    if (isDio1Pending)
+        ResolveDio1(opcode);
+
+    switch (opcode)
+    {
+    case SX126X_SET_TX:
+        radioMode = RadioModeTx;
+        timingAnalyzer.OnTxStart(time);
+        break;
+    case SX126X_SET_RX:
+        OnSetRx(time, startTrx, len);
+        break;
+    case SX126X_READ_BUFFER:
+        // opcode, offset, status, data
+        if (len >= 3)
+            timingAnalyzer.OnDataReceived(len - 3);
+        break;
+    case SX126X_SET_PACKET_TYPE:
+        OnSetPacketType(startTrx, len);
+        break;
+    case SX126X_SET_MODULATION_PARAMS:
+        OnSetModulationParams(startTrx, len);
+        break;
+    case SX126X_SET_PACKET_PARAMS:
+        OnSetPacketParams(startTrx, len);
+        break;
+    case SX126X_SET_LORA_SYMB_NUM_TIMEOUT:
+        if (len >= 2)
+            numTimeoutSymbols = TrxByte(startTrx, 1);
+        break;
+    case SX126X_SET_RF_FREQUENCY:
+        OnSetRfFrequency(startTrx, len);
+        break;
+    default:
+        break;
+    }
+}
+
+void Sx126xAnalyzer::DecodeDio1(uint64_t time)
+{
+    if (radioMode == RadioModeTx)
+    {
+        radioMode = RadioModeStandby;
+        timingAnalyzer.OnDoneInterrupt(time);
+    }
+    else if (radioMode == RadioModeRx)
+    {
+        // RX done or timeout: decided by the next command
+        isDio1Pending = true;
+        dio1Time = time;
+    }
+}
+
+void Sx126xAnalyzer::ResolveDio1(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case SX126X_GET_STATUS:
+    case SX126X_GET_IRQ_STATUS:
+    case SX126X_CLEAR_IRQ_STATUS:
+        // commands used for both cases
+        return;
+
+    case SX126X_GET_RX_BUFFER_STATUS:
+    case SX126X_GET_PACKET_STATUS:
+    case SX126X_READ_BUFFER:
+        timingAnalyzer.OnDoneInterrupt(dio1Time);
+        break;
+
+    default:
+        timingAnalyzer.OnTimeoutInterrupt(dio1Time);
+        break;
+    }
+
+    isDio1Pending = false;
+    radioMode = RadioModeStandby;
+}
+
+void Sx126xAnalyzer::OnSetRx(uint64_t time, const uint8_t *startTrx, size_t len)
+{
+    if (len < 4)
+        return;
+
+    // The LoRa symbol timeout takes precedence. Otherwise the timeout
+    // is set in steps of 15.625us (0: single mode without timeout,
+    // 0xffffff: continuous mode).
+    uint32_t timeout = ((uint32_t)TrxByte(startTrx, 1) << 16) | ((uint32_t)TrxByte(startTrx, 2) << 8) | TrxByte(startTrx, 3);
+    if (numTimeoutSymbols != 0 || timeout == 0xffffff)
+        timingAnalyzer.SetRxTimeoutDuration(0);
+    else
+        timingAnalyzer.SetRxTimeoutDuration((timeout * 125 + 4) / 8);
+    timingAnalyzer.SetRxSymbolTimeout(numTimeoutSymbols);
+
+    radioMode = RadioModeRx;
+    timingAnalyzer.OnRxStart(time);
+}
+
+void Sx126xAnalyzer::OnSetPacketType(const uint8_t *startTrx, size_t len)
+{
+    if (len < 2)
+        return;
+
+    packetType = TrxByte(startTrx, 1);
+    if (packetType == SX126X_PACKET_TYPE_LORA)
+        timingAnalyzer.SetLongRangeMode(LongrangeModeLora);
+    else if (packetType == SX126X_PACKET_TYPE_GFSK)
+        timingAnalyzer.SetLongRangeMode(LongrangeModeFSK);
+}
+
+void Sx126xAnalyzer::OnSetModulationParams(const uint8_t *startTrx, size_t len)
+{
+    // LoRa: SF, BW, CR, LDRO
+    if (packetType == SX126X_PACKET_TYPE_LORA && len >= 5)
+    {
+        uint8_t sf = TrxByte(startTrx, 1);
+        if (sf >= 6 && sf <= 12)
+            timingAnalyzer.SetSpreadingFactor(sf);
+
+        uint8_t bw = SX126X_BANDWIDTHS[TrxByte(startTrx, 2) & 0x0f];
+        if (bw != INVALID_BANDWIDTH)
+            timingAnalyzer.SetBandwidth(bw);
+
+        uint8_t cr = TrxByte(startTrx, 3);
+        if (cr >= 1 && cr <= 4)
+            timingAnalyzer.SetCodingRate(cr + 4);
+
+        timingAnalyzer.SetLowDataRateOptimization(TrxByte(startTrx, 4) & 0x01);
+    }
+    // GFSK: bit rate (3 bytes), pulse shape, bandwidth, frequency deviation (3 bytes)
+    else if (packetType == SX126X_PACKET_TYPE_GFSK && len >= 9)
+    {
+        // bit period = BR / (32 * 32 MHz) = BR / 2 in 1/512 us
+        uint32_t br = ((uint32_t)TrxByte(startTrx, 1) << 16) | ((uint32_t)TrxByte(startTrx, 2) << 8) | TrxByte(startTrx, 3);
+        if (br >= 2)
+            timingAnalyzer.SetFskBitPeriod(br / 2);
+
+        // Fdev = value * 32 MHz / 2^25
+        uint32_t fdev = ((uint32_t)TrxByte(startTrx, 6) << 16) | ((uint32_t)TrxByte(startTrx, 7) << 8) | TrxByte(startTrx, 8);
+        timingAnalyzer.SetFskFrequencyDeviation((uint32_t)(((uint64_t)fdev * 15625 + 8192) >> 14));
+    }
+}
+
+void Sx126xAnalyzer::OnSetPacketParams(const uint8_t *startTrx, size_t len)
+{
+    // LoRa: preamble length (2 bytes), header type, payload length, CRC type, invert IQ
+    if (packetType == SX126X_PACKET_TYPE_LORA && len >= 7)
+    {
+        timingAnalyzer.SetPreambleLength((TrxByte(startTrx, 1) << 8) | TrxByte(startTrx, 2));
+        timingAnalyzer.SetImplicitHeader(TrxByte(startTrx, 3) & 0x01);
+        timingAnalyzer.SetTxPayloadLength(TrxByte(startTrx, 4));
+        timingAnalyzer.SetCrcOn(TrxByte(startTrx, 5) & 0x01);
+    }
+    // GFSK: preamble length in bits (2 bytes), preamble detector length, sync word length in bits,
+    // address filtering, packet type, payload length, CRC type, whitening
+    else if (packetType == SX126X_PACKET_TYPE_GFSK && len >= 10)
+    {
+        timingAnalyzer.SetFskPreambleLength(((TrxByte(startTrx, 1) << 8) | TrxByte(startTrx, 2)) / 8);
+        uint8_t detector = TrxByte(startTrx, 3);
+        timingAnalyzer.SetFskPreambleDetectSize(detector >= 0x04 && detector <= 0x07 ? detector - 3 : 0);
+        timingAnalyzer.SetFskSyncSize(TrxByte(startTrx, 4) / 8);
+        timingAnalyzer.SetFskAddressFiltering(TrxByte(startTrx, 5) != 0);
+        timingAnalyzer.SetFskVariableLength(TrxByte(startTrx, 6) & 0x01);
+        timingAnalyzer.SetFskPayloadLength(TrxByte(startTrx, 7));
+        // CRC off is 0x01; the 1 byte CRC variants are counted as 2 bytes
+        timingAnalyzer.SetFskCrcOn(TrxByte(startTrx, 8) != 0x01);
+    }
+}
+
+void Sx126xAnalyzer::OnSetRfFrequency(const uint8_t *startTrx, size_t len)
+{
+    if (len < 5)
+        return;
+
+    // frequency = RF * 32 MHz / 2^25
+    uint32_t rf = ((uint32_t)TrxByte(startTrx, 1) << 24) | ((uint32_t)TrxByte(startTrx, 2) << 16)
+            | ((uint32_t)TrxByte(startTrx, 3) << 8) | TrxByte(startTrx, 4);
+    frequency = (uint32_t)(((uint64_t)rf * 15625 + 8192) >> 14);
+    timingAnalyzer.SetFrequency(frequency);
+}
@@ -12,10 +12,26 @@
 
 
 volatile uint32_t UptimeMillis;
+volatile uint32_t UptimeMillisEpoch;
+uint32_t SysTickMicrosFactor;
+
+
+void InitMicros()
+{
+    // The rounded-up reciprocal yields the exact quotient as long as
+    // `st * (SysTickMicrosFactor * ticksPerMicro - 2^31)` < 2^31,
+    // which holds for all counter values at any clock up to 128 MHz.
+    uint32_t ticksPerMicro = (SysTick->LOAD + 1) / 1000;
+    SysTickMicrosFactor = (uint32_t)((0x80000000ULL + ticksPerMicro - 1) / ticksPerMicro);
+}
 
 
 extern "C" void SysTick_Handler()
 {
-    UptimeMillis++;
+    uint32_t ms = UptimeMillis + 1;
+    UptimeMillis = ms;
+    if (ms == 0)
+        UptimeMillisEpoch++;
+
     HAL_IncTick();
 }
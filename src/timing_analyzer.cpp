@@ -10,21 +10,67 @@
 
 #include "timing_analyzer.h"
 #include "main.h"
-#include <cmath>
-
-#define TIMESTAMP_PATTERN "%8ld: "
 
 // Minimum number of preamble symbols required to detect packet
 #define MIN_RX_SYMBOLS 6
 
+// Receiver ramp-up time (not known but assumed to be 300us)
+#define RX_RAMP_UP_TIME 300
+
+
+const uint32_t BANDWIDTH_TABLE[NUM_BANDWIDTHS] = {
+    7800,
+    10400,
+    15600,
+    20800,
+    31250,
+    41700,
+    62500,
+    125000,
+    250000,
+    500000
+};
+
+// Symbol duration in 1/256 us for the given spreading factor and a bandwidth
+// of 125 kHz * bwNum / bwDen, i.e. 2^SF / BW = 2^SF * 8 * bwDen / bwNum us
+constexpr uint32_t SymbolDurationQ8(int sf, uint32_t bwNum, uint32_t bwDen)
+{
+    return (uint32_t)((((uint64_t)1 << sf) * 8 * bwDen * 256 + bwNum / 2) / bwNum);
+}
+
+// The exact bandwidths are fractions of 125 kHz:
+// 7.8125, 10.417, 15.625, 20.833, 31.25, 41.667, 62.5, 125, 250 and 500 kHz
+#define SYMBOL_DURATION_ROW(sf) { \
+    SymbolDurationQ8(sf, 1, 16), SymbolDurationQ8(sf, 1, 12), SymbolDurationQ8(sf, 1, 8), \
+    SymbolDurationQ8(sf, 1, 6), SymbolDurationQ8(sf, 1, 4), SymbolDurationQ8(sf, 1, 3), \
+    SymbolDurationQ8(sf, 1, 2), SymbolDurationQ8(sf, 1, 1), SymbolDurationQ8(sf, 2, 1), \
+    SymbolDurationQ8(sf, 4, 1) }
+
+// Symbol duration in 1/256 us, indexed by spreading factor (6 to 12) and bandwidth setting
+static constexpr uint32_t SYMBOL_DURATION_TABLE[7][NUM_BANDWIDTHS] = {
+    SYMBOL_DURATION_ROW(6),
+    SYMBOL_DURATION_ROW(7),
+    SYMBOL_DURATION_ROW(8),
+    SYMBOL_DURATION_ROW(9),
+    SYMBOL_DURATION_ROW(10),
+    SYMBOL_DURATION_ROW(11),
+    SYMBOL_DURATION_ROW(12)
+};
+
+static_assert(SYMBOL_DURATION_TABLE[1][7] == 1024 * 256, "SF7 / 125 kHz must be 1.024ms");
+
 
 TimingAnalyzer::TimingAnalyzer()
     : sampleNo(0), stage(LoraStageIdle), result(LoraResultNoDownlink),
       txUncalibratedStartTime(0), txStartTime(0), txUncalibratedEndTime(0),
       rx1Start(0), rx1End(0), rx2Start(0), rx2End(0),
-      longRangeMode(LongrangeModeLora), bandwidth(125000), numTimeoutSymbols(0x64), codingRate(5),
+      txFrequency(0), rxFrequency(0), hasTxFrame(false), rxDelay(0), cycleRxDelay(0),
+      longRangeMode(LongrangeModeLora), frequency(0), bandwidthIndex(7), numTimeoutSymbols(0x64), rxTimeoutDuration(0), codingRate(5),
       implicitHeader(0), spreadingFactor(7), crcOn(0),
-      preambleLength(8), txPayloadLength(1), lowDataRateOptimization(0)
+      preambleLength(8), txPayloadLength(1), lowDataRateOptimization(0), txFifoLength(-1),
+      fskBitPeriod(0x1a0b * 16), fskFrequencyDeviation(5005), fskPreambleDetectSize(2),
+      fskPreambleLength(3), fskSyncSize(4), fskVariableLength(1), fskCrcOn(1),
+      fskAddressFiltering(0), fskPayloadLength(0x40)
 {
 }
 
@@ -34,7 +80,7 @@ void TimingAnalyzer::ResetStage()
     result = LoraResultNoDownlink;
 }
 
-void TimingAnalyzer::OnTxStart(uint32_t time)
+void TimingAnalyzer::OnTxStart(uint64_t time)
 {
     if (stage != LoraStageIdle)
     {
@@ -43,12 +89,13 @@ void TimingAnalyzer::OnTxStart(uint32_t time)
     }
 
     sampleNo++;
-    Serial.Printf("--------  Sample %d  --------\r\n", sampleNo);
+    sampleOutput.SampleStart(sampleNo, hasTxFrame && txFrame.IsDataFrame() ? txFrame.fCnt : -1);
     stage = LoraStageTransmitting;
     txUncalibratedStartTime = time;
+    txFrequency = frequency;
 }
 
-void TimingAnalyzer::OnRxStart(uint32_t time)
+void TimingAnalyzer::OnRxStart(uint64_t time)
 {
     if (stage != LoraStageBeforeRx1Window && stage != LoraStageBeforeRx2Window)
     {
@@ -56,7 +103,7 @@ void TimingAnalyzer::OnRxStart(uint32_t time)
         return;
     }
 
-    int32_t t = CalibratedTime(time - txUncalibratedEndTime);
+    int32_t t = CalibratedTime(TimeDiff(time, txUncalibratedEndTime));
 
     if (stage == LoraStageBeforeRx1Window)
     {
@@ -69,11 +116,13 @@ void TimingAnalyzer::OnRxStart(uint32_t time)
         rx2Start = t;
     }
 
-    PrintRelativeTimestamp(t);
-    Serial.Printf("RX%c start\r\n", stage == LoraStageInRx1Window ? '1' : '2');
+    rxFrequency = frequency;
+    LearnRxDelay(t, stage == LoraStageInRx2Window);
+
+    sampleOutput.RxStart(stage == LoraStageInRx1Window ? 1 : 2, t);
 }
 
-void TimingAnalyzer::OnDoneInterrupt(uint32_t time)
+void TimingAnalyzer::OnDoneInterrupt(uint64_t time)
 {
     if (stage != LoraStageTransmitting && stage != LoraStageInRx1Window && stage != LoraStageInRx2Window)
     {
@@ -84,37 +133,35 @@ void TimingAnalyzer::OnDoneInterrupt(uint32_t time)
     if (stage == LoraStageTransmitting)
     {
         txUncalibratedEndTime = time;
-        txStartTime = CalibratedTime(txUncalibratedStartTime - txUncalibratedEndTime);
+        txStartTime = CalibratedTime(TimeDiff(txUncalibratedStartTime, txUncalibratedEndTime));
         stage = LoraStageBeforeRx1Window;
 
-        PrintRelativeTimestamp(txStartTime);
-        Serial.Print("TX start\r\n");
-        PrintRelativeTimestamp(0);
-        Serial.Print("TX done\r\n");
-
-        PrintParameters(-txStartTime, txPayloadLength);
+        PrintParameters(txStartTime, TxPayloadLength());
+        PrintPayloadLengthCheck();
+        if (hasTxFrame)
+            sampleOutput.Frame(txFrame);
+        UpdateRxDelay();
+        channelStatistics.CountUplink(txFrequency);
     }
     else if (stage == LoraStageInRx1Window)
     {
-        rx1End = CalibratedTime(time - txUncalibratedEndTime);
+        rx1End = CalibratedTime(TimeDiff(time, txUncalibratedEndTime));
         result = LoraResultDownlinkInRx1;
         stage = LoraStageWaitingForData;
 
-        PrintRelativeTimestamp(rx1End);
-        Serial.Print("RX1: downlink packet received\r\n");
+        sampleOutput.RxDone(1, rx1End);
     }
     else
     {
-        rx2End = CalibratedTime(time - txUncalibratedEndTime);
+        rx2End = CalibratedTime(TimeDiff(time, txUncalibratedEndTime));
         result = LoraResultDownlinkInRx2;
         stage = LoraStageWaitingForData;
 
-        PrintRelativeTimestamp(rx2End);
-        Serial.Print("RX2: downlink packet received\r\n");
+        sampleOutput.RxDone(2, rx2End);
     }
 }
 
-void TimingAnalyzer::OnDataReceived(uint8_t payloadLength)
+void TimingAnalyzer::OnDataReceived(int payloadLength)
 {
     if (stage != LoraStageWaitingForData)
     {
@@ -122,15 +169,15 @@ void TimingAnalyzer::OnDataReceived(uint8_t payloadLength)
         return;
     }
 
-    if (result == LoraResultDownlinkInRx1)
-        PrintRxAnalysis(rx1Start, rx1End, payloadLength);
-    else
-        PrintRxAnalysis(rx2Start, rx2End, payloadLength);
+    bool isRx2 = result == LoraResultDownlinkInRx2;
+    int32_t margin = isRx2 ? PrintRxAnalysis(rx2Start, rx2End, payloadLength)
+            : PrintRxAnalysis(rx1Start, rx1End, payloadLength);
+    channelStatistics.CountDownlink(rxFrequency, isRx2, margin);
 
     OnRxTxCompleted();
 }
 
-void TimingAnalyzer::OnTimeoutInterrupt(uint32_t time)
+void TimingAnalyzer::OnTimeoutInterrupt(uint64_t time)
 {
     if (stage != LoraStageInRx1Window && stage != LoraStageInRx2Window)
     {
@@ -138,46 +185,52 @@ void TimingAnalyzer::OnTimeoutInterrupt(uint32_t time)
         return;
     }
 
-    int32_t t = CalibratedTime(time - txUncalibratedEndTime);
+    int32_t t = CalibratedTime(TimeDiff(time, txUncalibratedEndTime));
 
-    PrintRelativeTimestamp(t);
-    Serial.Print(stage == LoraStageInRx1Window ? "RX1 timeout\r\n" : "RX2 timeout\r\n");
+    sampleOutput.RxTimeout(stage == LoraStageInRx1Window ? 1 : 2, t);
 
     if (stage == LoraStageInRx1Window)
     {
         stage = LoraStageBeforeRx2Window;
         rx1End = t;
-        PrintTimeoutAnalysis(rx1Start, rx1End);
+        int32_t margin = PrintTimeoutAnalysis(rx1Start, rx1End, false);
+        channelStatistics.CountTimeout(rxFrequency, margin);
     }
     else
     {
         rx2End = t;
         result = LoraResultNoDownlink;
-        PrintTimeoutAnalysis(rx2Start, rx2End);
+        int32_t margin = PrintTimeoutAnalysis(rx2Start, rx2End, true);
+        channelStatistics.CountTimeout(rxFrequency, margin);
         OnRxTxCompleted();
     }
 }
 
-void TimingAnalyzer::PrintRxAnalysis(int32_t windowStartTime, int32_t windowEndTime, int payloadLength)
+void TimingAnalyzer::OnRxStopped(uint64_t time)
 {
-    // HACK: It looks as if the air time calculation fits much better with 2 bytes less...
-    int32_t airTime = PayloadAirTime(payloadLength - 2);
+    // In FSK mode, the timeout is signaled on DIO2, which isn't monitored.
+    // Instead, the MCU switching off the receiver ends the RX window.
+    if (longRangeMode != LongrangeModeFSK)
+        return;
+    if (stage != LoraStageInRx1Window && stage != LoraStageInRx2Window)
+        return;
 
-    Serial.Printf("          SF%d, %lu Hz, payload = %d bytes, airtime = %ldus\r\n",
-            spreadingFactor, bandwidth, payloadLength, airTime);
+    OnTimeoutInterrupt(time);
+}
 
+int32_t TimingAnalyzer::PrintRxAnalysis(int32_t windowStartTime, int32_t windowEndTime, int payloadLength)
+{
+    int32_t airTime = PayloadAirTime(payloadLength);
     int32_t calculatedStartTime = windowEndTime - airTime;
-    Serial.Printf("          Start of preamble (calculated): %ld\r\n", calculatedStartTime);
+    int32_t marginStart = calculatedStartTime + PreambleMargin() - windowStartTime - RX_RAMP_UP_TIME;
 
-    // Ramp-up time is not known but assumed to be 300us.
-    int32_t marginStart = calculatedStartTime + SymbolDuration(preambleLength - MIN_RX_SYMBOLS) - windowStartTime - 300;
-    Serial.Printf("          Margin: start = %ldus\r\n", marginStart);
+    sampleOutput.RxAnalysis(Modulation(rxFrequency), payloadLength, airTime, windowEndTime, marginStart);
+    return marginStart;
 }
 
-void TimingAnalyzer::PrintTimeoutAnalysis(int32_t windowStartTime, int32_t windowEndTime)
+int32_t TimingAnalyzer::PrintTimeoutAnalysis(int32_t windowStartTime, int32_t windowEndTime, bool isRx2)
 {
-    // Round to nearest second
-    int32_t expectedStartTime = (windowStartTime + 500000) / 1000000 * 1000000;
+    int32_t expectedStartTime = ExpectedWindowStart(windowStartTime, isRx2);
 
     // The receiver listens for a downlink packet for a given time (timeout window).
     // If a packet preamble is detected during that time, it continues to recieve
@@ -185,74 +238,213 @@ void TimingAnalyzer::PrintTimeoutAnalysis(int32_t windowStartTime, int32_t windo
     // The optimal timeout window is positioned such that the middle of the window
     // aligns with the middle of the expected preamble. That way the margin for timing
     // errors is the same at the start and the end of the window.
-    int32_t timeoutLength = SymbolDuration(numTimeoutSymbols);
-    int32_t ramupDuration = windowEndTime - windowStartTime - timeoutLength;
-    int32_t marginStart = expectedStartTime + SymbolDuration(preambleLength - MIN_RX_SYMBOLS) - windowStartTime - ramupDuration;
-    int32_t marginEnd = windowEndTime - (expectedStartTime + SymbolDuration(MIN_RX_SYMBOLS));
+    // In FSK mode, the window is ended by the MCU; the ramp-up time is assumed.
+    int32_t timeoutLength;
+    int32_t preambleDuration;
+    if (longRangeMode == LongrangeModeLora)
+    {
+        timeoutLength = rxTimeoutDuration != 0 ? rxTimeoutDuration : SymbolDuration(numTimeoutSymbols);
+        preambleDuration = SymbolDuration(preambleLength);
+    }
+    else
+    {
+        timeoutLength = windowEndTime - windowStartTime - RX_RAMP_UP_TIME;
+        preambleDuration = FskByteDuration(fskPreambleLength);
+    }
 
-    Serial.Printf("          SF%d, %lu Hz, airtime = %ldus, ramp-up = %ldus\r\n",
-            spreadingFactor, bandwidth, timeoutLength, ramupDuration);
+    int32_t ramupDuration = windowEndTime - windowStartTime - timeoutLength;
+    int32_t marginStart = expectedStartTime + PreambleMargin() - windowStartTime - ramupDuration;
+    int32_t marginEnd = windowEndTime - (expectedStartTime + PreambleDetectionTime());
 
-    int32_t optimumEndTime = expectedStartTime + (SymbolDuration(preambleLength) + timeoutLength) / 2;
+    int32_t optimumEndTime = expectedStartTime + (preambleDuration + timeoutLength) / 2;
     int32_t corr = windowEndTime - optimumEndTime;
 
-    Serial.Printf("          Margin: start = %ldus, end = %ldus\r\n", marginStart, marginEnd);
-    Serial.Printf("          Correction for optimum RX window: %ldus\r\n", corr);
+    sampleOutput.TimeoutAnalysis(Modulation(rxFrequency), timeoutLength, ramupDuration, marginStart, marginEnd, corr);
+    return marginStart < marginEnd ? marginStart : marginEnd;
 }
 
 
-void TimingAnalyzer::PrintParameters(int32_t duration, int payloadLength)
+void TimingAnalyzer::SetTxFrame(const LoraWanFrame *frame)
 {
-    int32_t airTime = PayloadAirTime(payloadLength);
-    int32_t rampupTime = duration - airTime;
-
-    if (longRangeMode == LongrangeModeLora) {
-        Serial.Printf("          SF%d, %lu Hz, payload = %d bytes, airtime = %ldus, ramp-up = %ldus\r\n",
-                spreadingFactor, bandwidth, payloadLength, airTime, rampupTime);
-    } else {
-        Serial.Printf("          FSK, %lu Hz, payload = %d bytes, airtime = %ldus, ramp-up = %ldus\r\n",
-                bandwidth, payloadLength, airTime, rampupTime);
+    hasTxFrame = frame != nullptr;
+    if (hasTxFrame)
+        txFrame = *frame;
+}
+
+// Determines the RX delay of the current cycle (called at the end of the uplink).
+// The RX delay of data frames is set by the join accept or by a RXTimingSetupReq.
+// Both are not visible to the probe (the join accept is encrypted and downlink
+// data cannot be recorded). So the delay is derived from the first RX window
+// and then kept until the device joins again or confirms a new setting.
+void TimingAnalyzer::UpdateRxDelay()
+{
+    cycleRxDelay = 0;
+    if (!hasTxFrame)
+        return;
+
+    if (txFrame.mType == LoraWanJoinRequest)
+    {
+        cycleRxDelay = LORAWAN_JOIN_ACCEPT_DELAY1;
+        rxDelay = 0;
+    }
+    else if (txFrame.IsDataFrame())
+    {
+        if (txFrame.HasMacCommand(LORAWAN_CID_RX_TIMING_SETUP))
+            rxDelay = 0;
+        cycleRxDelay = rxDelay;
     }
 }
 
-void TimingAnalyzer::OnRxTxCompleted()
+void TimingAnalyzer::LearnRxDelay(int32_t windowStartTime, bool isRx2)
 {
-    stage = LoraStageIdle;
-    result = LoraResultNoDownlink;
+    if (cycleRxDelay != 0 || !hasTxFrame || !txFrame.IsDataFrame())
+        return;
+
+    // Round to nearest second
+    int32_t delay = (windowStartTime + 500000) / 1000000 * 1000000;
+    if (isRx2)
+        delay -= LORAWAN_RX2_OFFSET;
+    if (delay < LORAWAN_RECEIVE_DELAY1)
+        delay = LORAWAN_RECEIVE_DELAY1;
+
+    cycleRxDelay = delay;
+    rxDelay = delay;
+}
+
+// Expected start of the RX window (relative to the end of the uplink)
+int32_t TimingAnalyzer::ExpectedWindowStart(int32_t windowStartTime, bool isRx2)
+{
+    // Without LoRaWAN information: round to nearest second
+    if (cycleRxDelay == 0)
+        return (windowStartTime + 500000) / 1000000 * 1000000;
+
+    return isRx2 ? cycleRxDelay + LORAWAN_RX2_OFFSET : cycleRxDelay;
 }
 
-void TimingAnalyzer::PrintRelativeTimestamp(int32_t timestamp)
+void TimingAnalyzer::PrintParameters(int32_t txStartTime, int payloadLength)
 {
-    Serial.Printf(TIMESTAMP_PATTERN, timestamp);
+    int32_t airTime = PayloadAirTime(payloadLength);
+    int32_t rampupTime = -txStartTime - airTime;
+
+    sampleOutput.TxDone(txStartTime, Modulation(txFrequency), payloadLength, airTime, rampupTime);
 }
 
-void TimingAnalyzer::OutOfSync(const char *stage)
+void TimingAnalyzer::PrintPayloadLengthCheck()
+{
+    // In FSK variable length mode, the length is taken from the FIFO anyway
+    if (txFifoLength < 0 || (longRangeMode == LongrangeModeFSK && fskVariableLength))
+        return;
+
+    int configuredLength = ConfiguredTxPayloadLength();
+    int fifoLength = TxPayloadLength();
+    if (configuredLength != fifoLength)
+        sampleOutput.PayloadLengthMismatch(configuredLength, fifoLength);
+}
+
+int TimingAnalyzer::ConfiguredTxPayloadLength()
+{
+    return longRangeMode == LongrangeModeLora ? txPayloadLength : fskPayloadLength;
+}
+
+int TimingAnalyzer::TxPayloadLength()
+{
+    if (txFifoLength < 0)
+        return ConfiguredTxPayloadLength();
+
+    if (longRangeMode == LongrangeModeLora)
+        return txFifoLength;
+
+    // FSK: the FIFO also contains the length byte and the address byte
+    int length = txFifoLength;
+    if (fskVariableLength)
+        length -= 1;
+    if (fskAddressFiltering)
+        length -= 1;
+    return length > 0 ? length : 0;
+}
+
+ModulationInfo TimingAnalyzer::Modulation(uint32_t channelFrequency)
+{
+    ModulationInfo modulation;
+    modulation.longRangeMode = longRangeMode;
+    modulation.spreadingFactor = spreadingFactor;
+    modulation.bandwidthIndex = bandwidthIndex;
+    // bit rate = 512,000,000 / bit period (in 1/512 us)
+    modulation.fskBitRate = (512000000U + fskBitPeriod / 2) / fskBitPeriod;
+    modulation.fskFrequencyDeviation = fskFrequencyDeviation;
+    modulation.frequency = channelFrequency;
+    return modulation;
+}
+
+void TimingAnalyzer::OnRxTxCompleted()
 {
-    Serial.Print("Probe out of sync: ");
-    Serial.Print(stage);
-    Serial.Print("\r\n");
+    stage = LoraStageIdle;
+    result = LoraResultNoDownlink;
+}
 
+void TimingAnalyzer::OutOfSync(const char *stage)
+{
+    sampleOutput.OutOfSync(stage);
     ResetStage();
 }
 
-int32_t TimingAnalyzer::PayloadAirTime(uint8_t payloadLength)
+// Air time in us (LoRa according to Semtech AN1200.13)
+int32_t TimingAnalyzer::PayloadAirTime(int payloadLength)
 {
-    int32_t symbolDuration = (1U << spreadingFactor) * 1000000 / (int32_t)bandwidth;
-    int32_t preambleDuration = (preambleLength + 4) * symbolDuration + symbolDuration / 4;
+    if (longRangeMode == LongrangeModeFSK)
+        return FskAirTime(payloadLength);
 
-    int8_t div = 4 * (spreadingFactor - 2 * lowDataRateOptimization);
-    int32_t numPayloadSymbols = (8 * payloadLength - 4 * spreadingFactor + 44 - 20 * implicitHeader + div - 1) / div;
+    int div = 4 * (spreadingFactor - 2 * lowDataRateOptimization);
+    int numPayloadSymbols = (8 * payloadLength - 4 * spreadingFactor + 28 + 16 * crcOn - 20 * implicitHeader + div - 1) / div;
     numPayloadSymbols *= codingRate;
     if (numPayloadSymbols < 0)
         numPayloadSymbols = 0;
     numPayloadSymbols += 8;
-    int32_t payloadDuration = numPayloadSymbols * symbolDuration;
 
-    return preambleDuration + payloadDuration;
+    // preamble: preamble length + 4.25 symbols (calculated in quarter symbols)
+    uint32_t numQuarterSymbols = 4 * (preambleLength + numPayloadSymbols) + 17;
+    uint64_t duration = (uint64_t)numQuarterSymbols * SYMBOL_DURATION_TABLE[spreadingFactor - 6][bandwidthIndex];
+    return (int32_t)((duration + 512) >> 10);
 }
 
 int32_t TimingAnalyzer::SymbolDuration(int numSymbols)
 {
-    int32_t symbolDuration = (1U << spreadingFactor) * 1000000 / (int32_t)bandwidth;
-    return symbolDuration * numSymbols;
+    int64_t duration = (int64_t)numSymbols * SYMBOL_DURATION_TABLE[spreadingFactor - 6][bandwidthIndex];
+    return (int32_t)((duration + 128) >> 8);
+}
+
+// FSK air time in us: preamble, sync word, length byte (variable length only),
+// address byte (address filtering only), payload and CRC
+int32_t TimingAnalyzer::FskAirTime(int payloadLength)
+{
+    int numBytes = fskPreambleLength + fskSyncSize + payloadLength;
+    if (fskVariableLength)
+        numBytes += 1;
+    if (fskAddressFiltering)
+        numBytes += 1;
+    if (fskCrcOn)
+        numBytes += 2;
+    return FskByteDuration(numBytes);
+}
+
+int32_t TimingAnalyzer::FskByteDuration(int numBytes)
+{
+    int64_t duration = (int64_t)numBytes * 8 * fskBitPeriod;
+    return (int32_t)((duration + 256) >> 9);
+}
+
+int32_t TimingAnalyzer::PreambleMargin()
+{
+    if (longRangeMode == LongrangeModeLora)
+        return SymbolDuration(preambleLength - MIN_RX_SYMBOLS);
+    else
+        return FskByteDuration(fskPreambleLength - fskPreambleDetectSize);
+}
+
+int32_t TimingAnalyzer::PreambleDetectionTime()
+{
+    if (longRangeMode == LongrangeModeLora)
+        return SymbolDuration(MIN_RX_SYMBOLS);
+    else
+        return FskByteDuration(fskPreambleDetectSize);
 }
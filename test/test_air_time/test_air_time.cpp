@@ -0,0 +1,148 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the LoRa air time calculation against the formula
+ * of Semtech AN1200.13 for all combinations of the modulation parameters
+ */
+
+#include "timing_analyzer.h"
+#include <algorithm>
+#include <cmath>
+#include <unity.h>
+
+// Exact bandwidths as fractions of 125 kHz (numerator, denominator),
+// indexed by bandwidth setting
+static const int BANDWIDTH_FRACTIONS[NUM_BANDWIDTHS][2] = {
+    { 1, 16 }, { 1, 12 }, { 1, 8 }, { 1, 6 }, { 1, 4 },
+    { 1, 3 }, { 1, 2 }, { 1, 1 }, { 2, 1 }, { 4, 1 }
+};
+
+static const int PREAMBLE_LENGTHS[] = { 6, 8, 12, 65535 };
+
+static TimingAnalyzer analyzer;
+
+
+// Symbol duration in us: 2^SF / BW
+static double ReferenceSymbolDuration(int sf, int bandwidthIndex)
+{
+    // calculated such that the result is exact
+    return (double)(1 << sf) * 1000000 * BANDWIDTH_FRACTIONS[bandwidthIndex][1]
+            / (125000.0 * BANDWIDTH_FRACTIONS[bandwidthIndex][0]);
+}
+
+// Air time in us according to Semtech AN1200.13
+// (`codingRate` is 1 to 4 for 4/5 to 4/8)
+static double ReferenceAirTime(int sf, int bandwidthIndex, int codingRate, int lowDataRateOptimization,
+        int implicitHeader, int crcOn, int preambleLength, int payloadLength)
+{
+    double symbolDuration = ReferenceSymbolDuration(sf, bandwidthIndex);
+    double preambleDuration = (preambleLength + 4.25) * symbolDuration;
+    double numPayloadSymbols = 8 + std::max(
+            ceil((8.0 * payloadLength - 4 * sf + 28 + 16 * crcOn - 20 * implicitHeader)
+                    / (4 * (sf - 2 * lowDataRateOptimization))) * (codingRate + 4),
+            0.0);
+    return preambleDuration + numPayloadSymbols * symbolDuration;
+}
+
+void setUp()
+{
+    analyzer.SetLongRangeMode(LongrangeModeLora);
+}
+
+void tearDown()
+{
+}
+
+static void test_symbol_duration()
+{
+    for (int sf = 6; sf <= 12; sf++)
+    {
+        analyzer.SetSpreadingFactor(sf);
+        for (int bw = 0; bw < NUM_BANDWIDTHS; bw++)
+        {
+            analyzer.SetBandwidth(bw);
+            double symbolDuration = ReferenceSymbolDuration(sf, bw);
+            TEST_ASSERT_EQUAL_INT32((int32_t)llround(symbolDuration), analyzer.SymbolDuration(1));
+            TEST_ASSERT_EQUAL_INT32((int32_t)llround(symbolDuration * 100), analyzer.SymbolDuration(100));
+        }
+    }
+}
+
+// All spreading factors, bandwidths, coding rates, low data rate optimization,
+// implicit/explicit header, CRC on/off and payload lengths; the result
+// must be the exact air time rounded to the nearest microsecond
+static void test_air_time_all_parameters()
+{
+    int numMismatches = 0;
+    char message[160];
+
+    for (int sf = 6; sf <= 12; sf++)
+    for (int bw = 0; bw < NUM_BANDWIDTHS; bw++)
+    for (int cr = 1; cr <= 4; cr++)
+    for (int ldro = 0; ldro <= 1; ldro++)
+    for (int ih = 0; ih <= 1; ih++)
+    for (int crc = 0; crc <= 1; crc++)
+    for (int preambleLength : PREAMBLE_LENGTHS)
+    {
+        analyzer.SetSpreadingFactor(sf);
+        analyzer.SetBandwidth(bw);
+        analyzer.SetCodingRate(cr + 4);
+        analyzer.SetLowDataRateOptimization(ldro);
+        analyzer.SetImplicitHeader(ih);
+        analyzer.SetCrcOn(crc);
+        analyzer.SetPreambleLength(preambleLength);
+
+        for (int payloadLength = 0; payloadLength <= 255; payloadLength++)
+        {
+            double airTime = ReferenceAirTime(sf, bw, cr, ldro, ih, crc, preambleLength, payloadLength);
+            if (airTime > INT32_MAX)
+                continue;
+
+            int32_t expected = (int32_t)llround(airTime);
+            int32_t result = analyzer.PayloadAirTime(payloadLength);
+            if (result != expected)
+            {
+                if (numMismatches == 0)
+                    snprintf(message, sizeof(message),
+                            "SF%d, BW %d, CR 4/%d, LDRO %d, IH %d, CRC %d, preamble %d, payload %d: expected %ld, was %ld",
+                            sf, bw, cr + 4, ldro, ih, crc, preambleLength, payloadLength, (long)expected, (long)result);
+                numMismatches++;
+            }
+        }
+    }
+
+    if (numMismatches != 0)
+        TEST_FAIL_MESSAGE(message);
+}
+
+// Known values (e.g. from the Semtech LoRa calculator)
+static void test_air_time_examples()
+{
+    // SF7, 125 kHz, CR 4/5, explicit header, CRC on, preamble 8, 13 bytes
+    analyzer.SetSpreadingFactor(7);
+    analyzer.SetBandwidth(7);
+    analyzer.SetCodingRate(5);
+    analyzer.SetLowDataRateOptimization(0);
+    analyzer.SetImplicitHeader(0);
+    analyzer.SetCrcOn(1);
+    analyzer.SetPreambleLength(8);
+    TEST_ASSERT_EQUAL_INT32(46336, analyzer.PayloadAirTime(13));
+
+    // SF12, 125 kHz, CR 4/5, LDRO, explicit header, CRC on, preamble 8, 51 bytes
+    analyzer.SetSpreadingFactor(12);
+    analyzer.SetLowDataRateOptimization(1);
+    TEST_ASSERT_EQUAL_INT32(2465792, analyzer.PayloadAirTime(51));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_symbol_duration);
+    RUN_TEST(test_air_time_all_parameters);
+    RUN_TEST(test_air_time_examples);
+    return UNITY_END();
+}
@@ -0,0 +1,242 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the binary records (COBS framing and varint fields)
+ */
+
+#include "binary_record.h"
+#include <limits.h>
+#include <random>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+
+static std::mt19937 rng(1);
+
+
+// Encodes and decodes the data and checks the framing
+static void CheckCobsRoundTrip(const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> framed(data.size() + data.size() / 254 + 2 + 1, 0xaa);
+    size_t framedLen = CobsEncode(data.data(), data.size(), framed.data());
+
+    // the only 0 byte is the delimiter; the guard byte is untouched
+    TEST_ASSERT_TRUE(framedLen <= data.size() + data.size() / 254 + 2);
+    TEST_ASSERT_EQUAL_HEX8(0xaa, framed[data.size() + data.size() / 254 + 2]);
+    TEST_ASSERT_EQUAL_HEX8(0, framed[framedLen - 1]);
+    for (size_t i = 0; i < framedLen - 1; i++)
+        TEST_ASSERT_TRUE(framed[i] != 0);
+
+    std::vector<uint8_t> decoded(framedLen);
+    int decodedLen = CobsDecode(framed.data(), framedLen - 1, decoded.data());
+    TEST_ASSERT_EQUAL_INT((int)data.size(), decodedLen);
+    TEST_ASSERT_TRUE(memcmp(data.data(), decoded.data(), data.size()) == 0);
+}
+
+// Encodes the value with the writer and reads it back
+template <typename T>
+static T RoundTrip(void (RecordWriter::*put)(T), T (RecordReader::*get)(), T value)
+{
+    RecordWriter writer(RecordText);
+    (writer.*put)(value);
+    RecordReader reader(writer.Data() + 1, writer.Length() - 1);
+    T result = (reader.*get)();
+    TEST_ASSERT_TRUE(reader.IsValid());
+    TEST_ASSERT_EQUAL_UINT32(0, reader.Remaining());
+    return result;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_cobs_examples()
+{
+    const uint8_t data[] = { 0x11, 0x22, 0x00, 0x33 };
+    const uint8_t expected[] = { 0x03, 0x11, 0x22, 0x02, 0x33, 0x00 };
+    uint8_t framed[sizeof(data) + 2];
+    TEST_ASSERT_EQUAL_UINT32(sizeof(expected), CobsEncode(data, sizeof(data), framed));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, framed, sizeof(expected));
+
+    const uint8_t zero[] = { 0x00 };
+    const uint8_t expectedZero[] = { 0x01, 0x01, 0x00 };
+    TEST_ASSERT_EQUAL_UINT32(sizeof(expectedZero), CobsEncode(zero, sizeof(zero), framed));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expectedZero, framed, sizeof(expectedZero));
+
+    TEST_ASSERT_EQUAL_UINT32(2, CobsEncode(data, 0, framed));
+    TEST_ASSERT_EQUAL_HEX8(0x01, framed[0]);
+}
+
+// Runs of non-zero bytes around the maximum block length of 254 bytes,
+// with and without a 0 byte before and after them
+static void test_cobs_long_blocks()
+{
+    for (size_t runLen : { 253, 254, 255, 508, 509 })
+    {
+        for (int zeros = 0; zeros < 4; zeros++)
+        {
+            std::vector<uint8_t> data;
+            if ((zeros & 1) != 0)
+                data.push_back(0);
+            for (size_t i = 0; i < runLen; i++)
+                data.push_back((uint8_t)(1 + i % 255));
+            if ((zeros & 2) != 0)
+                data.push_back(0);
+            CheckCobsRoundTrip(data);
+        }
+    }
+
+    // a full block has no code byte for a 0 byte
+    std::vector<uint8_t> data(254, 0x55);
+    uint8_t framed[254 + 3];
+    TEST_ASSERT_EQUAL_UINT32(257, CobsEncode(data.data(), data.size(), framed));
+    TEST_ASSERT_EQUAL_HEX8(0xff, framed[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, framed[255]);
+}
+
+static void test_cobs_random_data()
+{
+    for (int n = 0; n < 2000; n++)
+    {
+        std::vector<uint8_t> data(rng() % 600);
+        int zeroProbability = 1 + rng() % 300;
+        for (uint8_t &byte : data)
+            byte = (int)(rng() % 1000) < zeroProbability ? 0 : (uint8_t)(1 + rng() % 255);
+        CheckCobsRoundTrip(data);
+    }
+}
+
+static void test_cobs_invalid_input()
+{
+    uint8_t data[16];
+
+    // 0 byte within the frame
+    const uint8_t zeroCode[] = { 0x02, 0x11, 0x00, 0x22 };
+    TEST_ASSERT_EQUAL_INT(-1, CobsDecode(zeroCode, sizeof(zeroCode), data));
+
+    // block longer than the frame
+    const uint8_t truncated[] = { 0x05, 0x11, 0x22 };
+    TEST_ASSERT_EQUAL_INT(-1, CobsDecode(truncated, sizeof(truncated), data));
+    const uint8_t truncatedLastBlock[] = { 0x02, 0x11, 0x03, 0x22 };
+    TEST_ASSERT_EQUAL_INT(-1, CobsDecode(truncatedLastBlock, sizeof(truncatedLastBlock), data));
+
+    TEST_ASSERT_EQUAL_INT(0, CobsDecode(data, 0, data));
+}
+
+static void test_varint_round_trip()
+{
+    const uint32_t unsignedValues[] = { 0, 1, 0x7f, 0x80, 0x3fff, 0x4000, 0xfffffff, 0x10000000, UINT32_MAX };
+    for (uint32_t value : unsignedValues)
+        TEST_ASSERT_EQUAL_UINT32(value, RoundTrip(&RecordWriter::PutVarint, &RecordReader::GetVarint, value));
+
+    const int32_t signedValues[] = { 0, 1, -1, 63, -64, 64, -65, INT32_MAX, INT32_MIN, INT32_MIN + 1 };
+    for (int32_t value : signedValues)
+        TEST_ASSERT_EQUAL_INT32(value, RoundTrip(&RecordWriter::PutSignedVarint, &RecordReader::GetSignedVarint, value));
+
+    for (int i = 0; i < 10000; i++)
+    {
+        int32_t value = (int32_t)rng() >> (rng() % 32);
+        TEST_ASSERT_EQUAL_INT32(value, RoundTrip(&RecordWriter::PutSignedVarint, &RecordReader::GetSignedVarint, value));
+    }
+}
+
+static void test_varint64_round_trip()
+{
+    const uint64_t unsignedValues[] = { 0, 0x7f, 0x80, UINT32_MAX, (uint64_t)UINT32_MAX + 1, UINT64_MAX >> 1, UINT64_MAX };
+    for (uint64_t value : unsignedValues)
+        TEST_ASSERT_TRUE(value == RoundTrip(&RecordWriter::PutVarint64, &RecordReader::GetVarint64, value));
+
+    const int64_t signedValues[] = { 0, 1, -1, INT32_MIN, INT32_MAX, (int64_t)INT32_MIN - 1, INT64_MAX, INT64_MIN, INT64_MIN + 1 };
+    for (int64_t value : signedValues)
+        TEST_ASSERT_TRUE(value == RoundTrip(&RecordWriter::PutSignedVarint64, &RecordReader::GetSignedVarint64, value));
+
+    for (int i = 0; i < 10000; i++)
+    {
+        int64_t value = (int64_t)(((uint64_t)rng() << 32) | rng()) >> (rng() % 64);
+        TEST_ASSERT_TRUE(value == RoundTrip(&RecordWriter::PutSignedVarint64, &RecordReader::GetSignedVarint64, value));
+    }
+}
+
+// Truncated and overlong varints make the record invalid
+static void test_invalid_varints()
+{
+    const uint8_t truncated[] = { 0x80, 0x80 };
+    RecordReader truncatedReader(truncated, sizeof(truncated));
+    truncatedReader.GetVarint();
+    TEST_ASSERT_FALSE(truncatedReader.IsValid());
+
+    const uint8_t overlong[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+    RecordReader overlongReader(overlong, sizeof(overlong));
+    overlongReader.GetVarint();
+    TEST_ASSERT_FALSE(overlongReader.IsValid());
+
+    const uint8_t overlong64[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+    RecordReader overlong64Reader(overlong64, sizeof(overlong64));
+    overlong64Reader.GetVarint64();
+    TEST_ASSERT_FALSE(overlong64Reader.IsValid());
+}
+
+static void test_strings()
+{
+    RecordWriter writer(RecordText);
+    writer.PutString("hello");
+    writer.PutString("");
+    writer.PutString("truncated");
+    writer.PutString("skipped");
+    writer.PutString("x");
+    writer.PutVarint(42);
+
+    RecordReader reader(writer.Data() + 1, writer.Length() - 1);
+    char str[8];
+    reader.GetString(str, sizeof(str));
+    TEST_ASSERT_EQUAL_STRING("hello", str);
+    reader.GetString(str, sizeof(str));
+    TEST_ASSERT_EQUAL_STRING("", str);
+    reader.GetString(str, 6);
+    TEST_ASSERT_EQUAL_STRING("trunc", str);
+
+    // no space: nothing is written
+    memset(str, 'a', sizeof(str));
+    reader.GetString(str, 0);
+    TEST_ASSERT_EQUAL_HEX8('a', str[0]);
+    reader.GetString(str, 1);
+    TEST_ASSERT_EQUAL_STRING("", str);
+
+    TEST_ASSERT_EQUAL_UINT32(42, reader.GetVarint());
+    TEST_ASSERT_TRUE(reader.IsValid());
+    TEST_ASSERT_EQUAL_UINT32(0, reader.Remaining());
+}
+
+// A string longer than the rest of the record makes the record invalid
+static void test_invalid_string()
+{
+    const uint8_t record[] = { 0x05, 'a', 'b' };
+    RecordReader reader(record, sizeof(record));
+    char str[8];
+    reader.GetString(str, sizeof(str));
+    TEST_ASSERT_FALSE(reader.IsValid());
+    TEST_ASSERT_EQUAL_STRING("", str);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_cobs_examples);
+    RUN_TEST(test_cobs_long_blocks);
+    RUN_TEST(test_cobs_random_data);
+    RUN_TEST(test_cobs_invalid_input);
+    RUN_TEST(test_varint_round_trip);
+    RUN_TEST(test_varint64_round_trip);
+    RUN_TEST(test_invalid_varints);
+    RUN_TEST(test_strings);
+    RUN_TEST(test_invalid_string);
+    return UNITY_END();
+}
@@ -0,0 +1,140 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the clock calibration: the integer calculation must
+ * yield the same result as the double-precision calculation
+ */
+
+#include "timing_analyzer.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <random>
+#include <unity.h>
+
+// Measured clock values (in the range allowed for MEASURED_CLOCK), incl. values
+// with an exact binary representation of the factor (where ties occur)
+static const double CLOCKS[] = { 1000, 1000.093, 999.958, 999.31, 1024, 800, 1250, 500.1, 1999.9 };
+#define NUM_CLOCKS (sizeof(CLOCKS) / sizeof(CLOCKS[0]))
+
+// Range of the exhaustive test (16s, longer than any analyzed time difference)
+#define EXHAUSTIVE_RANGE (1 << 24)
+#define NUM_RANDOM_INPUTS 1000000
+
+static std::mt19937 rng(1);
+
+
+// Checks the calibrated time against the double-precision calculation.
+// Inputs with a result that does not fit into 32 bits are skipped.
+// Returns false if the results differ.
+static bool CheckCalibratedTime(double clock, int32_t time)
+{
+    long long expected = llround(time * 1000.0 / clock);
+    if (expected > INT32_MAX || expected < INT32_MIN)
+        return true;
+
+    int32_t result = TimingAnalyzer::CalibratedTime(time, CALIBRATION_FACTOR_FOR(clock));
+    if (result == expected)
+        return true;
+
+    char message[100];
+    snprintf(message, sizeof(message), "clock %.3f, time %ld: expected %lld, was %ld",
+            clock, (long)time, expected, (long)result);
+    TEST_FAIL_MESSAGE(message);
+    return false;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_edge_inputs()
+{
+    static const int32_t INPUTS[] = {
+        0, 1, -1, 2, -2, 499, 500, 501, -500, 999, 1000, 1001, 1000000, -1000000,
+        0x7fffffff, 0x7ffffffe, INT32_MIN, INT32_MIN + 1, 0x40000000, -0x40000000
+    };
+
+    for (size_t c = 0; c < NUM_CLOCKS; c++)
+    {
+        for (int32_t time : INPUTS)
+            CheckCalibratedTime(CLOCKS[c], time);
+
+        // largest inputs with a result fitting into 32 bits
+        int32_t maxTime = (int32_t)std::min(2147483647.0, floor(2147483647.0 * CLOCKS[c] / 1000));
+        for (int32_t i = 0; i < 1000; i++)
+        {
+            CheckCalibratedTime(CLOCKS[c], maxTime - i);
+            CheckCalibratedTime(CLOCKS[c], -maxTime + i);
+        }
+    }
+}
+
+// Results exactly halfway between two integers are rounded away from zero
+static void test_ties_round_away_from_zero()
+{
+    TEST_ASSERT_EQUAL_INT32(3, TimingAnalyzer::CalibratedTime(2, CALIBRATION_FACTOR_FOR(800)));
+    TEST_ASSERT_EQUAL_INT32(-3, TimingAnalyzer::CalibratedTime(-2, CALIBRATION_FACTOR_FOR(800)));
+    TEST_ASSERT_EQUAL_INT32(63, TimingAnalyzer::CalibratedTime(64, CALIBRATION_FACTOR_FOR(1024)));
+    TEST_ASSERT_EQUAL_INT32(-63, TimingAnalyzer::CalibratedTime(-64, CALIBRATION_FACTOR_FOR(1024)));
+}
+
+static void test_random_inputs()
+{
+    for (size_t c = 0; c < NUM_CLOCKS; c++)
+    {
+        for (int i = 0; i < NUM_RANDOM_INPUTS; i++)
+        {
+            // full range and typical time differences (up to 10s)
+            int32_t time = (int32_t)rng();
+            if (!CheckCalibratedTime(CLOCKS[c], time))
+                return;
+            time = (int32_t)(rng() % 20000001) - 10000000;
+            if (!CheckCalibratedTime(CLOCKS[c], time))
+                return;
+        }
+    }
+}
+
+static void test_all_inputs_in_analysis_range()
+{
+    // clocks measured on actual boards
+    static const double MEASURED_CLOCKS[] = { 1000.093, 999.958 };
+
+    for (double clock : MEASURED_CLOCKS)
+    {
+        for (int32_t time = -EXHAUSTIVE_RANGE; time <= EXHAUSTIVE_RANGE; time++)
+        {
+            if (!CheckCalibratedTime(clock, time))
+                return;
+        }
+    }
+}
+
+// The configured calibration factor is used by the single-argument version
+static void test_configured_clock()
+{
+    TEST_ASSERT_EQUAL_INT32(TimingAnalyzer::CalibratedTime(123456789, CALIBRATION_FACTOR_FOR(MEASURED_CLOCK)),
+            TimingAnalyzer::CalibratedTime(123456789));
+    TEST_ASSERT_EQUAL_INT32((int32_t)llround(-123456789 * 1000.0 / MEASURED_CLOCK),
+            TimingAnalyzer::CalibratedTime(-123456789));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_edge_inputs);
+    RUN_TEST(test_ties_round_away_from_zero);
+    RUN_TEST(test_random_inputs);
+    RUN_TEST(test_all_inputs_in_analysis_range);
+    RUN_TEST(test_configured_clock);
+    return UNITY_END();
+}
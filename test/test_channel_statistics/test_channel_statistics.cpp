@@ -0,0 +1,145 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the channel statistics
+ */
+
+#include "channel_statistics.h"
+#include "host_serial.h"
+#include "main.h"
+#include <string>
+#include <unity.h>
+
+static ChannelStatistics *statistics;
+static std::string output;
+
+
+// Frequency of the channel with the given number (200 kHz spacing)
+static uint32_t ChannelFrequency(int channelNo)
+{
+    return 863100000 + channelNo * 200000;
+}
+
+// Statistics line of the channel with the given number
+static std::string ChannelLine(int channelNo, int numUplinks)
+{
+    uint32_t kHz = ChannelFrequency(channelNo) / 1000;
+    char line[120];
+    snprintf(line, sizeof(line), "Channel %lu.%03lu MHz: uplinks: %d, RX1: 0, RX2: 0, timeouts: 0\r\n",
+            (unsigned long)(kHz / 1000), (unsigned long)(kHz % 1000), numUplinks);
+    return line;
+}
+
+static std::string Print()
+{
+    output.clear();
+    statistics->Print();
+    Output.Flush();
+    return output;
+}
+
+void setUp()
+{
+    statistics = new ChannelStatistics();
+    HostSerial.SetCapture(&output);
+}
+
+void tearDown()
+{
+    Output.Flush();
+    HostSerial.SetCapture(nullptr);
+    delete statistics;
+}
+
+static void test_counters()
+{
+    statistics->CountUplink(868100000);
+    statistics->CountDownlink(868100000, false, 100);
+    statistics->CountUplink(868100000);
+    statistics->CountDownlink(869525000, true, 200);
+    statistics->CountUplink(868100000);
+    statistics->CountTimeout(868100000, -40);
+    statistics->CountTimeout(869525000, 50);
+
+    std::string result = Print();
+    TEST_ASSERT_EQUAL_STRING(
+        "Channel 868.100 MHz: uplinks: 3, RX1: 1, RX2: 0, timeouts: 1, mean margin: 30us\r\n"
+        "Channel 869.525 MHz: uplinks: 0, RX1: 0, RX2: 1, timeouts: 1, mean margin: 125us\r\n",
+        result.c_str());
+}
+
+// The mean margin is the sum of all margins divided by their number
+// (truncated towards zero)
+static void test_mean_margin()
+{
+    statistics->CountDownlink(868100000, false, -100);
+    statistics->CountTimeout(868100000, -51);
+    statistics->CountDownlink(868300000, false, 1000000);
+    statistics->CountDownlink(868300000, true, 1000000);
+    statistics->CountDownlink(868300000, false, 1000001);
+
+    std::string result = Print();
+    TEST_ASSERT_EQUAL_STRING(
+        "Channel 868.100 MHz: uplinks: 0, RX1: 1, RX2: 0, timeouts: 1, mean margin: -75us\r\n"
+        "Channel 868.300 MHz: uplinks: 0, RX1: 2, RX2: 1, timeouts: 0, mean margin: 1000000us\r\n",
+        result.c_str());
+}
+
+// An unknown frequency (0) is not counted
+static void test_unknown_frequency()
+{
+    statistics->CountUplink(0);
+    statistics->CountTimeout(0, 10);
+    TEST_ASSERT_EQUAL_STRING("", Print().c_str());
+}
+
+// Each channel of a full table (with colliding hash values) has its
+// own counters; the channels are printed in the order of first use
+static void test_full_table()
+{
+    // channel i gets i + 1 uplinks, interleaved
+    for (int round = 0; round < NUM_CHANNEL_SLOTS; round++)
+        for (int i = NUM_CHANNEL_SLOTS - 1; i >= round; i--)
+            statistics->CountUplink(ChannelFrequency(NUM_CHANNEL_SLOTS - 1 - i));
+
+    std::string expected;
+    for (int i = 0; i < NUM_CHANNEL_SLOTS; i++)
+        expected += ChannelLine(i, NUM_CHANNEL_SLOTS - i);
+    std::string result = Print();
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), result.c_str());
+}
+
+// Events of channels that no longer fit into the table are counted
+// as untracked; the existing channels are still counted
+static void test_table_overflow()
+{
+    for (int i = 0; i < NUM_CHANNEL_SLOTS; i++)
+        statistics->CountUplink(ChannelFrequency(i));
+
+    statistics->CountUplink(ChannelFrequency(NUM_CHANNEL_SLOTS));
+    statistics->CountDownlink(ChannelFrequency(NUM_CHANNEL_SLOTS), false, 100);
+    statistics->CountTimeout(ChannelFrequency(NUM_CHANNEL_SLOTS + 1), 100);
+    statistics->CountUplink(ChannelFrequency(NUM_CHANNEL_SLOTS - 1));
+
+    std::string expected;
+    for (int i = 0; i < NUM_CHANNEL_SLOTS; i++)
+        expected += ChannelLine(i, i == NUM_CHANNEL_SLOTS - 1 ? 2 : 1);
+    expected += "Channel table full - 3 events not counted\r\n";
+    std::string result = Print();
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), result.c_str());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_counters);
+    RUN_TEST(test_mean_margin);
+    RUN_TEST(test_unknown_frequency);
+    RUN_TEST(test_full_table);
+    RUN_TEST(test_table_overflow);
+    return UNITY_END();
+}
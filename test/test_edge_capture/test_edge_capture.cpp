@@ -0,0 +1,244 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the extension of the 16-bit capture values to 64 bit
+ * and the merging of the edges, including a simulation of the
+ * free-running capture timer and its interrupt handler
+ */
+
+#include "edge_capture.h"
+#include <random>
+#include <unity.h>
+#include <vector>
+
+#define NUM_CHANNELS 3
+// Timer period (in ticks)
+#define TIMER_PERIOD 0x10000ULL
+// Maximum interrupt latency (in ticks), just below half a timer period (4ms)
+#define MAX_LATENCY 32000
+
+static std::mt19937 rng(1);
+
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_extend_without_overflow()
+{
+    EdgeCapture capture;
+    TEST_ASSERT_EQUAL_UINT64(0x1234, capture.Extend(0x1234, false));
+    TEST_ASSERT_EQUAL_UINT64(0xfedc, capture.Extend(0xfedc, false));
+
+    capture.OnOverflow();
+    capture.OnOverflow();
+    TEST_ASSERT_EQUAL_UINT64(0x21234, capture.Extend(0x1234, false));
+}
+
+static void test_extend_with_pending_overflow()
+{
+    EdgeCapture capture;
+    capture.OnOverflow();
+
+    // captured after the overflow
+    TEST_ASSERT_EQUAL_UINT64(0x20000, capture.Extend(0x0000, true));
+    TEST_ASSERT_EQUAL_UINT64(0x27fff, capture.Extend(0x7fff, true));
+    // captured before the overflow
+    TEST_ASSERT_EQUAL_UINT64(0x18000, capture.Extend(0x8000, true));
+    TEST_ASSERT_EQUAL_UINT64(0x1ffff, capture.Extend(0xffff, true));
+}
+
+static void test_merge_sorts_across_overflow()
+{
+    EdgeCapture capture;
+    EdgeCapture::Edge edges[] = { { 0, 0x0010 }, { 1, 0xfff0 }, { 2, 0x0008 } };
+    EdgeCapture::TimedEdge result[3];
+
+    TEST_ASSERT_EQUAL_UINT32(3, capture.Merge(edges, 3, true, result));
+    TEST_ASSERT_EQUAL_UINT8(1, result[0].channel);
+    TEST_ASSERT_EQUAL_UINT64(0xfff0, result[0].ticks);
+    TEST_ASSERT_EQUAL_UINT8(2, result[1].channel);
+    TEST_ASSERT_EQUAL_UINT64(0x10008, result[1].ticks);
+    TEST_ASSERT_EQUAL_UINT8(0, result[2].channel);
+    TEST_ASSERT_EQUAL_UINT64(0x10010, result[2].ticks);
+}
+
+static void test_ticks_to_micros()
+{
+    TEST_ASSERT_EQUAL_UINT64(0, EdgeCapture::TicksToMicros(7));
+    TEST_ASSERT_EQUAL_UINT64(1, EdgeCapture::TicksToMicros(8));
+    TEST_ASSERT_EQUAL_UINT64(0x200000000ULL, EdgeCapture::TicksToMicros(0x1000000000ULL));
+}
+
+// Simulated input capture timer with three channels and its interrupt
+// handler, which runs with a random latency after the first flag is set
+class CaptureSimulation
+{
+public:
+    // Runs the simulation with the given edges (true time in ticks, sorted)
+    void Run(const std::vector<EdgeCapture::TimedEdge> &edges)
+    {
+        size_t nextEdge = 0;
+        uint64_t nextOverflow = TIMER_PERIOD;
+
+        while (nextEdge < edges.size() || isIrqPending)
+        {
+            uint64_t edgeTime = nextEdge < edges.size() ? edges[nextEdge].ticks : UINT64_MAX;
+            uint64_t irqTime = isIrqPending ? irqRunTime : UINT64_MAX;
+
+            if (irqTime <= edgeTime && irqTime <= nextOverflow)
+            {
+                RunIrqHandler();
+            }
+            else if (edgeTime <= nextOverflow)
+            {
+                Capture(edges[nextEdge]);
+                nextEdge++;
+            }
+            else
+            {
+                isOverflowFlagSet = true;
+                TriggerIrq(nextOverflow);
+                nextOverflow += TIMER_PERIOD;
+            }
+        }
+    }
+
+    // Edges reported by the interrupt handler
+    std::vector<EdgeCapture::TimedEdge> reported;
+    // Edges that have been expected (edges overwritten before
+    // the interrupt handler read them are lost)
+    std::vector<EdgeCapture::TimedEdge> expected;
+
+private:
+    void Capture(const EdgeCapture::TimedEdge &edge)
+    {
+        captured[edge.channel] = edge;
+        isCaptured[edge.channel] = true;
+        TriggerIrq(edge.ticks);
+    }
+
+    void TriggerIrq(uint64_t time)
+    {
+        if (isIrqPending)
+            return;
+        isIrqPending = true;
+        irqRunTime = time + rng() % (MAX_LATENCY + 1);
+    }
+
+    // Same logic as the capture interrupt handler in main.cpp
+    void RunIrqHandler()
+    {
+        EdgeCapture::Edge edges[NUM_CHANNELS];
+        size_t numEdges = 0;
+        for (uint8_t ch = 0; ch < NUM_CHANNELS; ch++)
+        {
+            if (isCaptured[ch])
+            {
+                edges[numEdges++] = { ch, (uint16_t)captured[ch].ticks };
+                isCaptured[ch] = false;
+                InsertExpected(captured[ch]);
+            }
+        }
+
+        bool overflowPending = isOverflowFlagSet;
+        EdgeCapture::TimedEdge timedEdges[NUM_CHANNELS];
+        size_t n = edgeCapture.Merge(edges, numEdges, overflowPending, timedEdges);
+        if (overflowPending)
+        {
+            isOverflowFlagSet = false;
+            edgeCapture.OnOverflow();
+        }
+
+        reported.insert(reported.end(), timedEdges, timedEdges + n);
+        isIrqPending = false;
+    }
+
+    // The expected edges of a single handler run are in chronological order
+    void InsertExpected(const EdgeCapture::TimedEdge &edge)
+    {
+        auto it = expected.end();
+        while (it != expected.begin() && (it - 1)->ticks > edge.ticks)
+            --it;
+        expected.insert(it, edge);
+    }
+
+    EdgeCapture edgeCapture;
+    EdgeCapture::TimedEdge captured[NUM_CHANNELS];
+    bool isCaptured[NUM_CHANNELS] = { false, false, false };
+    bool isOverflowFlagSet = false;
+    bool isIrqPending = false;
+    uint64_t irqRunTime = 0;
+};
+
+// Generates random edges with gaps from a few ticks to several timer periods,
+// running past 2^32 ticks so the upper 32 bits of the time are used as well
+static std::vector<EdgeCapture::TimedEdge> GenerateEdges(uint64_t endTime)
+{
+    std::vector<EdgeCapture::TimedEdge> edges;
+    uint64_t time = 0;
+    while (true)
+    {
+        uint32_t r = rng();
+        switch (r % 4)
+        {
+        case 0:
+            time += r % 64; // bursts
+            break;
+        case 1:
+            time += r % 40000; // around half a timer period
+            break;
+        case 2:
+            time += 0x8000 - 20 + r % 40; // exactly around half a timer period
+            break;
+        default:
+            time += r % (3 * TIMER_PERIOD);
+            break;
+        }
+        if (time >= endTime)
+            break;
+
+        edges.push_back({ (uint8_t)(rng() % NUM_CHANNELS), time });
+    }
+    return edges;
+}
+
+static void test_simulated_capture_timer()
+{
+    std::vector<EdgeCapture::TimedEdge> edges = GenerateEdges(0x100000000ULL + 100 * TIMER_PERIOD);
+    CaptureSimulation simulation;
+    simulation.Run(edges);
+
+    const std::vector<EdgeCapture::TimedEdge> &reported = simulation.reported;
+    const std::vector<EdgeCapture::TimedEdge> &expected = simulation.expected;
+    TEST_ASSERT_TRUE(expected.size() > edges.size() / 2);
+    TEST_ASSERT_EQUAL_UINT32(expected.size(), reported.size());
+    for (size_t i = 0; i < reported.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(expected[i].channel, reported[i].channel);
+        TEST_ASSERT_EQUAL_UINT64(expected[i].ticks, reported[i].ticks);
+        if (i > 0)
+            TEST_ASSERT_TRUE(reported[i - 1].ticks <= reported[i].ticks);
+    }
+
+    TEST_ASSERT_TRUE(reported.back().ticks > 0x100000000ULL);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_extend_without_overflow);
+    RUN_TEST(test_extend_with_pending_overflow);
+    RUN_TEST(test_merge_sorts_across_overflow);
+    RUN_TEST(test_ticks_to_micros);
+    RUN_TEST(test_simulated_capture_timer);
+    return UNITY_END();
+}
@@ -0,0 +1,190 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Recorded events of 4 LMIC TX/RX cycles without downlink
+ * (SX127x, SF7 uplink, RX1 and RX2 timeout), 42 events per cycle
+ */
+
+#ifndef LMIC_TRACE_H
+#define LMIC_TRACE_H
+
+#define LMIC_TRACE_EVENTS_PER_CYCLE 42
+// Duration of a cycle (in us)
+#define LMIC_TRACE_CYCLE_INTERVAL 5000000
+
+static const char LMIC_TRACE[] = R"(
+1000000 SPI 81 80
+1000060 SPI 86 d9 06 66
+1000120 SPI 9d 72
+1000180 SPI 9e 74
+1000240 SPI a6 04
+1000300 SPI a0 00
+1000360 SPI a1 08
+1000420 SPI a2 0d
+1000480 SPI c0 40
+1000540 SPI 8e 80
+1000600 SPI 8d 80
+1000660 SPI 80 40 78 56 34 12 00 00 00 01 c0 90 81 cc
+1000720 SPI 81 83
+1047114 DIO0
+1047174 SPI 81 80
+1047234 SPI 92 ff
+2044399 SPI 81 80
+2044459 SPI 86 d9 06 66
+2044519 SPI 9d 72
+2044579 SPI 9e 70
+2044639 SPI a6 04
+2044699 SPI 9f 08
+2044759 SPI a0 00
+2044819 SPI a1 08
+2044879 SPI a2 40
+2044939 SPI c0 00
+2045059 SPI 81 86
+2053278 DIO1
+2053338 SPI 81 80
+2980903 SPI 81 80
+2980963 SPI 86 d9 61 9a
+2981023 SPI 9d 72
+2981083 SPI 9e c0
+2981143 SPI a6 0c
+2981203 SPI 9f 08
+2981263 SPI a0 00
+2981323 SPI a1 08
+2981383 SPI a2 40
+2981443 SPI c0 00
+2981563 SPI 81 86
+3243741 DIO1
+3243801 SPI 81 80
+6000000 SPI 81 80
+6000060 SPI 86 d9 13 33
+6000120 SPI 9d 72
+6000180 SPI 9e 74
+6000240 SPI a6 04
+6000300 SPI a0 00
+6000360 SPI a1 08
+6000420 SPI a2 0d
+6000480 SPI c0 40
+6000540 SPI 8e 80
+6000600 SPI 8d 80
+6000660 SPI 80 40 78 56 34 12 00 01 00 01 9d 8e 32 44
+6000720 SPI 81 83
+6047114 DIO0
+6047174 SPI 81 80
+6047234 SPI 92 ff
+7044403 SPI 81 80
+7044463 SPI 86 d9 13 33
+7044523 SPI 9d 72
+7044583 SPI 9e 70
+7044643 SPI a6 04
+7044703 SPI 9f 08
+7044763 SPI a0 00
+7044823 SPI a1 08
+7044883 SPI a2 40
+7044943 SPI c0 00
+7045063 SPI 81 86
+7053311 DIO1
+7053371 SPI 81 80
+7980926 SPI 81 80
+7980986 SPI 86 d9 61 9a
+7981046 SPI 9d 72
+7981106 SPI 9e c0
+7981166 SPI a6 0c
+7981226 SPI 9f 08
+7981286 SPI a0 00
+7981346 SPI a1 08
+7981406 SPI a2 40
+7981466 SPI c0 00
+7981586 SPI 81 86
+8243783 DIO1
+8243843 SPI 81 80
+11000000 SPI 81 80
+11000060 SPI 86 d9 20 00
+11000120 SPI 9d 72
+11000180 SPI 9e 74
+11000240 SPI a6 04
+11000300 SPI a0 00
+11000360 SPI a1 08
+11000420 SPI a2 0d
+11000480 SPI c0 40
+11000540 SPI 8e 80
+11000600 SPI 8d 80
+11000660 SPI 80 40 78 56 34 12 00 02 00 01 39 01 80 3c
+11000720 SPI 81 83
+11047088 DIO0
+11047148 SPI 81 80
+11047208 SPI 92 ff
+12044371 SPI 81 80
+12044431 SPI 86 d9 20 00
+12044491 SPI 9d 72
+12044551 SPI 9e 70
+12044611 SPI a6 04
+12044671 SPI 9f 08
+12044731 SPI a0 00
+12044791 SPI a1 08
+12044851 SPI a2 40
+12044911 SPI c0 00
+12045031 SPI 81 86
+12053269 DIO1
+12053329 SPI 81 80
+12980883 SPI 81 80
+12980943 SPI 86 d9 61 9a
+12981003 SPI 9d 72
+12981063 SPI 9e c0
+12981123 SPI a6 0c
+12981183 SPI 9f 08
+12981243 SPI a0 00
+12981303 SPI a1 08
+12981363 SPI a2 40
+12981423 SPI c0 00
+12981543 SPI 81 86
+13243742 DIO1
+13243802 SPI 81 80
+16000000 SPI 81 80
+16000060 SPI 86 d9 06 66
+16000120 SPI 9d 72
+16000180 SPI 9e 74
+16000240 SPI a6 04
+16000300 SPI a0 00
+16000360 SPI a1 08
+16000420 SPI a2 0d
+16000480 SPI c0 40
+16000540 SPI 8e 80
+16000600 SPI 8d 80
+16000660 SPI 80 40 78 56 34 12 00 03 00 01 39 03 c4 18
+16000720 SPI 81 83
+16047111 DIO0
+16047171 SPI 81 80
+16047231 SPI 92 ff
+17044393 SPI 81 80
+17044453 SPI 86 d9 06 66
+17044513 SPI 9d 72
+17044573 SPI 9e 70
+17044633 SPI a6 04
+17044693 SPI 9f 08
+17044753 SPI a0 00
+17044813 SPI a1 08
+17044873 SPI a2 40
+17044933 SPI c0 00
+17045053 SPI 81 86
+17053285 DIO1
+17053345 SPI 81 80
+17980925 SPI 81 80
+17980985 SPI 86 d9 61 9a
+17981045 SPI 9d 72
+17981105 SPI 9e c0
+17981165 SPI a6 0c
+17981225 SPI 9f 08
+17981285 SPI a0 00
+17981345 SPI a1 08
+17981405 SPI a2 40
+17981465 SPI c0 00
+17981585 SPI 81 86
+18243767 DIO1
+18243827 SPI 81 80
+)";
+
+#endif
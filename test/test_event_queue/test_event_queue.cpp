@@ -0,0 +1,187 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the event queue overflow handling:
+ * a recorded trace is replayed while the main loop is stalled
+ * so the queue overflows.
+ */
+
+#include "event_processor.h"
+#include "host_capture.h"
+#include "host_serial.h"
+#include "lmic_trace.h"
+#include "main.h"
+#include "replay.h"
+#include <string>
+#include <unity.h>
+#include <vector>
+
+struct TraceEvent
+{
+    uint64_t time;
+    RecordedEventType type;
+    std::vector<uint8_t> data;
+};
+
+static std::vector<TraceEvent> trace;
+static std::string output;
+// Offset added to the trace time so each test continues where the previous one stopped
+static uint64_t timeOffset = 0;
+
+
+static void AddTraceEvent(const RecordedEvent &event, void *)
+{
+    trace.push_back({ event.time, event.type, std::vector<uint8_t>(event.data, event.data + event.len) });
+}
+
+// Simulates the interrupt handler(s) of the given trace event
+static void QueueTraceEvent(size_t index)
+{
+    const TraceEvent &event = trace[index];
+    uint64_t time = event.time + timeOffset;
+    if (event.type == RecordedEventSpi)
+        SimulateSpiTrx(time, event.data.data(), event.data.size());
+    else
+        SimulateDioEdge(event.type == RecordedEventDio0 ? 0 : 1, time);
+}
+
+// Queues the trace events [start, end) without running the main loop
+static void QueueTraceEvents(size_t start, size_t end)
+{
+    for (size_t i = start; i < end; i++)
+        QueueTraceEvent(i);
+}
+
+// Queues the trace events [start, end) and processes each one right away
+static void ReplayTraceEvents(size_t start, size_t end)
+{
+    for (size_t i = start; i < end; i++)
+    {
+        QueueTraceEvent(i);
+        ProcessEvents();
+    }
+}
+
+static size_t CycleStart(int cycle)
+{
+    return cycle * LMIC_TRACE_EVENTS_PER_CYCLE;
+}
+
+static int CountOccurrences(const std::string &text, const char *str)
+{
+    int count = 0;
+    size_t pos = 0;
+    while ((pos = text.find(str, pos)) != std::string::npos)
+    {
+        count++;
+        pos++;
+    }
+    return count;
+}
+
+// Checks that the output contains the complete analysis of the uplink
+// with the given frame counter (TX, RX1 and RX2 timeout)
+static void AssertCompleteSample(int fCnt)
+{
+    char header[40];
+    snprintf(header, sizeof(header), "(FCnt %d)  --------\r\n", fCnt);
+    size_t sampleStart = output.find(header);
+    TEST_ASSERT_TRUE_MESSAGE(sampleStart != std::string::npos, header);
+
+    size_t sampleEnd = output.find("--------  Sample", sampleStart + 1);
+    std::string sample = output.substr(sampleStart, sampleEnd - sampleStart);
+    TEST_ASSERT_EQUAL_INT(1, CountOccurrences(sample, ": TX done"));
+    TEST_ASSERT_EQUAL_INT(1, CountOccurrences(sample, ": RX1 timeout"));
+    TEST_ASSERT_EQUAL_INT(1, CountOccurrences(sample, ": RX2 timeout"));
+    TEST_ASSERT_EQUAL_INT(2, CountOccurrences(sample, "Margin: start = "));
+}
+
+void setUp()
+{
+    output.clear();
+    HostSerial.SetCapture(&output);
+}
+
+void tearDown()
+{
+    Output.Flush();
+    HostSerial.SetCapture(nullptr);
+    timeOffset += 4 * LMIC_TRACE_CYCLE_INTERVAL;
+}
+
+static void test_trace_without_overflow()
+{
+    ReplayTraceEvents(0, trace.size());
+
+    TEST_ASSERT_EQUAL_INT(0, CountOccurrences(output, "Event queue overflow"));
+    for (int fCnt = 0; fCnt < 4; fCnt++)
+        AssertCompleteSample(fCnt);
+}
+
+// The main loop stalls during the second cycle so the events of RX1 are lost
+static void test_overflow_is_reported_and_analysis_recovers()
+{
+    ReplayTraceEvents(CycleStart(0), CycleStart(1));
+
+    // TX and RX1 of the second cycle (29 events) while the main loop is stalled
+    size_t stallEnd = CycleStart(1) + 29;
+    QueueTraceEvents(CycleStart(1), stallEnd);
+    ProcessEvents();
+
+    ReplayTraceEvents(stallEnd, trace.size());
+
+    TEST_ASSERT_EQUAL_INT(1, CountOccurrences(output, "Event queue overflow"));
+    TEST_ASSERT_EQUAL_INT(1, CountOccurrences(output, "Event queue overflow - 13 events dropped\r\n"));
+    AssertCompleteSample(0);
+    AssertCompleteSample(2);
+    AssertCompleteSample(3);
+    // no RX1 analysis from events on either side of the gap
+    TEST_ASSERT_EQUAL_INT(3, CountOccurrences(output, ": RX1 timeout"));
+}
+
+// Events are dropped again after the gap marker has been queued but before
+// it has been processed. Each gap must be reported with its own count.
+static void test_overflow_before_gap_is_processed()
+{
+    ReplayTraceEvents(CycleStart(0), CycleStart(1));
+
+    // 20 events while stalled: 16 queued, 4 dropped
+    size_t pos = CycleStart(1);
+    QueueTraceEvents(pos, pos + 20);
+    pos += 20;
+
+    // the main loop processes a single event, making room for the gap marker;
+    // the next event is dropped again, followed by 8 more
+    TEST_ASSERT_TRUE(ProcessNextEvent());
+    QueueTraceEvents(pos, pos + 9);
+    pos += 9;
+
+    CompleteBatch(1);
+    ProcessEvents();
+    ReplayTraceEvents(pos, trace.size());
+
+    TEST_ASSERT_EQUAL_INT(2, CountOccurrences(output, "Event queue overflow"));
+    size_t first = output.find("Event queue overflow - 4 events dropped\r\n");
+    size_t second = output.find("Event queue overflow - 9 events dropped\r\n");
+    TEST_ASSERT_TRUE(first != std::string::npos);
+    TEST_ASSERT_TRUE(second != std::string::npos);
+    TEST_ASSERT_TRUE(first < second);
+    AssertCompleteSample(2);
+    AssertCompleteSample(3);
+}
+
+int main()
+{
+    if (!ReadEventText(LMIC_TRACE, AddTraceEvent, nullptr))
+        return 1;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_trace_without_overflow);
+    RUN_TEST(test_overflow_is_reported_and_analysis_recovers);
+    RUN_TEST(test_overflow_before_gap_is_processed);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the formatting code: the format strings of all
+ * call sites (collected from the section "fmtstr") must produce
+ * the same text as snprintf.
+ */
+
+#include "binary_record.h"
+#include "format.h"
+#include "format_samples.h"
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unity.h>
+
+#define TEXT_BUF_LEN 256
+
+// Checks that the sample produces the same text with both implementations
+static void AssertSampleMatchesSnprintf(const FormatSample &sample)
+{
+    TEST_ASSERT_TRUE_MESSAGE(sample.argType != FormatSample::ArgUnsupported, sample.fmt.c_str());
+
+    char text[TEXT_BUF_LEN];
+    char expected[TEXT_BUF_LEN];
+    size_t len = sample.Format(text, sizeof(text));
+    size_t expectedLen = sample.Reference(expected, sizeof(expected));
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, text, sample.fmt.c_str());
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(expectedLen, len, sample.fmt.c_str());
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// The section contains the format strings of the call sites in src/
+static void test_call_sites_are_collected()
+{
+    std::vector<const char *> formats = CollectFormatStrings();
+    TEST_ASSERT_TRUE(formats.size() >= 20);
+
+    bool found = false;
+    for (const char *fmt : formats)
+        found = found || strcmp(fmt, "Event queue overflow - %lu events dropped\r\n") == 0;
+    TEST_ASSERT_TRUE(found);
+}
+
+static void test_call_sites_match_snprintf()
+{
+    std::vector<FormatSample> samples = CreateFormatSamples(CollectFormatStrings());
+    TEST_ASSERT_TRUE(samples.size() >= 100);
+    for (const FormatSample &sample : samples)
+        AssertSampleMatchesSnprintf(sample);
+}
+
+// The loss marker is formatted directly (not via SERIAL_PRINTF)
+static void test_loss_marker_matches_snprintf()
+{
+    std::vector<FormatSample> samples = CreateFormatSamples({ OUTPUT_DROPPED_FORMAT });
+    TEST_ASSERT_EQUAL_UINT(2 * 6 + 1, samples.size());
+    for (const FormatSample &sample : samples)
+        AssertSampleMatchesSnprintf(sample);
+}
+
+// The format strings are split into pieces with a single conversion
+static void test_samples_split_format()
+{
+    std::vector<FormatSample> samples = CreateFormatSamples({ "a %d%% b %-8s|%05lx end" });
+    TEST_ASSERT_EQUAL_UINT(7 + 3 + 6 + 1, samples.size());
+    TEST_ASSERT_EQUAL_STRING("a %d", samples[0].fmt.c_str());
+    TEST_ASSERT_EQUAL_INT(FormatSample::ArgInt, samples[0].argType);
+    TEST_ASSERT_EQUAL_STRING("%% b %-8s", samples[7].fmt.c_str());
+    TEST_ASSERT_EQUAL_INT(FormatSample::ArgString, samples[7].argType);
+    TEST_ASSERT_EQUAL_STRING("|%05lx", samples[10].fmt.c_str());
+    TEST_ASSERT_EQUAL_INT(FormatSample::ArgUnsignedLong, samples[10].argType);
+    TEST_ASSERT_EQUAL_STRING(" end", samples[16].fmt.c_str());
+    TEST_ASSERT_EQUAL_INT(FormatSample::ArgNone, samples[16].argType);
+
+    samples = CreateFormatSamples({ "%.2f" });
+    TEST_ASSERT_EQUAL_INT(FormatSample::ArgUnsupported, samples[0].argType);
+}
+
+// Flags and conversions not used by call sites yet
+static void test_flags_and_conversions()
+{
+    char text[TEXT_BUF_LEN];
+    char expected[TEXT_BUF_LEN];
+
+    FormatToBuffer(text, sizeof(text), "%-6d|%-6s|%6s|%c|%X|%%|%i", -42, "ab", "cd", 'x', 0xbeefU, 7);
+    snprintf(expected, sizeof(expected), "%-6d|%-6s|%6s|%c|%X|%%|%i", -42, "ab", "cd", 'x', 0xbeefU, 7);
+    TEST_ASSERT_EQUAL_STRING(expected, text);
+
+    FormatToBuffer(text, sizeof(text), "%05d|%05ld|%x", -42, 123456L, 0U);
+    snprintf(expected, sizeof(expected), "%05d|%05ld|%x", -42, 123456L, 0U);
+    TEST_ASSERT_EQUAL_STRING(expected, text);
+}
+
+// Extreme values of each argument type
+static void test_extreme_values()
+{
+    char text[TEXT_BUF_LEN];
+    char expected[TEXT_BUF_LEN];
+
+    FormatToBuffer(text, sizeof(text), "%d|%d|%ld|%ld|%u|%lu|%x", INT_MIN, INT_MAX, LONG_MIN, LONG_MAX, UINT_MAX,
+            ULONG_MAX, UINT_MAX);
+    snprintf(expected, sizeof(expected), "%d|%d|%ld|%ld|%u|%lu|%x", INT_MIN, INT_MAX, LONG_MIN, LONG_MAX, UINT_MAX,
+            ULONG_MAX, UINT_MAX);
+    TEST_ASSERT_EQUAL_STRING(expected, text);
+
+    FormatToBuffer(text, sizeof(text), "[%s]%8d|%-8ld|%s", "", 0, 0L, "end");
+    snprintf(expected, sizeof(expected), "[%s]%8d|%-8ld|%s", "", 0, 0L, "end");
+    TEST_ASSERT_EQUAL_STRING(expected, text);
+}
+
+// Like snprintf, the text is truncated and terminated
+static void test_truncation()
+{
+    char text[8];
+    TEST_ASSERT_EQUAL_UINT(7, FormatToBuffer(text, sizeof(text), "RX%d: %ld", 1, 1234567890L));
+    TEST_ASSERT_EQUAL_STRING("RX1: 12", text);
+    TEST_ASSERT_EQUAL_UINT(0, FormatToBuffer(text, 1, "RX%d", 1));
+    TEST_ASSERT_EQUAL_STRING("", text);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_call_sites_are_collected);
+    RUN_TEST(test_call_sites_match_snprintf);
+    RUN_TEST(test_loss_marker_matches_snprintf);
+    RUN_TEST(test_samples_split_format);
+    RUN_TEST(test_flags_and_conversions);
+    RUN_TEST(test_extreme_values);
+    RUN_TEST(test_truncation);
+    return UNITY_END();
+}
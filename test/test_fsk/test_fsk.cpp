@@ -0,0 +1,247 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the FSK analysis (air time against the packet format,
+ * register decoding and the end of the RX window)
+ */
+
+#include "host_serial.h"
+#include "main.h"
+#include "spi_analyzer.h"
+#include <cmath>
+#include <string>
+#include <unity.h>
+
+#define SPI_BUF_LEN 256
+
+// Bit periods in 1/512 us (16 * BitRate + BitRateFrac): 50 kbps,
+// 4.8 kbps (reset value), 1.2 kbps with fractional part, 300 kbps
+static const uint32_t BIT_PERIODS[] = { 640 * 16, 0x1a0b * 16, 0x682b * 16 + 5, 107 * 16 };
+
+static const uint8_t OP_MODE_FSK_STANDBY[] = { 0x81, 0x01 };
+static const uint8_t OP_MODE_FSK_TX[] = { 0x81, 0x03 };
+static const uint8_t OP_MODE_FSK_RX[] = { 0x81, 0x05 };
+
+// EU868 DR7: 868.8 MHz, 50 kbps, fdev 25 kHz, 5 bytes preamble,
+// 3 bytes sync word, variable length, CRC on
+static const uint8_t FREQUENCY[] = { 0x86, 0xd9, 0x33, 0x33 };
+static const uint8_t BIT_RATE_AND_FDEV[] = { 0x82, 0x02, 0x80, 0x01, 0x99 };
+static const uint8_t PREAMBLE_AND_SYNC_CONFIG[] = { 0xa5, 0x00, 0x05, 0x12 };
+static const uint8_t PACKET_CONFIG1[] = { 0xb0, 0xd0 };
+
+// Payload of 20 bytes (preceded by the length byte)
+static const uint8_t FIFO_WRITE[] = {
+    0x80, 20, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20
+};
+
+static uint8_t spiBuf[SPI_BUF_LEN];
+static uint32_t spiPos;
+static uint64_t time;
+static TimingAnalyzer *timingAnalyzer;
+static SpiAnalyzer *analyzer;
+static std::string output;
+
+
+// FSK air time in us: all bytes of the packet at the given bit period
+static double ReferenceAirTime(uint32_t bitPeriod, int preambleLength, int syncSize, int variableLength,
+        int addressFiltering, int crcOn, int payloadLength)
+{
+    int numBytes = preambleLength + syncSize + variableLength + addressFiltering + 2 * crcOn + payloadLength;
+    return numBytes * 8 * (bitPeriod / 512.0);
+}
+
+// Writes the transaction to the SPI buffer (like the DMA) and decodes it
+template <size_t N>
+static void Trx(const uint8_t (&data)[N])
+{
+    uint32_t startPos = spiPos;
+    const uint8_t *startTrx = spiBuf + (spiPos & (SPI_BUF_LEN - 1));
+    for (size_t i = 0; i < N; i++)
+    {
+        spiBuf[spiPos & (SPI_BUF_LEN - 1)] = data[i];
+        spiPos++;
+    }
+    const uint8_t *endTrx = spiBuf + (spiPos & (SPI_BUF_LEN - 1));
+    analyzer->OnTrx(time, startTrx, endTrx, startPos);
+}
+
+// Transmits the payload in the FIFO (TX done after the given time)
+static void Transmit(uint32_t duration)
+{
+    Trx(FIFO_WRITE);
+    time += 1000;
+    Trx(OP_MODE_FSK_TX);
+    time += duration;
+    analyzer->OnDio0(time);
+    Trx(OP_MODE_FSK_STANDBY);
+}
+
+static std::string AnalysisOutput()
+{
+    Output.Flush();
+    return output;
+}
+
+static bool Contains(const std::string &text, const char *str)
+{
+    return text.find(str) != std::string::npos;
+}
+
+void setUp()
+{
+    spiPos = 0;
+    time = 0;
+    output.clear();
+    timingAnalyzer = new TimingAnalyzer();
+    analyzer = new SpiAnalyzer(spiBuf, SPI_BUF_LEN, *timingAnalyzer);
+    HostSerial.SetCapture(&output);
+    Trx(OP_MODE_FSK_STANDBY);
+}
+
+void tearDown()
+{
+    Output.Flush();
+    HostSerial.SetCapture(nullptr);
+    delete analyzer;
+    delete timingAnalyzer;
+}
+
+// All combinations of the sync word size, length byte, address byte
+// and CRC; the result must be the exact air time rounded to the
+// nearest microsecond
+static void test_air_time_packet_format()
+{
+    timingAnalyzer->SetLongRangeMode(LongrangeModeFSK);
+
+    for (uint32_t bitPeriod : BIT_PERIODS)
+    {
+        timingAnalyzer->SetFskBitPeriod(bitPeriod);
+        for (int preambleLength : { 0, 3, 5, 1000 })
+        {
+            timingAnalyzer->SetFskPreambleLength(preambleLength);
+            for (int syncSize = 0; syncSize <= 8; syncSize++)
+            {
+                timingAnalyzer->SetFskSyncSize(syncSize);
+                for (int flags = 0; flags < 8; flags++)
+                {
+                    int variableLength = flags & 1;
+                    int addressFiltering = (flags >> 1) & 1;
+                    int crcOn = (flags >> 2) & 1;
+                    timingAnalyzer->SetFskVariableLength(variableLength);
+                    timingAnalyzer->SetFskAddressFiltering(addressFiltering);
+                    timingAnalyzer->SetFskCrcOn(crcOn);
+
+                    for (int payloadLength = 0; payloadLength <= 255; payloadLength += 5)
+                    {
+                        double airTime = ReferenceAirTime(bitPeriod, preambleLength, syncSize, variableLength,
+                                addressFiltering, crcOn, payloadLength);
+                        TEST_ASSERT_EQUAL_INT32((int32_t)llround(airTime), timingAnalyzer->PayloadAirTime(payloadLength));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Registers that have never been written have their reset values
+// (4.8 kbps, fdev 5005 Hz, 434 MHz, 3 bytes preamble, 4 bytes sync word,
+// variable length, CRC on)
+static void test_reset_values()
+{
+    Transmit(50100);
+    std::string result = AnalysisOutput();
+
+    TEST_ASSERT_TRUE(Contains(result,
+            "FSK, 4800 bps, fdev = 5005 Hz, 434.000 MHz, payload = 20 bytes, airtime = 50003us, ramp-up = 97us\r\n"));
+}
+
+// Configuration of EU868 DR7 with the length byte in the FIFO
+static void test_dr7_transmission()
+{
+    Trx(FREQUENCY);
+    Trx(BIT_RATE_AND_FDEV);
+    Trx(PREAMBLE_AND_SYNC_CONFIG);
+    Trx(PACKET_CONFIG1);
+    Transmit(5000);
+    std::string result = AnalysisOutput();
+
+    TEST_ASSERT_TRUE(Contains(result,
+            "FSK, 50000 bps, fdev = 24963 Hz, 868.800 MHz, payload = 20 bytes, airtime = 4960us, ramp-up = 40us\r\n"));
+}
+
+// Fixed length packets have no length byte; the length is taken from the FIFO
+static void test_fixed_length_transmission()
+{
+    const uint8_t packetConfig[] = { 0xb0, 0x50, 0x40, 21 };
+    Trx(BIT_RATE_AND_FDEV);
+    Trx(PREAMBLE_AND_SYNC_CONFIG);
+    Trx(packetConfig);
+    Transmit(5000);
+    std::string result = AnalysisOutput();
+
+    // 5 + 3 + 21 + 2 bytes
+    TEST_ASSERT_TRUE(Contains(result, "payload = 21 bytes, airtime = 4960us, ramp-up = 40us\r\n"));
+    TEST_ASSERT_FALSE(Contains(result, "mismatch"));
+}
+
+// The FSK timeout isn't monitored: the MCU switching the radio to standby
+// ends the RX window
+static void test_rx_window_end()
+{
+    Trx(FREQUENCY);
+    Trx(BIT_RATE_AND_FDEV);
+    Trx(PREAMBLE_AND_SYNC_CONFIG);
+    Trx(PACKET_CONFIG1);
+    Transmit(5000);
+
+    time += 1000000;
+    Trx(OP_MODE_FSK_RX);
+    time += 5000;
+    Trx(OP_MODE_FSK_STANDBY);
+    std::string result = AnalysisOutput();
+
+    TEST_ASSERT_TRUE(Contains(result, " 1000000: RX1 start\r\n"));
+    TEST_ASSERT_TRUE(Contains(result, " 1005000: RX1 timeout\r\n"
+            "          FSK, 50000 bps, fdev = 24963 Hz, 868.800 MHz, airtime = 4700us, ramp-up = 300us\r\n"));
+}
+
+// In LoRa mode, switching to standby doesn't end the RX window
+// (the timeout is signaled on DIO1)
+static void test_lora_rx_window_is_not_ended_by_standby()
+{
+    const uint8_t opModeSleep[] = { 0x81, 0x00 };
+    const uint8_t opModeLoraSleep[] = { 0x81, 0x80 };
+    const uint8_t opModeLoraTx[] = { 0x81, 0x83 };
+    const uint8_t opModeLoraRx[] = { 0x81, 0x86 };
+    const uint8_t opModeLoraStandby[] = { 0x81, 0x81 };
+    Trx(opModeSleep);
+    Trx(opModeLoraSleep);
+    Trx(opModeLoraTx);
+    time += 50000;
+    analyzer->OnDio0(time);
+
+    time += 1000000;
+    Trx(opModeLoraRx);
+    time += 5000;
+    Trx(opModeLoraStandby);
+    std::string result = AnalysisOutput();
+
+    TEST_ASSERT_TRUE(Contains(result, "RX1 start\r\n"));
+    TEST_ASSERT_FALSE(Contains(result, "RX1 timeout"));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_air_time_packet_format);
+    RUN_TEST(test_reset_values);
+    RUN_TEST(test_dr7_transmission);
+    RUN_TEST(test_fixed_length_transmission);
+    RUN_TEST(test_rx_window_end);
+    RUN_TEST(test_lora_rx_window_is_not_ended_by_standby);
+    return UNITY_END();
+}
@@ -0,0 +1,109 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the LoRaWAN frame header parser
+ */
+
+#include "lorawan.h"
+#include <string.h>
+#include <unity.h>
+
+// Unconfirmed data up, DevAddr 12345678, FCtrl with 2 bytes FOpts
+// (LinkCheckReq, DeviceTimeReq), FCnt 0x0102, FPort 1, 1 byte payload, MIC
+static const uint8_t DATA_FRAME[] = {
+    0x40, 0x78, 0x56, 0x34, 0x12, 0x02, 0x02, 0x01, 0x02, 0x0d, 0x01, 0xaa, 0x9d, 0x8e, 0x32, 0x44
+};
+
+// Number of reads beyond the frame length
+static int numInvalidReads;
+
+
+// Parses the first `len` bytes of `data`; reads beyond `len` are counted
+static bool Parse(const uint8_t *data, size_t len, LoraWanFrame &frame)
+{
+    return ParseLoraWanFrame([data, len](size_t offset) -> uint8_t {
+        if (offset >= len)
+        {
+            numInvalidReads++;
+            return 0;
+        }
+        return data[offset];
+    }, len, frame);
+}
+
+void setUp()
+{
+    numInvalidReads = 0;
+}
+
+void tearDown()
+{
+}
+
+static void test_data_frame()
+{
+    LoraWanFrame frame;
+    TEST_ASSERT_TRUE(Parse(DATA_FRAME, sizeof(DATA_FRAME), frame));
+    TEST_ASSERT_EQUAL_INT(LoraWanUnconfirmedDataUp, frame.mType);
+    TEST_ASSERT_EQUAL_HEX32(0x12345678, frame.devAddr);
+    TEST_ASSERT_EQUAL_UINT16(0x0102, frame.fCnt);
+    TEST_ASSERT_EQUAL_UINT8(2, frame.fOptsLen);
+    TEST_ASSERT_EQUAL_INT(1, frame.fPort);
+    TEST_ASSERT_TRUE(frame.HasMacCommand(0x0d));
+    TEST_ASSERT_EQUAL_INT(0, numInvalidReads);
+}
+
+// Data frames shorter than the header and MIC are rejected
+// without reading beyond the end of the data
+static void test_short_data_frames()
+{
+    static const uint8_t SHORT_FRAME[] = { 0x40, 0x78, 0x56, 0x34, 0x12, 0x00, 0x01, 0x00, 0x9d, 0x8e, 0x32, 0x44 };
+
+    LoraWanFrame frame;
+    for (size_t len = 1; len < 12; len++)
+        TEST_ASSERT_FALSE(Parse(DATA_FRAME, len, frame));
+    TEST_ASSERT_EQUAL_INT(0, numInvalidReads);
+
+    // minimum length (no FOpts and no FPort)
+    TEST_ASSERT_TRUE(Parse(SHORT_FRAME, sizeof(SHORT_FRAME), frame));
+    TEST_ASSERT_EQUAL_INT(-1, frame.fPort);
+
+    // FOpts longer than the frame
+    for (size_t len = 12; len < 14; len++)
+        TEST_ASSERT_FALSE(Parse(DATA_FRAME, len, frame));
+    TEST_ASSERT_EQUAL_INT(0, numInvalidReads);
+}
+
+static void test_join_request()
+{
+    uint8_t joinRequest[23] = { 0x00 };
+    LoraWanFrame frame;
+    TEST_ASSERT_TRUE(Parse(joinRequest, sizeof(joinRequest), frame));
+    TEST_ASSERT_EQUAL_INT(LoraWanJoinRequest, frame.mType);
+    TEST_ASSERT_FALSE(Parse(joinRequest, 22, frame));
+}
+
+static void test_invalid_major_version()
+{
+    uint8_t data[sizeof(DATA_FRAME)];
+    memcpy(data, DATA_FRAME, sizeof(data));
+    data[0] |= 0x01;
+    LoraWanFrame frame;
+    TEST_ASSERT_FALSE(Parse(data, sizeof(data), frame));
+    TEST_ASSERT_FALSE(Parse(data, 0, frame));
+    TEST_ASSERT_EQUAL_INT(0, numInvalidReads);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_data_frame);
+    RUN_TEST(test_short_data_frames);
+    RUN_TEST(test_join_request);
+    RUN_TEST(test_invalid_major_version);
+    return UNITY_END();
+}
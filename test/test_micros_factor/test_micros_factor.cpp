@@ -0,0 +1,87 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Exhaustive test of the conversion from SysTick ticks to microseconds:
+ * the multiplication with the reciprocal must yield the same result as
+ * the division for all counter values.
+ */
+
+#include "timing.h"
+#include <unity.h>
+
+// Highest SysTick clock (in MHz) the conversion must support
+#define MAX_CLOCK_MHZ 128
+
+// Counts the counter values for which the multiplication with the
+// reciprocal differs from the division, for the given reload value
+static uint32_t CountMismatches(uint32_t load)
+{
+    SysTick->LOAD = load;
+    InitMicros();
+
+    uint32_t ticksPerMicro = (load + 1) / 1000;
+    uint32_t numMismatches = 0;
+    for (uint32_t st = 0; st <= load; st++)
+    {
+        uint64_t expected = 1000000 - st / ticksPerMicro;
+        if (MicrosFromTicks(999, st) != expected)
+            numMismatches++;
+    }
+
+    return numMismatches;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// SysTick with a 1ms period at every integer clock frequency in MHz
+static void test_all_counter_values_at_integer_clocks()
+{
+    for (uint32_t mhz = 1; mhz <= MAX_CLOCK_MHZ; mhz++)
+    {
+        char message[40];
+        snprintf(message, sizeof(message), "%u MHz", (unsigned)mhz);
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, CountMismatches(mhz * 1000 - 1), message);
+    }
+}
+
+// Largest reload value resulting in the same number of ticks per
+// microsecond (i.e. the largest counter range for each reciprocal)
+static void test_all_counter_values_at_largest_reload()
+{
+    for (uint32_t ticksPerMicro = 1; ticksPerMicro <= MAX_CLOCK_MHZ; ticksPerMicro++)
+    {
+        char message[40];
+        snprintf(message, sizeof(message), "%u ticks/us", (unsigned)ticksPerMicro);
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, CountMismatches(ticksPerMicro * 1000 + 998), message);
+    }
+}
+
+static void test_factor_at_72mhz()
+{
+    SysTick->LOAD = 71999;
+    InitMicros();
+
+    // ceil(2^31 / 72)
+    TEST_ASSERT_EQUAL_UINT32(29826162, SysTickMicrosFactor);
+    TEST_ASSERT_EQUAL_UINT64(1001000, MicrosFromTicks(1000, 0));
+    TEST_ASSERT_EQUAL_UINT64(1000001, MicrosFromTicks(1000, 71999));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_all_counter_values_at_integer_clocks);
+    RUN_TEST(test_all_counter_values_at_largest_reload);
+    RUN_TEST(test_factor_at_72mhz);
+    return UNITY_END();
+}
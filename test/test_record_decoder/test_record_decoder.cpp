@@ -0,0 +1,197 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for decoding deferred format records with the format
+ * strings of all call sites (section "fmtstr")
+ */
+
+#include "binary_record.h"
+#include "format_samples.h"
+#include "host_serial.h"
+#include "main.h"
+#include "record_decoder.h"
+#include <cstdio>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+// Start and end of the section "fmtstr" (provided by the linker)
+extern "C" const char __start_fmtstr[];
+extern "C" const char __stop_fmtstr[];
+
+#define FORMAT_STRINGS_PATH "test_record_decoder_fmtstr.bin"
+#define RECORDS_PATH "test_record_decoder_records.bin"
+
+static FILE *recordFile;
+static std::string output;
+
+
+static void WriteFormatStrings(const char *data, size_t len)
+{
+    FILE *file = fopen(FORMAT_STRINGS_PATH, "wb");
+    TEST_ASSERT_NOT_NULL(file);
+    fwrite(data, 1, len, file);
+    fclose(file);
+}
+
+static void WriteRecord(const RecordWriter &record)
+{
+    uint8_t framed[MAX_FRAMED_RECORD_LEN];
+    size_t len = CobsEncode(record.Data(), record.Length(), framed);
+    fwrite(framed, 1, len, recordFile);
+}
+
+// Appends the sample argument like `OutputBuffer::PrintDeferred`
+static void PutArg(RecordWriter &record, const FormatSample &sample)
+{
+    switch (sample.argType)
+    {
+    case FormatSample::ArgInt:
+        record.PutSignedVarint64((int)sample.value);
+        break;
+    case FormatSample::ArgLong:
+        record.PutSignedVarint64((long)sample.value);
+        break;
+    case FormatSample::ArgUnsigned:
+        record.PutSignedVarint64((unsigned)sample.value);
+        break;
+    case FormatSample::ArgUnsignedLong:
+        record.PutSignedVarint64((unsigned long)sample.value);
+        break;
+    case FormatSample::ArgString:
+        record.PutString(sample.str);
+        break;
+    default:
+        break;
+    }
+}
+
+// Decodes the records written so far and returns the text
+static std::string DecodeRecordFile()
+{
+    fclose(recordFile);
+    recordFile = nullptr;
+    output.clear();
+    TEST_ASSERT_EQUAL_INT(0, DecodeRecords(RECORDS_PATH, false, FORMAT_STRINGS_PATH));
+    Output.Flush();
+    return output;
+}
+
+void setUp()
+{
+    recordFile = fopen(RECORDS_PATH, "wb");
+    TEST_ASSERT_NOT_NULL(recordFile);
+    HostSerial.SetCapture(&output);
+}
+
+void tearDown()
+{
+    if (recordFile != nullptr)
+        fclose(recordFile);
+    Output.Flush();
+    HostSerial.SetCapture(nullptr);
+    remove(RECORDS_PATH);
+    remove(FORMAT_STRINGS_PATH);
+}
+
+// Each call site's format string is referenced by its offset in the
+// section (the format ID of DEFERRED_FORMAT) with arguments of the types
+// the format expects. The decoded text must match `snprintf`.
+static void test_all_call_sites()
+{
+    WriteFormatStrings(__start_fmtstr, __stop_fmtstr - __start_fmtstr);
+
+    std::string expected;
+    int numRecords = 0;
+    for (const char *fmt : CollectFormatStrings())
+    {
+        std::vector<FormatSample> samples = CreateFormatSamples({ fmt });
+
+        // group the samples by piece of the format string
+        std::vector<std::vector<FormatSample>> pieces;
+        for (const FormatSample &sample : samples)
+        {
+            TEST_ASSERT_TRUE_MESSAGE(sample.argType != FormatSample::ArgUnsupported, fmt);
+            if (pieces.size() == (size_t)sample.piece)
+                pieces.push_back({});
+            pieces.back().push_back(sample);
+        }
+        std::string pieceFormats;
+        for (const std::vector<FormatSample> &piece : pieces)
+            pieceFormats += piece[0].fmt;
+        TEST_ASSERT_EQUAL_STRING(fmt, pieceFormats.c_str());
+
+        // several records with different argument values
+        for (size_t variant = 0; variant < 7; variant++)
+        {
+            RecordWriter record(RecordFormat);
+            record.PutVarint(fmt - __start_fmtstr);
+            for (const std::vector<FormatSample> &piece : pieces)
+            {
+                const FormatSample &sample = piece[variant % piece.size()];
+                PutArg(record, sample);
+                char text[256];
+                size_t len = sample.Reference(text, sizeof(text));
+                expected.append(text, len);
+            }
+            TEST_ASSERT_TRUE(record.Length() < MAX_RECORD_LEN);
+            WriteRecord(record);
+            numRecords++;
+        }
+    }
+
+    TEST_ASSERT_TRUE(numRecords > 100);
+    std::string result = DecodeRecordFile();
+    TEST_ASSERT_EQUAL_UINT32(expected.size(), result.size());
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), result.c_str());
+}
+
+// Records with an unknown format ID or with arguments that don't match
+// the format string are skipped; the other records are still decoded
+static void test_invalid_records()
+{
+    const char formatStrings[] = "value %d\r\n\0%s: %lu\r\n";
+    WriteFormatStrings(formatStrings, sizeof(formatStrings));
+
+    RecordWriter valid(RecordFormat);
+    valid.PutVarint(0);
+    valid.PutSignedVarint64(-17);
+    WriteRecord(valid);
+
+    RecordWriter unknownId(RecordFormat);
+    unknownId.PutVarint(sizeof(formatStrings) + 10);
+    unknownId.PutSignedVarint64(1);
+    WriteRecord(unknownId);
+
+    RecordWriter missingArg(RecordFormat);
+    missingArg.PutVarint(11);
+    missingArg.PutString("RX1");
+    WriteRecord(missingArg);
+
+    RecordWriter extraArg(RecordFormat);
+    extraArg.PutVarint(0);
+    extraArg.PutSignedVarint64(1);
+    extraArg.PutSignedVarint64(2);
+    WriteRecord(extraArg);
+
+    RecordWriter validString(RecordFormat);
+    validString.PutVarint(11);
+    validString.PutString("RX1");
+    validString.PutSignedVarint64(4294967295LL);
+    WriteRecord(validString);
+
+    std::string result = DecodeRecordFile();
+    TEST_ASSERT_EQUAL_STRING("value -17\r\nRX1: 4294967295\r\n", result.c_str());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_all_call_sites);
+    RUN_TEST(test_invalid_records);
+    return UNITY_END();
+}
@@ -0,0 +1,94 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for reading event files
+ */
+
+#include "replay.h"
+#include <cstdio>
+#include <unity.h>
+#include <vector>
+
+struct ParsedEvent
+{
+    uint64_t time;
+    RecordedEventType type;
+    std::vector<uint8_t> data;
+};
+
+static std::vector<ParsedEvent> events;
+
+
+static void AddEvent(const RecordedEvent &event, void *)
+{
+    events.push_back({ event.time, event.type, std::vector<uint8_t>(event.data, event.data + event.len) });
+}
+
+void setUp()
+{
+    events.clear();
+}
+
+void tearDown()
+{
+}
+
+static void test_missing_file_fails()
+{
+    TEST_ASSERT_FALSE(ReadEventFile("/nonexistent/events.txt", AddEvent, nullptr));
+    TEST_ASSERT_EQUAL_UINT32(0, events.size());
+}
+
+static void test_read_file()
+{
+    const char *path = "test_replay_events.txt";
+    FILE *file = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(file);
+    fputs("# comment\n1000000 SPI 81 83\n\n1046376 DIO0\r\n2049826\tDIO1", file);
+    fclose(file);
+
+    bool ok = ReadEventFile(path, AddEvent, nullptr);
+    remove(path);
+
+    TEST_ASSERT_TRUE(ok);
+    TEST_ASSERT_EQUAL_UINT32(3, events.size());
+    TEST_ASSERT_EQUAL_UINT64(1000000, events[0].time);
+    TEST_ASSERT_EQUAL_INT(RecordedEventSpi, events[0].type);
+    TEST_ASSERT_EQUAL_UINT32(2, events[0].data.size());
+    TEST_ASSERT_EQUAL_HEX8(0x81, events[0].data[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x83, events[0].data[1]);
+    TEST_ASSERT_EQUAL_INT(RecordedEventDio0, events[1].type);
+    TEST_ASSERT_EQUAL_UINT64(2049826, events[2].time);
+    TEST_ASSERT_EQUAL_INT(RecordedEventDio1, events[2].type);
+}
+
+static void test_read_text()
+{
+    TEST_ASSERT_TRUE(ReadEventText("1 SPI 0102ab\n2 DIO1\n", AddEvent, nullptr));
+    TEST_ASSERT_EQUAL_UINT32(2, events.size());
+    TEST_ASSERT_EQUAL_UINT32(3, events[0].data.size());
+    TEST_ASSERT_EQUAL_HEX8(0xab, events[0].data[2]);
+}
+
+static void test_invalid_lines_fail()
+{
+    TEST_ASSERT_FALSE(ReadEventText("SPI 81 83\n", AddEvent, nullptr));
+    TEST_ASSERT_FALSE(ReadEventText("1000 DIO2\n", AddEvent, nullptr));
+    TEST_ASSERT_FALSE(ReadEventText("1000 SPI 8\n", AddEvent, nullptr));
+    TEST_ASSERT_FALSE(ReadEventText("1000 SPI 8x\n", AddEvent, nullptr));
+    TEST_ASSERT_EQUAL_UINT32(0, events.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_missing_file_fails);
+    RUN_TEST(test_read_file);
+    RUN_TEST(test_read_text);
+    RUN_TEST(test_invalid_lines_fail);
+    return UNITY_END();
+}
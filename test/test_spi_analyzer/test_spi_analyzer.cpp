@@ -0,0 +1,189 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the SX127x decoder (TX payload in the FIFO)
+ */
+
+#include "host_serial.h"
+#include "main.h"
+#include "spi_analyzer.h"
+#include <string>
+#include <unity.h>
+
+// Small SPI buffer so the TX payload can be overwritten
+#define SPI_BUF_LEN 64
+
+// Unconfirmed data up, DevAddr 12345678, FCnt 0x0102
+static const uint8_t FIFO_WRITE[] = {
+    0x80, 0x40, 0x78, 0x56, 0x34, 0x12, 0x02, 0x02, 0x01, 0x02, 0x0d, 0x01, 0xaa, 0x9d, 0x8e, 0x32, 0x44
+};
+#define FIFO_LENGTH 16
+
+static const uint8_t FIFO_ADDR_PTR[] = { 0x8d, 0x80 };
+static const uint8_t OP_MODE_STANDBY[] = { 0x81, 0x81 };
+static const uint8_t OP_MODE_TX[] = { 0x81, 0x83 };
+// Register read (not relevant for the analysis)
+static const uint8_t VERSION_READ[] = { 0x42, 0x00 };
+
+static uint8_t spiBuf[SPI_BUF_LEN];
+static uint32_t spiPos;
+static uint64_t time;
+static TimingAnalyzer *timingAnalyzer;
+static SpiAnalyzer *analyzer;
+static std::string output;
+
+
+// Checks the SPI data like the event processor
+static bool IsOverwritten(uint32_t pos)
+{
+    return spiPos - pos >= SPI_BUF_LEN;
+}
+
+// Writes the transaction to the SPI buffer (like the DMA) and decodes it
+template <size_t N>
+static void Trx(const uint8_t (&data)[N])
+{
+    uint32_t startPos = spiPos;
+    const uint8_t *startTrx = spiBuf + (spiPos & (SPI_BUF_LEN - 1));
+    for (size_t i = 0; i < N; i++)
+    {
+        spiBuf[spiPos & (SPI_BUF_LEN - 1)] = data[i];
+        spiPos++;
+    }
+    const uint8_t *endTrx = spiBuf + (spiPos & (SPI_BUF_LEN - 1));
+    analyzer->OnTrx(time, startTrx, endTrx, startPos);
+}
+
+static void SetPayloadLength(uint8_t length)
+{
+    const uint8_t payloadLength[] = { 0xa2, length };
+    Trx(payloadLength);
+}
+
+// Starts the transmission, completes it and returns the analysis output
+static std::string Transmit()
+{
+    output.clear();
+    time += 100000;
+    Trx(OP_MODE_TX);
+    time += 50000;
+    analyzer->OnDio0(time);
+    Trx(OP_MODE_STANDBY);
+    Output.Flush();
+    return output;
+}
+
+static bool Contains(const std::string &text, const char *str)
+{
+    return text.find(str) != std::string::npos;
+}
+
+void setUp()
+{
+    spiPos = 0;
+    time = 0;
+    timingAnalyzer = new TimingAnalyzer();
+    analyzer = new SpiAnalyzer(spiBuf, SPI_BUF_LEN, *timingAnalyzer, IsOverwritten);
+    HostSerial.SetCapture(&output);
+    Trx(OP_MODE_STANDBY);
+}
+
+void tearDown()
+{
+    Output.Flush();
+    HostSerial.SetCapture(nullptr);
+    delete analyzer;
+    delete timingAnalyzer;
+}
+
+static void test_tx_payload_is_decoded()
+{
+    SetPayloadLength(FIFO_LENGTH);
+    Trx(FIFO_ADDR_PTR);
+    Trx(FIFO_WRITE);
+    std::string result = Transmit();
+
+    TEST_ASSERT_TRUE(Contains(result, "Unconfirmed data up, DevAddr = 12345678, FCnt = 258"));
+    TEST_ASSERT_TRUE(Contains(result, "payload = 16 bytes"));
+    TEST_ASSERT_FALSE(Contains(result, "mismatch"));
+}
+
+// The DMA has overwritten the payload before the transmission starts:
+// the remaining bytes must not be parsed as a frame
+static void test_overwritten_tx_payload_is_not_decoded()
+{
+    SetPayloadLength(FIFO_LENGTH);
+    Trx(FIFO_ADDR_PTR);
+    Trx(FIFO_WRITE);
+    for (int i = 0; i < SPI_BUF_LEN / 2; i++)
+        Trx(VERSION_READ);
+    std::string result = Transmit();
+
+    TEST_ASSERT_TRUE(Contains(result, "SPI buffer overrun - TX payload of 16 bytes not decoded\r\n"));
+    TEST_ASSERT_FALSE(Contains(result, "Unconfirmed data up"));
+    // the length is still known
+    TEST_ASSERT_TRUE(Contains(result, "payload = 16 bytes"));
+}
+
+// A transmission without a new FIFO write must not reuse the previous payload
+static void test_tx_without_fifo_write()
+{
+    SetPayloadLength(FIFO_LENGTH);
+    Trx(FIFO_ADDR_PTR);
+    Trx(FIFO_WRITE);
+    Transmit();
+    TEST_ASSERT_EQUAL_UINT32(0, analyzer->TxFifoLength());
+    TEST_ASSERT_FALSE(analyzer->HasTxFifoData());
+    // skip the RX windows
+    timingAnalyzer->ResetStage();
+
+    SetPayloadLength(20);
+    std::string result = Transmit();
+
+    TEST_ASSERT_FALSE(Contains(result, "Unconfirmed data up"));
+    TEST_ASSERT_FALSE(Contains(result, "FCnt"));
+    TEST_ASSERT_FALSE(Contains(result, "mismatch"));
+    TEST_ASSERT_TRUE(Contains(result, "payload = 20 bytes"));
+}
+
+// The FIFO contains fewer bytes than configured in RegPayloadLength
+static void test_payload_length_mismatch()
+{
+    SetPayloadLength(20);
+    Trx(FIFO_ADDR_PTR);
+    Trx(FIFO_WRITE);
+    std::string result = Transmit();
+
+    TEST_ASSERT_TRUE(Contains(result, "Payload length mismatch: register = 20 bytes, FIFO = 16 bytes\r\n"));
+    TEST_ASSERT_TRUE(Contains(result, "payload = 16 bytes"));
+}
+
+// A payload written in two bursts has a known length but cannot be decoded
+static void test_payload_written_in_two_bursts()
+{
+    SetPayloadLength(FIFO_LENGTH + 4);
+    Trx(FIFO_ADDR_PTR);
+    const uint8_t prefix[] = { 0x80, 0x01, 0x02, 0x03, 0x04 };
+    Trx(prefix);
+    Trx(FIFO_WRITE);
+    std::string result = Transmit();
+
+    TEST_ASSERT_FALSE(Contains(result, "Unconfirmed data up"));
+    TEST_ASSERT_FALSE(Contains(result, "mismatch"));
+    TEST_ASSERT_TRUE(Contains(result, "payload = 20 bytes"));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_tx_payload_is_decoded);
+    RUN_TEST(test_overwritten_tx_payload_is_not_decoded);
+    RUN_TEST(test_tx_without_fifo_write);
+    RUN_TEST(test_payload_length_mismatch);
+    RUN_TEST(test_payload_written_in_two_bursts);
+    return UNITY_END();
+}
@@ -0,0 +1,189 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the lock-free SPSC ring buffer
+ */
+
+#include "spsc_ring.h"
+#include <chrono>
+#include <thread>
+#include <unity.h>
+
+// Item with redundant fields so torn or stale reads are detected
+struct Item
+{
+    uint64_t time;
+    uint32_t seqNo;
+    uint8_t check;
+};
+
+static Item MakeItem(uint32_t seqNo)
+{
+    return { (uint64_t)seqNo * 1000003, seqNo, (uint8_t)(seqNo * 7) };
+}
+
+static bool IsValidItem(const Item &item, uint32_t expectedSeqNo)
+{
+    return item.seqNo == expectedSeqNo && item.time == (uint64_t)expectedSeqNo * 1000003
+            && item.check == (uint8_t)(expectedSeqNo * 7);
+}
+
+// Gives the other thread a chance to run (required if there is a single CPU only)
+static void Pause()
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(1));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_new_ring_is_empty()
+{
+    SpscRing<Item, 16> ring;
+    Item item;
+
+    TEST_ASSERT_TRUE(ring.IsEmpty());
+    TEST_ASSERT_EQUAL_UINT32(0, ring.Size());
+    TEST_ASSERT_FALSE(ring.Pop(item));
+}
+
+static void test_full_ring_rejects_item()
+{
+    SpscRing<Item, 16> ring;
+
+    for (uint32_t i = 0; i < 16; i++)
+        TEST_ASSERT_TRUE(ring.Push(MakeItem(i)));
+
+    TEST_ASSERT_EQUAL_UINT32(16, ring.Size());
+    TEST_ASSERT_FALSE(ring.Push(MakeItem(16)));
+    TEST_ASSERT_EQUAL_UINT32(16, ring.Size());
+
+    // all slots are usable and the rejected item has not overwritten anything
+    Item item;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        TEST_ASSERT_TRUE(ring.Pop(item));
+        TEST_ASSERT_TRUE(IsValidItem(item, i));
+    }
+    TEST_ASSERT_FALSE(ring.Pop(item));
+    TEST_ASSERT_TRUE(ring.IsEmpty());
+}
+
+static void test_space_is_reused_after_pop()
+{
+    SpscRing<Item, 4> ring;
+    Item item;
+
+    for (uint32_t i = 0; i < 4; i++)
+        ring.Push(MakeItem(i));
+    TEST_ASSERT_TRUE(ring.Pop(item));
+    TEST_ASSERT_TRUE(IsValidItem(item, 0));
+
+    TEST_ASSERT_TRUE(ring.Push(MakeItem(4)));
+    TEST_ASSERT_FALSE(ring.Push(MakeItem(5)));
+
+    for (uint32_t i = 1; i <= 4; i++)
+    {
+        TEST_ASSERT_TRUE(ring.Pop(item));
+        TEST_ASSERT_TRUE(IsValidItem(item, i));
+    }
+    TEST_ASSERT_TRUE(ring.IsEmpty());
+}
+
+// Runs many laps around the ring with a varying fill level
+// so the indices wrap at every possible position
+static void test_wrap_around_keeps_order()
+{
+    SpscRing<Item, 8> ring;
+    uint32_t nextPush = 0;
+    uint32_t nextPop = 0;
+    Item item;
+
+    for (int round = 0; round < 1000; round++)
+    {
+        int numPush = round % 9;
+        for (int i = 0; i < numPush; i++)
+        {
+            if (ring.Push(MakeItem(nextPush)))
+                nextPush++;
+        }
+
+        int numPop = (round * 5) % 9;
+        for (int i = 0; i < numPop && ring.Pop(item); i++)
+        {
+            TEST_ASSERT_TRUE(IsValidItem(item, nextPop));
+            nextPop++;
+        }
+
+        TEST_ASSERT_EQUAL_UINT32(nextPush - nextPop, ring.Size());
+    }
+
+    while (ring.Pop(item))
+    {
+        TEST_ASSERT_TRUE(IsValidItem(item, nextPop));
+        nextPop++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(nextPush, nextPop);
+    TEST_ASSERT_GREATER_THAN(1000, nextPop);
+}
+
+// Number of items passed between the threads in the stress test
+#define NUM_STRESS_ITEMS 500000
+
+// The producer and consumer run on separate threads (and usually separate
+// cores) without any synchronization except the ring itself. Each item
+// must arrive exactly once, in order and completely written.
+static void test_two_threads_stress()
+{
+    static SpscRing<Item, 16> ring;
+
+    std::thread producer([]() {
+        for (uint32_t i = 0; i < NUM_STRESS_ITEMS; i++)
+        {
+            while (!ring.Push(MakeItem(i)))
+                Pause();
+        }
+    });
+
+    uint32_t numReceived = 0;
+    uint32_t numInvalid = 0;
+    Item item;
+    while (numReceived < NUM_STRESS_ITEMS)
+    {
+        if (!ring.Pop(item))
+        {
+            Pause();
+            continue;
+        }
+
+        if (!IsValidItem(item, numReceived))
+            numInvalid++;
+        numReceived++;
+    }
+
+    producer.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, numInvalid);
+    TEST_ASSERT_EQUAL_UINT32(NUM_STRESS_ITEMS, numReceived);
+    TEST_ASSERT_TRUE(ring.IsEmpty());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_new_ring_is_empty);
+    RUN_TEST(test_full_ring_rejects_item);
+    RUN_TEST(test_space_is_reused_after_pop);
+    RUN_TEST(test_wrap_around_keeps_order);
+    RUN_TEST(test_two_threads_stress);
+    return UNITY_END();
+}
@@ -0,0 +1,188 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * SX126x command sequences in the event file format (see replay.h).
+ * They can also be replayed with a host build compiled with RADIO_SX126X.
+ */
+
+#ifndef SX126X_TRACES_H
+#define SX126X_TRACES_H
+
+// Two LoRaWAN uplinks (EU868, SF7, 13 bytes) with RX1 and RX2 timeout, with
+// a command sequence modeled on the LoRaMac-node SX126x driver: SetPacketType,
+// SetRfFrequency, SetModulationParams (4 parameters), SetPacketParams
+// (6 parameters), buffer setup, SetDioIrqParams, SetTx/SetRx, GetIrqStatus
+// and ClearIrqStatus after DIO1, SetStandby.
+static const char SX126X_LORA_TRACE[] = R"(
+1000000 SPI 80 00
+1000060 SPI 8a 01
+1000120 SPI 86 36 41 99 9a
+1000180 SPI 8b 07 04 01 00
+1000240 SPI 8c 00 08 00 0d 01 00
+1000300 SPI 8f 00 00
+1000360 SPI 0e 00 40 78 56 34 12 00 00 00 01 9d 8e 32 44
+1000420 SPI 08 02 01 02 01 00 00 00 00
+1000480 SPI 83 00 00 00
+1046966 DIO1
+1047026 SPI 12 00 00 00
+1047086 SPI 02 ff ff
+2044830 SPI 80 00
+2044890 SPI 86 36 41 99 9a
+2044950 SPI 8b 07 04 01 00
+2045010 SPI 8c 00 08 00 ff 00 01
+2045070 SPI a0 08
+2045130 SPI 08 02 02 02 02 00 00 00 00
+2045190 SPI 82 00 00 00
+2053432 DIO1
+2053492 SPI 12 00 00 00
+2053552 SPI 02 ff ff
+2053612 SPI 80 00
+2997214 SPI 80 00
+2997274 SPI 86 36 58 66 66
+2997334 SPI 8b 0c 04 01 01
+2997394 SPI 8c 00 08 00 ff 00 01
+2997454 SPI a0 08
+2997514 SPI 08 02 02 02 02 00 00 00 00
+2997574 SPI 82 00 00 00
+3259768 DIO1
+3259828 SPI 12 00 00 00
+3259888 SPI 02 ff ff
+3259948 SPI 80 00
+6000000 SPI 80 00
+6000060 SPI 8a 01
+6000120 SPI 86 36 41 99 9a
+6000180 SPI 8b 07 04 01 00
+6000240 SPI 8c 00 08 00 0d 01 00
+6000300 SPI 8f 00 00
+6000360 SPI 0e 00 40 78 56 34 12 00 01 00 01 9d 8e 32 44
+6000420 SPI 08 02 01 02 01 00 00 00 00
+6000480 SPI 83 00 00 00
+6046966 DIO1
+6047026 SPI 12 00 00 00
+6047086 SPI 02 ff ff
+7044830 SPI 80 00
+7044890 SPI 86 36 41 99 9a
+7044950 SPI 8b 07 04 01 00
+7045010 SPI 8c 00 08 00 ff 00 01
+7045070 SPI a0 08
+7045130 SPI 08 02 02 02 02 00 00 00 00
+7045190 SPI 82 00 00 00
+7053432 DIO1
+7053492 SPI 12 00 00 00
+7053552 SPI 02 ff ff
+7053612 SPI 80 00
+7997214 SPI 80 00
+7997274 SPI 86 36 58 66 66
+7997334 SPI 8b 0c 04 01 01
+7997394 SPI 8c 00 08 00 ff 00 01
+7997454 SPI a0 08
+7997514 SPI 08 02 02 02 02 00 00 00 00
+7997574 SPI 82 00 00 00
+8259768 DIO1
+8259828 SPI 12 00 00 00
+8259888 SPI 02 ff ff
+8259948 SPI 80 00
+)";
+
+// Same as above, but with a driver that always sends 8 modulation
+// parameters and 9 packet parameters (unused parameters are 0)
+static const char SX126X_LORA_PADDED_TRACE[] = R"(
+1000000 SPI 80 00
+1000060 SPI 8a 01
+1000120 SPI 86 36 41 99 9a
+1000180 SPI 8b 07 04 01 00 00 00 00 00
+1000240 SPI 8c 00 08 00 0d 01 00 00 00 00
+1000300 SPI 8f 00 00
+1000360 SPI 0e 00 40 78 56 34 12 00 00 00 01 9d 8e 32 44
+1000420 SPI 08 02 01 02 01 00 00 00 00
+1000480 SPI 83 00 00 00
+1046966 DIO1
+1047026 SPI 12 00 00 00
+1047086 SPI 02 ff ff
+2044830 SPI 80 00
+2044890 SPI 86 36 41 99 9a
+2044950 SPI 8b 07 04 01 00 00 00 00 00
+2045010 SPI 8c 00 08 00 ff 00 01 00 00 00
+2045070 SPI a0 08
+2045130 SPI 08 02 02 02 02 00 00 00 00
+2045190 SPI 82 00 00 00
+2053432 DIO1
+2053492 SPI 12 00 00 00
+2053552 SPI 02 ff ff
+2053612 SPI 80 00
+2997214 SPI 80 00
+2997274 SPI 86 36 58 66 66
+2997334 SPI 8b 0c 04 01 01 00 00 00 00
+2997394 SPI 8c 00 08 00 ff 00 01 00 00 00
+2997454 SPI a0 08
+2997514 SPI 08 02 02 02 02 00 00 00 00
+2997574 SPI 82 00 00 00
+3259768 DIO1
+3259828 SPI 12 00 00 00
+3259888 SPI 02 ff ff
+3259948 SPI 80 00
+6000000 SPI 80 00
+6000060 SPI 8a 01
+6000120 SPI 86 36 41 99 9a
+6000180 SPI 8b 07 04 01 00 00 00 00 00
+6000240 SPI 8c 00 08 00 0d 01 00 00 00 00
+6000300 SPI 8f 00 00
+6000360 SPI 0e 00 40 78 56 34 12 00 01 00 01 9d 8e 32 44
+6000420 SPI 08 02 01 02 01 00 00 00 00
+6000480 SPI 83 00 00 00
+6046966 DIO1
+6047026 SPI 12 00 00 00
+6047086 SPI 02 ff ff
+7044830 SPI 80 00
+7044890 SPI 86 36 41 99 9a
+7044950 SPI 8b 07 04 01 00 00 00 00 00
+7045010 SPI 8c 00 08 00 ff 00 01 00 00 00
+7045070 SPI a0 08
+7045130 SPI 08 02 02 02 02 00 00 00 00
+7045190 SPI 82 00 00 00
+7053432 DIO1
+7053492 SPI 12 00 00 00
+7053552 SPI 02 ff ff
+7053612 SPI 80 00
+7997214 SPI 80 00
+7997274 SPI 86 36 58 66 66
+7997334 SPI 8b 0c 04 01 01 00 00 00 00
+7997394 SPI 8c 00 08 00 ff 00 01 00 00 00
+7997454 SPI a0 08
+7997514 SPI 08 02 02 02 02 00 00 00 00
+7997574 SPI 82 00 00 00
+8259768 DIO1
+8259828 SPI 12 00 00 00
+8259888 SPI 02 ff ff
+8259948 SPI 80 00
+)";
+
+// GFSK uplink (EU868 DR7: 50 kbps, 20 bytes) and a downlink
+// of 17 bytes received in RX1 (RX timeout set with SetRx)
+static const char SX126X_GFSK_TRACE[] = R"(
+1000000 SPI 80 00
+1000060 SPI 8a 00
+1000120 SPI 86 36 4c cc cd
+1000180 SPI 8b 00 50 00 09 1a 00 66 66
+1000240 SPI 8c 00 28 05 18 00 01 14 f2 01
+1000300 SPI 8f 00 00
+1000360 SPI 0e 00 40 78 56 34 12 00 05 00 01 00 01 02 03 04 05 06 9d 8e 32 44
+1000420 SPI 83 00 00 00
+1005480 DIO1
+1005540 SPI 02 ff ff
+2004980 SPI 80 00
+2005040 SPI 8b 00 50 00 09 1a 00 66 66
+2005100 SPI 8c 00 28 05 18 00 01 ff f2 01
+2005160 SPI 82 00 01 40
+2010540 DIO1
+2010600 SPI 12 00 00 00
+2010660 SPI 13 00 00 00
+2010720 SPI 1e 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00
+2010780 SPI 80 00
+)";
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the SX126x decoder with recorded command sequences
+ */
+
+#include "host_serial.h"
+#include "main.h"
+#include "replay.h"
+#include "sx126x_analyzer.h"
+#include "sx126x_traces.h"
+#include <string>
+#include <unity.h>
+
+// Small SPI buffer so transactions wrap around
+#define SPI_BUF_LEN 64
+
+static uint8_t spiBuf[SPI_BUF_LEN];
+static uint32_t spiPos;
+static TimingAnalyzer *timingAnalyzer;
+static Sx126xAnalyzer *analyzer;
+static std::string output;
+
+
+// Writes the transaction to the SPI buffer (like the DMA) and decodes it
+static void Trx(uint64_t time, const uint8_t *data, size_t len)
+{
+    const uint8_t *startTrx = spiBuf + (spiPos & (SPI_BUF_LEN - 1));
+    for (size_t i = 0; i < len; i++)
+    {
+        spiBuf[spiPos & (SPI_BUF_LEN - 1)] = data[i];
+        spiPos++;
+    }
+    const uint8_t *endTrx = spiBuf + (spiPos & (SPI_BUF_LEN - 1));
+    analyzer->OnTrx(time, startTrx, endTrx);
+}
+
+template <size_t N>
+static void Trx(const uint8_t (&data)[N])
+{
+    Trx(0, data, N);
+}
+
+static void DecodeEvent(const RecordedEvent &event, void *)
+{
+    if (event.type == RecordedEventSpi)
+        Trx(event.time, event.data, event.len);
+    else if (event.type == RecordedEventDio1)
+        analyzer->OnDio1(event.time);
+    else
+        analyzer->OnDio0(event.time);
+}
+
+// Decodes the trace and returns the analysis output
+static std::string DecodeTrace(const char *trace)
+{
+    output.clear();
+    TEST_ASSERT_TRUE(ReadEventText(trace, DecodeEvent, nullptr));
+    Output.Flush();
+    return output;
+}
+
+static int CountOccurrences(const std::string &text, const char *str)
+{
+    int count = 0;
+    size_t pos = 0;
+    while ((pos = text.find(str, pos)) != std::string::npos)
+    {
+        count++;
+        pos++;
+    }
+    return count;
+}
+
+void setUp()
+{
+    spiPos = 0;
+    timingAnalyzer = new TimingAnalyzer();
+    analyzer = new Sx126xAnalyzer(spiBuf, SPI_BUF_LEN, *timingAnalyzer);
+    HostSerial.SetCapture(&output);
+}
+
+void tearDown()
+{
+    Output.Flush();
+    HostSerial.SetCapture(nullptr);
+    delete analyzer;
+    delete timingAnalyzer;
+}
+
+static void test_lora_sequence()
+{
+    std::string result = DecodeTrace(SX126X_LORA_TRACE);
+
+    TEST_ASSERT_EQUAL_INT(2, CountOccurrences(result,
+            "SF7, 125000 Hz, 868.100 MHz, payload = 13 bytes, airtime = 46336us, ramp-up = 150us\r\n"));
+    TEST_ASSERT_EQUAL_INT(2, CountOccurrences(result, ": RX1 timeout\r\n"
+            "          SF7, 125000 Hz, 868.100 MHz, airtime = 8192us, ramp-up = 50us\r\n"));
+    TEST_ASSERT_EQUAL_INT(2, CountOccurrences(result, ": RX2 timeout\r\n"
+            "          SF12, 125000 Hz, 869.525 MHz, airtime = 262144us, ramp-up = 50us\r\n"));
+    TEST_ASSERT_EQUAL_INT(869525000, analyzer->Frequency());
+}
+
+// Unused parameter bytes must not change the interpretation
+static void test_lora_sequence_with_padded_parameters()
+{
+    std::string expected = DecodeTrace(SX126X_LORA_TRACE);
+
+    tearDown();
+    setUp();
+    std::string result = DecodeTrace(SX126X_LORA_PADDED_TRACE);
+
+    TEST_ASSERT_TRUE(result.size() > 0);
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), result.c_str());
+}
+
+static void test_gfsk_sequence()
+{
+    std::string result = DecodeTrace(SX126X_GFSK_TRACE);
+
+    TEST_ASSERT_EQUAL_INT(1, CountOccurrences(result,
+            "FSK, 50000 bps, fdev = 25000 Hz, 868.800 MHz, payload = 20 bytes, airtime = 4960us, ramp-up = 100us\r\n"));
+    TEST_ASSERT_EQUAL_INT(1, CountOccurrences(result, ": RX1: downlink packet received\r\n"
+            "          FSK, 50000 bps, fdev = 25000 Hz, 868.800 MHz, payload = 17 bytes, airtime = 4480us\r\n"));
+}
+
+// After switching from GFSK to LoRa and back, the parameters of each packet
+// type are decoded according to the current type
+static void test_packet_type_switch()
+{
+    DecodeTrace(SX126X_GFSK_TRACE);
+    std::string result = DecodeTrace(SX126X_LORA_TRACE);
+    TEST_ASSERT_EQUAL_INT(2, CountOccurrences(result,
+            "SF7, 125000 Hz, 868.100 MHz, payload = 13 bytes, airtime = 46336us, ramp-up = 150us\r\n"));
+
+    result = DecodeTrace(SX126X_GFSK_TRACE);
+    TEST_ASSERT_EQUAL_INT(1, CountOccurrences(result,
+            "FSK, 50000 bps, fdev = 25000 Hz, 868.800 MHz, payload = 20 bytes, airtime = 4960us, ramp-up = 100us\r\n"));
+}
+
+// Modulation and packet parameters sent for another packet type are ignored
+static void test_parameters_of_other_packet_type_ignored()
+{
+    static const uint8_t SET_PACKET_TYPE_LORA[] = { 0x8a, 0x01 };
+    static const uint8_t SET_PACKET_TYPE_GFSK[] = { 0x8a, 0x00 };
+    static const uint8_t SET_LORA_SF9[] = { 0x8b, 0x09, 0x04, 0x01, 0x00 };
+    static const uint8_t SET_LORA_SF12_PADDED[] = { 0x8b, 0x0c, 0x04, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00 };
+    static const uint8_t SET_GFSK_PACKET[] = { 0x8c, 0x00, 0x28, 0x05, 0x18, 0x00, 0x01, 0x40, 0xf2, 0x01 };
+    static const uint8_t SET_LORA_PACKET[] = { 0x8c, 0x00, 0x08, 0x00, 0x0d, 0x01, 0x00 };
+
+    Trx(SET_PACKET_TYPE_LORA);
+    Trx(SET_LORA_SF9);
+    Trx(SET_LORA_PACKET);
+    int32_t airTime = timingAnalyzer->PayloadAirTime(13);
+    TEST_ASSERT_EQUAL_INT32(4096, timingAnalyzer->SymbolDuration(1));
+
+    // LoRa parameters and packet parameters with the length of
+    // GFSK parameters while in GFSK mode
+    Trx(SET_PACKET_TYPE_GFSK);
+    Trx(SET_LORA_SF12_PADDED);
+    Trx(SET_GFSK_PACKET);
+    Trx(SET_PACKET_TYPE_LORA);
+    TEST_ASSERT_EQUAL_INT32(4096, timingAnalyzer->SymbolDuration(1));
+    TEST_ASSERT_EQUAL_INT32(airTime, timingAnalyzer->PayloadAirTime(13));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_lora_sequence);
+    RUN_TEST(test_lora_sequence_with_padded_parameters);
+    RUN_TEST(test_gfsk_sequence);
+    RUN_TEST(test_packet_type_switch);
+    RUN_TEST(test_parameters_of_other_packet_type_ignored);
+    return UNITY_END();
+}
@@ -0,0 +1,284 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the time functions with a simulated SysTick timer
+ * (rollover of the SysTick counter, of the millisecond counter and
+ * of the millisecond epoch)
+ */
+
+#include "timing.h"
+#include <random>
+#include <unity.h>
+
+extern "C" void SysTick_Handler();
+
+// SysTick reload value for 72 MHz
+#define LOAD_72MHZ 71999
+
+// Simulated SysTick clock: total number of ticks since start
+static uint64_t simTicks;
+// Number of ticks the clock advances on each read of the SysTick counter
+static uint32_t simTicksPerRead;
+// Tick count at the last read of the SysTick counter
+static uint64_t lastReadTicks;
+// Indicates if the SysTick interrupt is blocked (code running in ISR)
+static bool isInterruptBlocked;
+static std::mt19937 rng(1);
+
+
+static uint32_t TickInPeriod(uint64_t ticks)
+{
+    return (uint32_t)(ticks % (SysTick->LOAD + 1));
+}
+
+// Advances the simulated clock; the SysTick interrupt runs immediately
+// unless blocked, in which case it becomes pending
+static void AdvanceClock(uint32_t ticks)
+{
+    uint64_t periodBefore = simTicks / (SysTick->LOAD + 1);
+    simTicks += ticks;
+    uint64_t periodAfter = simTicks / (SysTick->LOAD + 1);
+    SysTick->VAL = SysTick->LOAD - TickInPeriod(simTicks);
+
+    for (uint64_t i = periodBefore; i < periodAfter; i++)
+    {
+        if (isInterruptBlocked)
+            SCB->ICSR |= SCB_ICSR_PENDSTSET_Msk;
+        else
+            SysTick_Handler();
+    }
+}
+
+// Hook called on each read of the SysTick counter: the clock advances
+// before the value is returned
+static void OnSysTickRead()
+{
+    AdvanceClock(simTicksPerRead);
+    lastReadTicks = simTicks;
+}
+
+// Runs the pending SysTick interrupt (after an ISR completes)
+static void RunPendingSysTick()
+{
+    if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0)
+    {
+        SCB->ICSR &= ~SCB_ICSR_PENDSTSET_Msk;
+        SysTick_Handler();
+    }
+}
+
+// Sets the simulated clock to the start of the given millisecond
+// (SysTick counter just reloaded)
+static void StartClock(uint64_t millis)
+{
+    SysTick->VAL.onRead = nullptr;
+    simTicks = millis * (SysTick->LOAD + 1);
+    SysTick->VAL = SysTick->LOAD;
+    UptimeMillis = (uint32_t)millis;
+    UptimeMillisEpoch = (uint32_t)(millis >> 32);
+    SCB->ICSR = 0;
+    isInterruptBlocked = false;
+    simTicksPerRead = 0;
+}
+
+// Checks that the time returned for the last counter read is correct:
+// it must be the number of complete microseconds (rounded up to the
+// granularity of the conversion)
+static void AssertMicrosMatchClock(uint64_t micros)
+{
+    uint32_t ticksPerMicro = (SysTick->LOAD + 1) / 1000;
+    uint64_t expected = lastReadTicks / ticksPerMicro;
+    TEST_ASSERT_TRUE(micros >= expected);
+    TEST_ASSERT_TRUE(micros <= expected + 1);
+}
+
+void setUp()
+{
+    SysTick->LOAD = LOAD_72MHZ;
+    InitMicros();
+    StartClock(0);
+}
+
+void tearDown()
+{
+    SysTick->VAL.onRead = nullptr;
+}
+
+static void test_systick_handler_increments_millis()
+{
+    StartClock(1000);
+    SysTick_Handler();
+    TEST_ASSERT_EQUAL_UINT32(1001, UptimeMillis);
+    TEST_ASSERT_EQUAL_UINT32(0, UptimeMillisEpoch);
+}
+
+static void test_uptime_millis_wrap_increments_epoch()
+{
+    StartClock(0x3FFFFFFFEULL);
+    SysTick_Handler();
+    TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFF, UptimeMillis);
+    TEST_ASSERT_EQUAL_UINT32(3, UptimeMillisEpoch);
+
+    SysTick_Handler();
+    TEST_ASSERT_EQUAL_UINT32(0, UptimeMillis);
+    TEST_ASSERT_EQUAL_UINT32(4, UptimeMillisEpoch);
+
+    SysTick_Handler();
+    TEST_ASSERT_EQUAL_UINT32(1, UptimeMillis);
+    TEST_ASSERT_EQUAL_UINT32(4, UptimeMillisEpoch);
+}
+
+static void test_micros_within_period()
+{
+    StartClock(5000);
+
+    // counter just reloaded
+    TEST_ASSERT_EQUAL_UINT64(5000001, GetMicros());
+    // counter about to reload
+    SysTick->VAL = 0;
+    TEST_ASSERT_EQUAL_UINT64(5001000, GetMicros());
+    // middle of the period
+    SysTick->VAL = 36000;
+    TEST_ASSERT_EQUAL_UINT64(5000500, GetMicros());
+}
+
+static void test_micros_beyond_32_bit_millis()
+{
+    StartClock(0x1FFFFFFFFULL);
+    SysTick->VAL = 36000;
+    TEST_ASSERT_EQUAL_UINT64(0x1FFFFFFFFULL * 1000 + 500, GetMicros());
+    TEST_ASSERT_EQUAL_UINT64(0x1FFFFFFFFULL * 1000 + 500, GetMicrosFromISR());
+}
+
+// The SysTick counter reloads (and the SysTick handler runs) after the
+// millisecond count has been read but before the counter is read.
+// Without the retry, the time would jump back by 1ms.
+static void test_systick_reload_while_reading()
+{
+    StartClock(7000);
+    AdvanceClock(SysTick->LOAD - 2);
+    uint64_t before = GetMicros();
+
+    simTicksPerRead = 5;
+    SysTick->VAL.onRead = OnSysTickRead;
+    uint64_t micros = GetMicros();
+
+    TEST_ASSERT_EQUAL_UINT32(7001, UptimeMillis);
+    AssertMicrosMatchClock(micros);
+    TEST_ASSERT_TRUE(micros > before);
+}
+
+// Same as above but the millisecond counter wraps around
+// and the epoch is incremented while reading
+static void test_epoch_increment_while_reading()
+{
+    StartClock(0xFFFFFFFFULL);
+    AdvanceClock(SysTick->LOAD - 2);
+    uint64_t before = GetMicros();
+
+    simTicksPerRead = 5;
+    SysTick->VAL.onRead = OnSysTickRead;
+    uint64_t micros = GetMicros();
+
+    TEST_ASSERT_EQUAL_UINT32(0, UptimeMillis);
+    TEST_ASSERT_EQUAL_UINT32(1, UptimeMillisEpoch);
+    AssertMicrosMatchClock(micros);
+    TEST_ASSERT_TRUE(micros > before);
+    TEST_ASSERT_TRUE(micros >= 0x100000000ULL * 1000);
+}
+
+// In an interrupt handler, the SysTick interrupt is pending if the counter
+// has reloaded. The millisecond count is then one behind.
+static void test_micros_from_isr_with_pending_systick()
+{
+    StartClock(9000);
+    AdvanceClock(SysTick->LOAD - 2);
+    isInterruptBlocked = true;
+
+    // reload before the counter is read
+    simTicksPerRead = 5;
+    SysTick->VAL.onRead = OnSysTickRead;
+    uint64_t micros = GetMicrosFromISR();
+
+    TEST_ASSERT_EQUAL_UINT32(9000, UptimeMillis);
+    AssertMicrosMatchClock(micros);
+
+    RunPendingSysTick();
+    TEST_ASSERT_EQUAL_UINT32(9001, UptimeMillis);
+}
+
+// Hook simulating that the counter is read just before it reloads:
+// the SysTick interrupt becomes pending right after the read
+static void OnReadJustBeforeReload()
+{
+    SysTick->VAL.value = 1;
+    SCB->ICSR |= SCB_ICSR_PENDSTSET_Msk;
+}
+
+// The counter is read just before the reload, the pending flag just after.
+// The millisecond count must not be incremented.
+static void test_micros_from_isr_with_reload_after_read()
+{
+    StartClock(9000);
+    isInterruptBlocked = true;
+    SysTick->VAL.onRead = OnReadJustBeforeReload;
+
+    TEST_ASSERT_EQUAL_UINT64(9001000, GetMicrosFromISR());
+}
+
+// Reads the time continuously with the clock advancing by a random
+// number of ticks between reads, across many SysTick reloads and
+// the wraparound of the millisecond counter. The time must be correct
+// and never go backwards, from the main loop and from an ISR.
+static void test_monotonic_across_rollovers()
+{
+    for (int isr = 0; isr < 2; isr++)
+    {
+        StartClock(0xFFFFFFFCULL);
+        SysTick->VAL.onRead = OnSysTickRead;
+        uint64_t end = simTicks + 8 * (uint64_t)(SysTick->LOAD + 1);
+        uint64_t last = 0;
+
+        while (simTicks < end)
+        {
+            simTicksPerRead = rng() % 400 + 1;
+            uint64_t micros;
+            if (isr != 0)
+            {
+                isInterruptBlocked = true;
+                micros = GetMicrosFromISR();
+                isInterruptBlocked = false;
+                RunPendingSysTick();
+            }
+            else
+            {
+                micros = GetMicros();
+            }
+
+            AssertMicrosMatchClock(micros);
+            TEST_ASSERT_TRUE(micros >= last);
+            last = micros;
+        }
+
+        TEST_ASSERT_EQUAL_UINT32(1, UptimeMillisEpoch);
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_systick_handler_increments_millis);
+    RUN_TEST(test_uptime_millis_wrap_increments_epoch);
+    RUN_TEST(test_micros_within_period);
+    RUN_TEST(test_micros_beyond_32_bit_millis);
+    RUN_TEST(test_systick_reload_while_reading);
+    RUN_TEST(test_epoch_increment_while_reading);
+    RUN_TEST(test_micros_from_isr_with_pending_systick);
+    RUN_TEST(test_micros_from_isr_with_reload_after_read);
+    RUN_TEST(test_monotonic_across_rollovers);
+    return UNITY_END();
+}
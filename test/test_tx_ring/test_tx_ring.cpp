@@ -0,0 +1,338 @@
+/*
+ * SX127x Probe - STM32F1x software to monitor LoRa timings
+ *
+ * Copyright (c) 2019 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Unit tests for the transmit ring with a simulated transport
+ */
+
+#include "tx_ring.h"
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+#define BUF_LEN 256
+#define QUEUE_LEN 8
+
+// Simulated transport: transfers complete when the test calls `Complete()`
+// (or while the ring blocks if `completesWhileBlocking` is set)
+struct MockTransport
+{
+    static bool IsReady() { return isConnected && transferData == nullptr; }
+
+    static void Transmit(const uint8_t *data, size_t len)
+    {
+        transferData = data;
+        transferLen = len;
+        numTransfers++;
+    }
+
+    static uint32_t Millis()
+    {
+        if (completesWhileBlocking && transferData != nullptr)
+            Complete();
+        return millis++;
+    }
+
+    // Completes the transfer in progress (like the completion interrupt)
+    static void Complete()
+    {
+        TEST_ASSERT_NOT_NULL(transferData);
+        received.append((const char *)transferData, transferLen);
+        transferData = nullptr;
+        transmissionCompleted();
+    }
+
+    static bool isConnected;
+    static bool completesWhileBlocking;
+    static const uint8_t *transferData;
+    static size_t transferLen;
+    static int numTransfers;
+    static uint32_t millis;
+    // Data received by the other end
+    static std::string received;
+    // Calls `TransmissionCompleted()` of the ring under test
+    static void (*transmissionCompleted)();
+};
+
+bool MockTransport::isConnected;
+bool MockTransport::completesWhileBlocking;
+const uint8_t *MockTransport::transferData;
+size_t MockTransport::transferLen;
+int MockTransport::numTransfers;
+uint32_t MockTransport::millis;
+std::string MockTransport::received;
+void (*MockTransport::transmissionCompleted)();
+
+// Ring under test for the given overflow policy
+template <TxOverflowPolicy POLICY>
+struct TestRing
+{
+    typedef TxRing<BUF_LEN, QUEUE_LEN, MockTransport, POLICY> Ring;
+
+    static void TransmissionCompleted() { ring->TransmissionCompleted(); }
+
+    static Ring *ring;
+};
+
+template <TxOverflowPolicy POLICY> typename TestRing<POLICY>::Ring *TestRing<POLICY>::ring = nullptr;
+
+typedef TestRing<TxDropNewest>::Ring Ring;
+
+static Ring *ring;
+static std::string &received = MockTransport::received;
+static std::mt19937 rng(1);
+
+
+static void Complete()
+{
+    MockTransport::Complete();
+}
+
+// Completes all transfers until the ring is empty
+static void CompleteAll()
+{
+    while (MockTransport::transferData != nullptr)
+        MockTransport::Complete();
+}
+
+static bool Write(const std::string &message, TxPriority priority = TxPriorityNormal)
+{
+    return ring->Write((const uint8_t *)message.data(), message.size(), priority);
+}
+
+void setUp()
+{
+    MockTransport::isConnected = true;
+    MockTransport::completesWhileBlocking = false;
+    MockTransport::transferData = nullptr;
+    MockTransport::transferLen = 0;
+    MockTransport::numTransfers = 0;
+    MockTransport::millis = 0;
+    received.clear();
+    ring = new Ring();
+    TestRing<TxDropNewest>::ring = ring;
+    MockTransport::transmissionCompleted = TestRing<TxDropNewest>::TransmissionCompleted;
+}
+
+void tearDown()
+{
+    delete ring;
+}
+
+static void test_messages_are_transmitted()
+{
+    TEST_ASSERT_TRUE(Write("first\r\n"));
+    TEST_ASSERT_TRUE(ring->IsTransmitting());
+    TEST_ASSERT_TRUE(Write("second\r\n"));
+    TEST_ASSERT_TRUE(Write("third\r\n"));
+
+    Complete();
+    Complete();
+    TEST_ASSERT_FALSE(ring->IsTransmitting());
+    TEST_ASSERT_TRUE(ring->IsEmpty());
+    TEST_ASSERT_EQUAL_STRING("first\r\nsecond\r\nthird\r\n", received.c_str());
+    TEST_ASSERT_EQUAL_INT(2, MockTransport::numTransfers);
+}
+
+// Data crossing the end of the buffer is transmitted in the right order
+static void test_data_wraps_around()
+{
+    std::string first(200, 'a');
+    std::string second(100, 'b');
+    TEST_ASSERT_TRUE(Write(first));
+    Complete();
+    TEST_ASSERT_TRUE(Write(second));
+    CompleteAll();
+
+    TEST_ASSERT_TRUE(ring->IsEmpty());
+    std::string expected = first + second;
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), received.c_str());
+}
+
+// The connection is reset while a transfer is in progress: the completion
+// never comes. Without the abort, the ring would never transmit again.
+static void test_aborted_transfer_is_retransmitted()
+{
+    TEST_ASSERT_TRUE(Write("before reset\r\n"));
+    TEST_ASSERT_TRUE(ring->IsTransmitting());
+
+    // reset: the transfer is lost
+    MockTransport::isConnected = false;
+    MockTransport::transferData = nullptr;
+    ring->TransmissionAborted();
+    TEST_ASSERT_FALSE(ring->IsTransmitting());
+
+    TEST_ASSERT_TRUE(Write("while disconnected\r\n"));
+    TEST_ASSERT_FALSE(ring->IsTransmitting());
+
+    // reconnected
+    MockTransport::isConnected = true;
+    ring->StartTransmit();
+    TEST_ASSERT_TRUE(ring->IsTransmitting());
+    Complete();
+    Complete();
+
+    TEST_ASSERT_TRUE(ring->IsEmpty());
+    TEST_ASSERT_EQUAL_STRING("before reset\r\nwhile disconnected\r\n", received.c_str());
+    TEST_ASSERT_EQUAL_UINT32(0, ring->DropStatistics().numDroppedMessages);
+}
+
+// Aborting without a transfer in progress has no effect
+static void test_abort_when_idle()
+{
+    ring->TransmissionAborted();
+    TEST_ASSERT_TRUE(Write("message\r\n"));
+    Complete();
+    ring->TransmissionAborted();
+    ring->StartTransmit();
+
+    TEST_ASSERT_TRUE(ring->IsEmpty());
+    TEST_ASSERT_EQUAL_INT(1, MockTransport::numTransfers);
+    TEST_ASSERT_EQUAL_STRING("message\r\n", received.c_str());
+}
+
+// Message with number, filled up to the given length and terminated with LF
+static std::string NumberedMessage(size_t messageNo, size_t len)
+{
+    std::string message = std::to_string(messageNo) + " ";
+    message.resize(len - 1, (char)('a' + messageNo % 26));
+    return message + "\n";
+}
+
+// Writes messages of random length (up to more than the buffer length) and
+// priority while transfers complete at random. Each message must either arrive
+// intact and in order, or be counted as dropped with all its bytes.
+template <TxOverflowPolicy POLICY>
+static void SimulateRandomLoad()
+{
+    typedef TestRing<POLICY> Test;
+    Test::ring = new typename Test::Ring();
+    MockTransport::transmissionCompleted = Test::TransmissionCompleted;
+    MockTransport::completesWhileBlocking = POLICY == TxBlock;
+
+    const size_t numMessages = 5000;
+    std::vector<size_t> lengths;
+    uint32_t numWrittenBytes = 0;
+    uint32_t numFailedWrites = 0;
+
+    for (size_t i = 0; i < numMessages; i++)
+    {
+        size_t len = rng() % 8 == 0 ? BUF_LEN / 2 + rng() % BUF_LEN : 8 + rng() % 40;
+        lengths.push_back(len);
+        numWrittenBytes += len;
+
+        std::string message = NumberedMessage(i, len);
+        TxPriority priority = rng() % 4 == 0 ? TxPriorityLow : TxPriorityNormal;
+        if (!Test::ring->Write((const uint8_t *)message.data(), len, priority))
+            numFailedWrites++;
+
+        // the link is slower than the writes
+        if (MockTransport::transferData != nullptr && rng() % 3 == 0)
+            Complete();
+    }
+    CompleteAll();
+    TEST_ASSERT_TRUE(Test::ring->IsEmpty());
+
+    // verify the received messages
+    uint32_t numReceived = 0;
+    long lastMessageNo = -1;
+    size_t start = 0;
+    while (start < received.size())
+    {
+        size_t end = received.find('\n', start);
+        TEST_ASSERT_TRUE_MESSAGE(end != std::string::npos, "incomplete message");
+        std::string message = received.substr(start, end + 1 - start);
+        long messageNo = atol(message.c_str());
+        TEST_ASSERT_TRUE(messageNo > lastMessageNo && messageNo < (long)numMessages);
+        std::string expected = NumberedMessage(messageNo, lengths[messageNo]);
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), message.c_str());
+        lastMessageNo = messageNo;
+        numReceived++;
+        start = end + 1;
+    }
+
+    const TxDropStatistics &statistics = Test::ring->DropStatistics();
+    TEST_ASSERT_TRUE(statistics.numDroppedMessages > 0);
+    TEST_ASSERT_TRUE(numReceived > numMessages / 10);
+    TEST_ASSERT_EQUAL_UINT32(numMessages - numReceived, statistics.numDroppedMessages);
+    TEST_ASSERT_EQUAL_UINT32(numWrittenBytes - received.size(), statistics.numDroppedBytes);
+    if (POLICY != TxDropOldest)
+        TEST_ASSERT_EQUAL_UINT32(numFailedWrites, statistics.numDroppedMessages);
+
+    delete Test::ring;
+}
+
+static void test_drop_accounting_drop_newest()
+{
+    SimulateRandomLoad<TxDropNewest>();
+}
+
+static void test_drop_accounting_drop_oldest()
+{
+    SimulateRandomLoad<TxDropOldest>();
+}
+
+static void test_drop_accounting_block()
+{
+    SimulateRandomLoad<TxBlock>();
+}
+
+static void test_drop_accounting_coalesce()
+{
+    SimulateRandomLoad<TxCoalesce>();
+}
+
+// A message longer than half the buffer is written as a whole if it fits,
+// or dropped as a whole if it doesn't
+static void test_long_message_is_not_split()
+{
+    std::string first = NumberedMessage(1, BUF_LEN / 2 + 20);
+    TEST_ASSERT_TRUE(Write(first));
+    std::string second = NumberedMessage(2, BUF_LEN / 2 + 20);
+    TEST_ASSERT_FALSE(Write(second));
+    TEST_ASSERT_EQUAL_UINT32(1, ring->DropStatistics().numDroppedMessages);
+    TEST_ASSERT_EQUAL_UINT32(second.size(), ring->DropStatistics().numDroppedBytes);
+
+    Complete();
+    TEST_ASSERT_TRUE(Write(second));
+    CompleteAll();
+    TEST_ASSERT_TRUE(ring->IsEmpty());
+    std::string expected = first + second;
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), received.c_str());
+}
+
+// A message longer than the buffer can never be written
+static void test_message_longer_than_buffer_is_dropped()
+{
+    TEST_ASSERT_FALSE(Write(NumberedMessage(1, BUF_LEN + 1)));
+    TEST_ASSERT_FALSE(ring->IsTransmitting());
+    TEST_ASSERT_EQUAL_UINT32(1, ring->DropStatistics().numDroppedMessages);
+    TEST_ASSERT_EQUAL_UINT32(BUF_LEN + 1, ring->DropStatistics().numDroppedBytes);
+
+    std::string message = NumberedMessage(2, BUF_LEN);
+    TEST_ASSERT_TRUE(Write(message));
+    CompleteAll();
+    TEST_ASSERT_TRUE(ring->IsEmpty());
+    TEST_ASSERT_EQUAL_STRING(message.c_str(), received.c_str());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_messages_are_transmitted);
+    RUN_TEST(test_data_wraps_around);
+    RUN_TEST(test_aborted_transfer_is_retransmitted);
+    RUN_TEST(test_abort_when_idle);
+    RUN_TEST(test_long_message_is_not_split);
+    RUN_TEST(test_message_longer_than_buffer_is_dropped);
+    RUN_TEST(test_drop_accounting_drop_newest);
+    RUN_TEST(test_drop_accounting_drop_oldest);
+    RUN_TEST(test_drop_accounting_block);
+    RUN_TEST(test_drop_accounting_coalesce);
+    return UNITY_END();
+}
@@ -0,0 +1,32 @@
+#
+# SX127x Probe - STM32F1x software to monitor LoRa timings
+#
+# Copyright (c) 2019 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# PlatformIO post script: extracts the format strings (section "fmtstr")
+# of a firmware built with DEFERRED_FORMAT=1 into fmtstr.bin next to
+# the firmware. The host build needs the file to decode the output.
+#
+
+Import("env")
+
+
+def extract_format_strings(source, target, env):
+    elf = target[0].get_abspath()
+    out = env.subst("$BUILD_DIR/fmtstr.bin")
+    env.Execute(env.VerboseAction(
+        '"$OBJCOPY" -O binary --only-section=fmtstr "%s" "%s"' % (elf, out),
+        "Extracting format strings to %s" % out))
+
+
+def is_deferred_format(env):
+    for define in env.get("CPPDEFINES", []):
+        if isinstance(define, (list, tuple)) and define[0] == "DEFERRED_FORMAT":
+            return str(define[1]) == "1"
+    return False
+
+
+if is_deferred_format(env):
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", extract_format_strings)